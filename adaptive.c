@@ -0,0 +1,757 @@
+/**
+ *  Incrementally updated adaptive Huffman tree (FGK algorithm).
+ *
+ *  Nodes are stored in parallel arrays ordered by position, with the root
+ *  at position 0; see adaptive.h. The encoder and decoder both start from
+ *  the same initial tree and apply the same updates, so they agree on
+ *  every codeword without the tree ever being transmitted.
+ *
+ *  A tree with deferred updates is rebuilt from scratch, by the same code
+ *  that ages it, whenever enough symbols have been counted; see
+ *  adaptive.h.
+ */
+
+#include <stdint.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "node.h"
+#include "adaptive.h"
+#include "bitio.h"
+
+/**********************************************************/
+
+PRIVATE void add_new_node (adaptive_tree_t *tree, int symbol);
+PRIVATE void swap_nodes (adaptive_tree_t *tree, int i, int j);
+PRIVATE void swap_codes (adaptive_tree_t *tree, int a, int b);
+PRIVATE void invalidate_codes (adaptive_tree_t *tree);
+PRIVATE void defer_update (adaptive_tree_t *tree, int symbol, bool added);
+PRIVATE void rebuild_tree (adaptive_tree_t *tree, bool halve);
+PRIVATE bool near_root (const adaptive_tree_t *tree, int node);
+PRIVATE void build_decode_table (adaptive_tree_t *tree);
+PRIVATE void fill_decode_table (adaptive_tree_t *tree, int node,
+  int prefix, int depth);
+
+/**********************************************************/
+
+/**
+ *  Set up the initial tree, which has a root with two leaves: one for the
+ *  not seen symbol and one for end of stream. Both are given a weight of
+ *  one, which they keep for the life of the tree, so that every node has
+ *  a non zero weight. The tree is aged whenever its total weight reaches
+ *  2^age_bits. Unless drift_bits is NO_DRIFT_BITS, updates are deferred
+ *  until the symbols counted come to 1/2^drift_bits of the total.
+ */
+    PUBLIC void
+adaptive_init (adaptive_tree_t *tree, int age_bits, int drift_bits)
+{
+    assert (age_bits >= MIN_AGE_BITS && age_bits <= MAX_AGE_BITS);
+    assert (drift_bits >= NO_DRIFT_BITS && drift_bits <= MAX_DRIFT_BITS);
+    tree->age_limit = 1u << age_bits;
+    tree->drift_bits = drift_bits;
+    tree->pending = 0;
+
+    for (int i = 0; i < ADAPTIVE_SYMBOLS; i ++)
+    {
+        tree->leaf [i] = -1;
+        tree->code_epoch [i] = 0;
+    }
+
+    tree->epoch = 1;
+    tree->decode_valid = false;
+    tree->walked = 0;
+    tree->rebuilds = 0;
+    tree->escapes = 0;
+
+    tree->weight [ROOT_NODE] = 2;
+    tree->parent [ROOT_NODE] = -1;
+    tree->child [ROOT_NODE] = ROOT_NODE + 1;
+
+    tree->weight [ROOT_NODE + 1] = 1;
+    tree->parent [ROOT_NODE + 1] = ROOT_NODE;
+    tree->child [ROOT_NODE + 1] = NO_NODE;
+    tree->symbol [ROOT_NODE + 1] = END_OF_STREAM;
+    tree->leaf [SYMBOL_INDEX (END_OF_STREAM)] = ROOT_NODE + 1;
+
+    tree->weight [ROOT_NODE + 2] = 1;
+    tree->parent [ROOT_NODE + 2] = ROOT_NODE;
+    tree->child [ROOT_NODE + 2] = NO_NODE;
+    tree->symbol [ROOT_NODE + 2] = NOT_SEEN;
+    tree->leaf [SYMBOL_INDEX (NOT_SEEN)] = ROOT_NODE + 2;
+
+    tree->next_free_node = ROOT_NODE + 3;
+}
+
+/**********************************************************/
+
+/**
+ *  Test if a symbol has a leaf in the tree yet.
+ */
+    PUBLIC bool
+adaptive_seen (const adaptive_tree_t *tree, int symbol)
+{
+    return tree->leaf [SYMBOL_INDEX (symbol)] != -1;
+}
+
+/**********************************************************/
+
+/**
+ *  Get the codeword for a symbol that is in the tree. Codewords are cached
+ *  between calls, and only worked out again, by walking from the symbol's
+ *  leaf up to the root, once a change to the tree has invalidated them.
+ */
+    PUBLIC const codeword_t *
+adaptive_lookup (adaptive_tree_t *tree, int symbol)
+{
+    int index = SYMBOL_INDEX (symbol);
+    int node = tree->leaf [index];
+    int parent, length = 0;
+    uint64_t bits = 0;
+
+    assert (node != -1);
+
+    if (tree->code_epoch [index] == tree->epoch)
+        return tree->codes + index;
+
+    while (node != ROOT_NODE)
+    {
+        // the first child of a node is reached with a 0 bit, the second
+        // with a 1 bit.
+        parent = tree->parent [node];
+        bits |= (uint64_t) (node - tree->child [parent]) << length;
+        length += 1;
+        node = parent;
+    }
+
+    assert (length < 64);
+    tree->codes [index].bits = bits;
+    tree->codes [index].length = length;
+    tree->code_epoch [index] = tree->epoch;
+
+    return tree->codes + index;
+}
+
+/**********************************************************/
+
+/**
+ *  Add one to the weight of the given symbol, adding it to the tree first
+ *  if it has not been seen before. Each node on the path to the root is
+ *  incremented in turn; before that, it is swapped with the node in the
+ *  lowest position that has the same weight, which keeps the nodes in
+ *  order of weight. A tree with deferred updates only counts the symbol.
+ */
+    PUBLIC void
+adaptive_update (adaptive_tree_t *tree, int symbol)
+{
+    int node, leader, behind, step, middle;
+    unsigned int weight;
+    bool added = !adaptive_seen (tree, symbol);
+
+    if (added)
+        add_new_node (tree, symbol);
+
+    if (tree->drift_bits != NO_DRIFT_BITS)
+    {
+        defer_update (tree, symbol, added);
+        return;
+    }
+
+    node = tree->leaf [SYMBOL_INDEX (symbol)];
+
+    while (node != ROOT_NODE)
+    {
+        weight = tree->weight [node] += 1;
+        leader = node;
+
+        // the leader is the last position whose predecessor weighs at
+        // least as much as the node now does. Usually that is the node
+        // itself, but after the tree has been aged many nodes can share a
+        // weight, so the search gallops back in growing steps, and then
+        // closes in by bisection. The root always weighs enough.
+        if (tree->weight [node - 1] < weight)
+        {
+            behind = node;
+            step = 1;
+
+            while (true)
+            {
+                leader = behind - step;
+                step *= 2;
+
+                if (leader <= ROOT_NODE + 1)
+                {
+                    leader = ROOT_NODE + 1;
+                    break;
+                }
+
+                if (tree->weight [leader - 1] >= weight)
+                    break;
+
+                behind = leader;
+            }
+
+            while (behind - leader > 1)
+            {
+                middle = (leader + behind) / 2;
+
+                if (tree->weight [middle - 1] >= weight)
+                    leader = middle;
+                else
+                    behind = middle;
+            }
+        }
+
+        if (leader != node)
+        {
+            swap_nodes (tree, node, leader);
+            node = leader;
+        }
+
+        node = tree->parent [node];
+    }
+
+    tree->weight [ROOT_NODE] += 1;
+
+    if (tree->weight [ROOT_NODE] >= tree->age_limit)
+        rebuild_tree (tree, true);
+}
+
+/**********************************************************/
+
+/**
+ *  Count a symbol, which is in the tree by now, leaving the rest of the
+ *  tree alone, and rebuild the tree if it is due: aged if the total has
+ *  reached the age limit, or just brought up to date if the symbols
+ *  counted since the last rebuild have reached the drift limit, or if the
+ *  symbol was only just added. While the total is small, that is after
+ *  every symbol, but so is the tree.
+ */
+    PRIVATE void
+defer_update (adaptive_tree_t *tree, int symbol, bool added)
+{
+    unsigned int total;
+
+    tree->weight [tree->leaf [SYMBOL_INDEX (symbol)]] += 1;
+    total = tree->weight [ROOT_NODE] += 1;
+    tree->pending += 1;
+
+    // each symbol added splits the deepest leaf, so a run of them would
+    // make a chain of leaves, one deeper than the next, with codewords too
+    // long to write. A tree only adds each symbol once, so rebuilding
+    // costs little.
+    if (total >= tree->age_limit)
+        rebuild_tree (tree, true);
+    else if (added || tree->pending >= total >> tree->drift_bits)
+        rebuild_tree (tree, false);
+}
+
+/**********************************************************/
+
+/**
+ *  Split the lightest leaf into an internal node with two children: the
+ *  leaf that was there before, and a new zero weight leaf for symbol.
+ */
+    PRIVATE void
+add_new_node (adaptive_tree_t *tree, int symbol)
+{
+    int lightest = tree->next_free_node - 1;
+    int moved = tree->next_free_node;
+    int created = tree->next_free_node + 1;
+    int old_index, new_index;
+
+    assert (created < ADAPTIVE_NODES);
+    assert (tree->child [lightest] == NO_NODE);
+    tree->next_free_node += 2;
+    tree->escapes += 1;
+
+    // the decode table would still work, but it would stop short at the
+    // new internal node, so it is worth refreshing.
+    tree->decode_valid = false;
+
+    tree->weight [moved] = tree->weight [lightest];
+    tree->parent [moved] = lightest;
+    tree->child [moved] = NO_NODE;
+    tree->symbol [moved] = tree->symbol [lightest];
+    tree->leaf [SYMBOL_INDEX (tree->symbol [moved])] = moved;
+
+    tree->child [lightest] = moved;
+
+    tree->weight [created] = 0;
+    tree->parent [created] = lightest;
+    tree->child [created] = NO_NODE;
+    tree->symbol [created] = symbol;
+    tree->leaf [SYMBOL_INDEX (symbol)] = created;
+
+    // no other codeword changes: the two new leaves have the codeword of
+    // the old leaf, extended with a 0 and a 1 bit.
+    old_index = SYMBOL_INDEX (tree->symbol [moved]);
+    new_index = SYMBOL_INDEX (symbol);
+
+    if (tree->code_epoch [old_index] == tree->epoch)
+    {
+        tree->codes [new_index].bits = (tree->codes [old_index].bits << 1) | 1;
+        tree->codes [new_index].length = tree->codes [old_index].length + 1;
+        tree->code_epoch [new_index] = tree->epoch;
+
+        tree->codes [old_index].bits <<= 1;
+        tree->codes [old_index].length += 1;
+    }
+    else
+    {
+        tree->code_epoch [new_index] = tree->epoch - 1;
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Build a new tree from the weights of the leaves. If the tree is being
+ *  aged, every weight is halved first, rounding up so that none drops to
+ *  zero. Merging the two lightest items at a time, as in
+ *  build_huffman_tree, takes the items in order of weight, so laying them
+ *  out in the reverse of the order they were taken puts the nodes in order
+ *  of weight with siblings side by side, which is the sibling property.
+ *  Ties between leaves are broken by symbol, or by position, and leaves
+ *  are taken before internal nodes, so that the encoder and decoder always
+ *  build exactly the same tree.
+ */
+    PRIVATE void
+rebuild_tree (adaptive_tree_t *tree, bool halve)
+{
+    struct { unsigned int weight; int symbol; } leaf,
+      leaves [ADAPTIVE_SYMBOLS];
+    unsigned int internal [ADAPTIVE_SYMBOLS];
+    int index;
+    int taken [2 * ADAPTIVE_SYMBOLS], position [ADAPTIVE_SYMBOLS];
+    int num_leaves = 0, num_taken = 0, next_leaf = 0, next_internal = 0;
+    int num_internal, item, j, node;
+    bool deferred = tree->drift_bits != NO_DRIFT_BITS;
+
+    tree->rebuilds += 1;
+    tree->pending = 0;
+
+    // the leaves are taken from the lightest end, so that, with the tree
+    // mostly in order already, the insertion sort barely has to move any.
+    for (int i = tree->next_free_node - 1; i > ROOT_NODE; i --)
+    {
+        if (tree->child [i] != NO_NODE)
+            continue;
+
+        leaf.weight = tree->weight [i];
+
+        if (halve)
+            leaf.weight = (leaf.weight + 1) / 2;
+
+        leaf.symbol = tree->symbol [i];
+        index = SYMBOL_INDEX (leaf.symbol);
+
+        // insertion sort is plenty for a few hundred leaves. A tree with
+        // deferred updates keeps tied leaves in the order they were in,
+        // rather than ordering them by symbol, which makes up for them
+        // not being moved as they are counted: that order still tends to
+        // put the leaves used most recently nearest the root, and losing
+        // it costs as much as 1% on small inputs in context mode.
+        for (j = num_leaves; j > 0; j --)
+        {
+            if (leaves [j - 1].weight < leaf.weight ||
+              (leaves [j - 1].weight == leaf.weight && (deferred ||
+              SYMBOL_INDEX (leaves [j - 1].symbol) < index)))
+            {
+                break;
+            }
+
+            leaves [j] = leaves [j - 1];
+        }
+
+        leaves [j] = leaf;
+        num_leaves += 1;
+    }
+
+    // items are numbered as leaves 0 to num_leaves - 1, then internal
+    // nodes. Internal node k is made from taken items 2k and 2k + 1.
+    num_internal = num_leaves - 1;
+
+    for (int k = 0; k < num_internal; k ++)
+    {
+        internal [k] = 0;
+
+        for (int pick = 0; pick < 2; pick ++)
+        {
+            if (next_leaf < num_leaves && (next_internal == k ||
+              leaves [next_leaf].weight <= internal [next_internal]))
+            {
+                internal [k] += leaves [next_leaf].weight;
+                item = next_leaf ++;
+            }
+            else
+            {
+                internal [k] += internal [next_internal];
+                item = num_leaves + next_internal ++;
+            }
+
+            taken [num_taken ++] = item;
+        }
+    }
+
+    // the root goes at the front, followed by the taken items, last
+    // taken first.
+    position [num_internal - 1] = ROOT_NODE;
+
+    for (int i = 0; i < num_taken; i ++)
+    {
+        if (taken [i] >= num_leaves)
+            position [taken [i] - num_leaves] = num_taken - i;
+    }
+
+    for (int i = 0; i < num_taken; i ++)
+    {
+        node = num_taken - i;
+
+        if (taken [i] < num_leaves)
+        {
+            leaf = leaves [taken [i]];
+            tree->weight [node] = leaf.weight;
+            tree->child [node] = NO_NODE;
+            tree->symbol [node] = leaf.symbol;
+            tree->leaf [SYMBOL_INDEX (leaf.symbol)] = node;
+        }
+        else
+        {
+            tree->weight [node] = internal [taken [i] - num_leaves];
+        }
+
+        // items 2k and 2k + 1 are the children of internal node k, and
+        // the second of them is the first in position.
+        if (i % 2 == 1)
+            tree->child [position [i / 2]] = node;
+
+        tree->parent [node] = position [i / 2];
+    }
+
+    tree->weight [ROOT_NODE] = internal [num_internal - 1];
+    tree->parent [ROOT_NODE] = -1;
+    tree->next_free_node = num_taken + 1;
+
+    invalidate_codes (tree);
+    tree->decode_valid = false;
+}
+
+/**********************************************************/
+
+/**
+ *  Exchange the subtrees at positions i and j. The positions keep their
+ *  parents; everything hanging below them moves.
+ */
+    PRIVATE void
+swap_nodes (adaptive_tree_t *tree, int i, int j)
+{
+    int positions [2] = { i, j };
+    uint32_t weight;
+    int16_t child, symbol;
+
+    // swapping two leaves just exchanges their codewords. Moving a subtree
+    // changes the codewords of all the leaves below it, so in that case
+    // the whole cache is thrown away.
+    if (tree->child [i] == NO_NODE && tree->child [j] == NO_NODE)
+        swap_codes (tree, tree->symbol [i], tree->symbol [j]);
+    else
+        invalidate_codes (tree);
+
+    // decode table entries only record the position they end at, so moving
+    // leaves around does not affect them. They are wrong, though, if they
+    // lead through an internal node whose children are about to change.
+    if (tree->decode_valid &&
+      ((tree->child [i] != NO_NODE && near_root (tree, i)) ||
+      (tree->child [j] != NO_NODE && near_root (tree, j))))
+    {
+        tree->decode_valid = false;
+    }
+
+    // point the children (or the symbol's leaf entry) of each node at the
+    // position it is about to move to.
+    for (int k = 0; k < 2; k ++)
+    {
+        int node = positions [k];
+        int destination = positions [1 - k];
+
+        if (tree->child [node] == NO_NODE)
+        {
+            tree->leaf [SYMBOL_INDEX (tree->symbol [node])] = destination;
+        }
+        else
+        {
+            tree->parent [tree->child [node]] = destination;
+            tree->parent [tree->child [node] + 1] = destination;
+        }
+    }
+
+    weight = tree->weight [i];
+    tree->weight [i] = tree->weight [j];
+    tree->weight [j] = weight;
+
+    child = tree->child [i];
+    tree->child [i] = tree->child [j];
+    tree->child [j] = child;
+
+    symbol = tree->symbol [i];
+    tree->symbol [i] = tree->symbol [j];
+    tree->symbol [j] = symbol;
+}
+
+/**********************************************************/
+
+/**
+ *  Exchange the cached codewords of two symbols.
+ */
+    PRIVATE void
+swap_codes (adaptive_tree_t *tree, int a, int b)
+{
+    int index_a = SYMBOL_INDEX (a);
+    int index_b = SYMBOL_INDEX (b);
+    codeword_t code = tree->codes [index_a];
+    unsigned int epoch = tree->code_epoch [index_a];
+
+    tree->codes [index_a] = tree->codes [index_b];
+    tree->code_epoch [index_a] = tree->code_epoch [index_b];
+    tree->codes [index_b] = code;
+    tree->code_epoch [index_b] = epoch;
+}
+
+/**********************************************************/
+
+/**
+ *  Mark every cached codeword as out of date, by moving the tree on to a
+ *  new epoch. If the epoch counter wraps around, old entries could match
+ *  it again by accident, so they are explicitly cleared.
+ */
+    PRIVATE void
+invalidate_codes (adaptive_tree_t *tree)
+{
+    tree->epoch += 1;
+
+    if (tree->epoch == 0)
+    {
+        for (int i = 0; i < ADAPTIVE_SYMBOLS; i ++)
+            tree->code_epoch [i] = 0;
+
+        tree->epoch = 1;
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Decode one symbol from the input. If the decode table is up to date,
+ *  the first DECODE_BITS bits are resolved with it; the rest of the
+ *  codeword, or all of it if there is no table, is read one bit at a
+ *  time. Returns the symbol, or DECODE_ERROR if the input ends part way
+ *  through the codeword.
+ */
+    PUBLIC int
+adaptive_decode (adaptive_tree_t *tree, bit_reader_t *reader)
+{
+    const decode_entry_t *entry;
+    int node = ROOT_NODE, bit;
+
+    if (!tree->decode_valid && tree->walked >= DECODE_REBUILD_BITS)
+        build_decode_table (tree);
+
+    if (tree->decode_valid)
+    {
+        entry = tree->decode_table + peek_bits (reader, DECODE_BITS);
+
+        if (skip_bits (reader, entry->length) == -1)
+            return DECODE_ERROR;
+
+        node = entry->node;
+    }
+
+    while (tree->child [node] != NO_NODE)
+    {
+        if ((bit = read_bit (reader)) == -1)
+            return DECODE_ERROR;
+
+        node = tree->child [node] + bit;
+
+        if (!tree->decode_valid)
+            tree->walked += 1;
+    }
+
+    return tree->symbol [node];
+}
+
+/**********************************************************/
+
+/**
+ *  Write the codeword for a symbol to the output. A byte that has not been
+ *  seen yet is sent as the not seen codeword followed by the literal 8 bit
+ *  value, MSB first. The tree is not updated. Returns the number of bits
+ *  written.
+ */
+    PUBLIC int
+adaptive_write (adaptive_tree_t *tree, bit_writer_t *writer, int symbol)
+{
+    const codeword_t *codeword;
+
+    if (!adaptive_seen (tree, symbol))
+    {
+        // only bytes can be sent as literals. Any other symbol has to be
+        // added to the tree before it is used.
+        assert (symbol >= 0 && symbol < ALPHABET_LENGTH);
+        codeword = adaptive_lookup (tree, NOT_SEEN);
+        write_bits (writer, codeword->bits, codeword->length);
+        write_bits (writer, symbol, 8);
+        return codeword->length + 8;
+    }
+
+    codeword = adaptive_lookup (tree, symbol);
+    write_bits (writer, codeword->bits, codeword->length);
+    return codeword->length;
+}
+
+/**********************************************************/
+
+/**
+ *  Read a symbol written by adaptive_write, following a not seen codeword
+ *  with its literal byte. The tree is not updated. Returns the byte value,
+ *  END_OF_STREAM, or DECODE_ERROR if the input ends first.
+ */
+    PUBLIC int
+adaptive_read (adaptive_tree_t *tree, bit_reader_t *reader)
+{
+    int symbol = adaptive_decode (tree, reader);
+
+    if (symbol == NOT_SEEN && (symbol = read_bits (reader, 8)) == -1)
+        return DECODE_ERROR;
+
+    return symbol;
+}
+
+/**********************************************************/
+
+/**
+ *  Write the age limit of the trees in a stream, which follows the stream
+ *  header in adaptive and context modes.
+ */
+    PUBLIC void
+write_age_bits (bit_writer_t *writer, int age_bits)
+{
+    write_bits (writer, age_bits, 8);
+}
+
+/**********************************************************/
+
+/**
+ *  Read the age limit written by write_age_bits. Returns the number of
+ *  bits, or -1 if the input ends first or the limit is not valid.
+ */
+    PUBLIC int
+read_age_bits (bit_reader_t *reader)
+{
+    int age_bits = read_bits (reader, 8);
+
+    if (age_bits < MIN_AGE_BITS || age_bits > MAX_AGE_BITS)
+        return -1;
+
+    return age_bits;
+}
+
+/**********************************************************/
+
+/**
+ *  Write the drift limit of the trees in a stream, which follows the age
+ *  limit if the stream has FLAG_DEFERRED set.
+ */
+    PUBLIC void
+write_drift_bits (bit_writer_t *writer, int drift_bits)
+{
+    write_bits (writer, drift_bits, 8);
+}
+
+/**********************************************************/
+
+/**
+ *  Read the drift limit written by write_drift_bits. Returns the number of
+ *  bits, or -1 if the input ends first or the limit is not valid. A stream
+ *  with deferred updates never has a limit of NO_DRIFT_BITS.
+ */
+    PUBLIC int
+read_drift_bits (bit_reader_t *reader)
+{
+    int drift_bits = read_bits (reader, 8);
+
+    if (drift_bits <= NO_DRIFT_BITS || drift_bits > MAX_DRIFT_BITS)
+        return -1;
+
+    return drift_bits;
+}
+
+/**********************************************************/
+
+/**
+ *  Test if a node is close enough to the root to be passed through by the
+ *  decode table, ie. its depth is less than DECODE_BITS.
+ */
+    PRIVATE bool
+near_root (const adaptive_tree_t *tree, int node)
+{
+    for (int depth = 0; depth < DECODE_BITS; depth ++)
+    {
+        if (node == ROOT_NODE)
+            return true;
+
+        node = tree->parent [node];
+    }
+
+    return false;
+}
+
+/**********************************************************/
+
+/**
+ *  Work out where every possible DECODE_BITS bit prefix of the input ends
+ *  up, starting from the root.
+ */
+    PRIVATE void
+build_decode_table (adaptive_tree_t *tree)
+{
+    fill_decode_table (tree, ROOT_NODE, 0, 0);
+    tree->decode_valid = true;
+    tree->walked = 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Fill in the decode table entries for every prefix that passes through
+ *  node, which is reached by the depth bit path in prefix. A leaf, or a
+ *  node DECODE_BITS deep, covers all the entries that share its path,
+ *  however the remaining bits are set.
+ */
+    PRIVATE void
+fill_decode_table (adaptive_tree_t *tree, int node, int prefix, int depth)
+{
+    int first, count;
+
+    if (tree->child [node] == NO_NODE || depth == DECODE_BITS)
+    {
+        first = prefix << (DECODE_BITS - depth);
+        count = 1 << (DECODE_BITS - depth);
+
+        for (int i = first; i < first + count; i ++)
+        {
+            tree->decode_table [i].node = node;
+            tree->decode_table [i].length = depth;
+        }
+
+        return;
+    }
+
+    fill_decode_table (tree, tree->child [node], prefix << 1, depth + 1);
+    fill_decode_table (tree, tree->child [node] + 1,
+      (prefix << 1) | 1, depth + 1);
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
@@ -0,0 +1,149 @@
+/**
+ *  Adaptive Huffman tree, updated incrementally as each symbol is coded
+ *  (the FGK algorithm). The tree always satisfies the sibling property:
+ *  when the nodes are listed in order of position, their weights never
+ *  increase, and the two children of any node are adjacent. Adding one to
+ *  the weight of a leaf therefore only requires a walk from that leaf up
+ *  to the root, swapping nodes where the order would be violated.
+ *
+ *  So that the code follows the data as it changes, and the weights never
+ *  overflow, the tree is aged: whenever the total weight reaches the
+ *  tree's age limit, every weight is halved and the tree is rebuilt.
+ *
+ *  One symbol rarely changes the best code by much, so a tree can instead
+ *  defer its updates: only the weight of the symbol's leaf and the total
+ *  are counted, and the whole tree is rebuilt from the leaf weights once
+ *  the symbols counted since the last rebuild come to 1/2^drift_bits of
+ *  the total, or a symbol is added. In between, the codewords and the
+ *  decode table stay as they are, which makes coding a symbol far cheaper.
+ *  The schedule depends only on the symbols coded, so the encoder and
+ *  decoder rebuild in step. As the number of leaves is never more than the
+ *  total weight, the work of rebuilding comes to a few steps per leaf for
+ *  every 2^-drift_bits of the total, or a bounded amount per symbol,
+ *  however big the tree gets.
+ */
+
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stdint.h>
+
+#include "utils.h"
+#include "node.h"
+#include "huffman.h"
+#include "bitio.h"
+
+#define ADAPTIVE_NODES      (2 * ADAPTIVE_SYMBOLS - 1)
+
+#define ROOT_NODE           0
+
+// number of bits the decoder resolves with a single table lookup. Longer
+// codewords are finished off by walking the tree one bit at a time.
+#define DECODE_BITS         10
+
+// once the decode table is out of date, symbols are decoded by walking
+// the tree one bit at a time until this many bits have been walked, and
+// only then is the table rebuilt. A young tree changes shape after nearly
+// every symbol, so rebuilding straight away would cost a whole table per
+// symbol; this way rebuilding never costs more than the walking it saves.
+// That matters in context mode, where most trees are young.
+#define DECODE_REBUILD_BITS (1 << DECODE_BITS)
+
+// the age limit is given as a number of bits: the tree is aged when its
+// total weight reaches 2^bits. The smallest limit leaves plenty of room
+// above a tree with every symbol in it, and the largest keeps the weights
+// well clear of overflowing.
+#define MIN_AGE_BITS        10
+#define MAX_AGE_BITS        30
+#define DEFAULT_AGE_BITS    16
+
+// a drift limit of 0 updates the tree after every symbol. A larger limit
+// rebuilds more often, which costs more time, and beyond the largest one,
+// the rebuilds would cost more than updating after every symbol. With the
+// default, text and logs compress to within 0.5% of updating every time,
+// and usually within 0.01%, at about twice the speed.
+#define NO_DRIFT_BITS       0
+#define MAX_DRIFT_BITS      12
+#define DEFAULT_DRIFT_BITS  5
+
+
+// the result of following DECODE_BITS bits of input from the root: the
+// position reached, which is either a leaf or a node at depth DECODE_BITS,
+// and the number of bits used to get there.
+typedef struct
+{
+    uint16_t node;
+    uint16_t length;
+}
+decode_entry_t;
+
+// the nodes of a tree are kept as parallel arrays, indexed by position,
+// rather than as an array of structures, so that each pass over the tree
+// only brings in the fields it uses: walking from a leaf to the root only
+// touches parents, and walking down only children. Positions fit in 16
+// bits, which makes the nodes of a whole tree come to about 5kB.
+typedef struct
+{
+    // position of the leaf for each symbol, or -1 if not yet seen.
+    int16_t leaf [ADAPTIVE_SYMBOLS];
+    int next_free_node;
+
+    // for each node, its weight and the position of its parent, which is
+    // -1 for the root. For an internal node, child is the position of the
+    // first child, and the second child is at child + 1; for a leaf, it is
+    // NO_NODE, and symbol is the symbol the leaf represents.
+    uint32_t weight [ADAPTIVE_NODES];
+    int16_t parent [ADAPTIVE_NODES];
+    int16_t child [ADAPTIVE_NODES];
+    int16_t symbol [ADAPTIVE_NODES];
+
+    // total weight at which the tree is aged.
+    unsigned int age_limit;
+
+    // with deferred updates, the drift limit in bits and the number of
+    // symbols counted since the tree was last rebuilt. The weights of the
+    // internal nodes are out of date until then, except for the root,
+    // which is always the total. drift_bits is NO_DRIFT_BITS if the tree
+    // is updated after every symbol.
+    int drift_bits;
+    unsigned int pending;
+
+    // cached codeword for each symbol. An entry is only valid if its
+    // epoch matches the tree's epoch, which changes whenever the shape of
+    // the tree changes in a way that moves codewords around.
+    codeword_t codes [ADAPTIVE_SYMBOLS];
+    unsigned int code_epoch [ADAPTIVE_SYMBOLS];
+    unsigned int epoch;
+
+    // table used by the decoder, indexed by the next DECODE_BITS bits of
+    // input. It is rebuilt when needed after the top of the tree changes,
+    // once walked bits have been decoded without it.
+    decode_entry_t decode_table [1 << DECODE_BITS];
+    bool decode_valid;
+    unsigned int walked;
+
+    // number of times the tree has been rebuilt, and of symbols
+    // added to it, each of which was escaped with the not seen codeword
+    // first. They are only read for statistics.
+    uint64_t rebuilds;
+    uint64_t escapes;
+}
+adaptive_tree_t;
+
+
+void adaptive_init (adaptive_tree_t *tree, int age_bits, int drift_bits);
+bool adaptive_seen (const adaptive_tree_t *tree, int symbol);
+const codeword_t * adaptive_lookup (adaptive_tree_t *tree, int symbol);
+void adaptive_update (adaptive_tree_t *tree, int symbol);
+int adaptive_decode (adaptive_tree_t *tree, bit_reader_t *reader);
+int adaptive_write (adaptive_tree_t *tree, bit_writer_t *writer, int symbol);
+int adaptive_read (adaptive_tree_t *tree, bit_reader_t *reader);
+void write_age_bits (bit_writer_t *writer, int age_bits);
+int read_age_bits (bit_reader_t *reader);
+void write_drift_bits (bit_writer_t *writer, int drift_bits);
+int read_drift_bits (bit_reader_t *reader);
+
+
+#endif // ADAPTIVE_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
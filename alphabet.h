@@ -6,15 +6,26 @@
 #ifndef ALPHABET_H
 #define ALPHABET_H
 
-#include "heap.h"
+#include <stddef.h>
 
 #define ALPHABET_LENGTH 256
 
 
-void initialise_histogram (void);
-void update_symbol (int symbol);
-void enqueue_symbols (heap_t *heap);
-int seen_symbol (int symbol);
+// we will record frequencies in this array, which conveniently allows fast
+// lookup time by virtue of the fact that any 8 bit value i is stored at
+// index i in the array.
+typedef struct
+{
+    int count [ALPHABET_LENGTH];
+}
+histogram_t;
+
+
+void initialise_histogram (histogram_t *histogram);
+void update_symbol (histogram_t *histogram, int symbol);
+void count_symbols (histogram_t *histogram, const unsigned char *data,
+  size_t length);
+int seen_symbol (const histogram_t *histogram, int symbol);
 
 
 #endif // ALPHABET_H
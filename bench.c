@@ -0,0 +1,375 @@
+/**
+ *  Benchmark driver. Each of the generated corpora is compressed and
+ *  decompressed in memory through libstreamzip, in each mode, and the
+ *  results are checked and timed. One line of results per corpus and mode
+ *  is written to stdout, as CSV by default or as JSON with --json, so
+ *  that runs can be compared between releases.
+ *
+ *  Each measurement is repeated, and the fastest time is kept. Peak RSS is
+ *  the high water mark of the whole process so far, so it only ever goes
+ *  up from one line to the next.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "utils.h"
+#include "corpus.h"
+#include "streamzip.h"
+
+/**********************************************************/
+
+typedef struct
+{
+    bool json;
+    long long size;
+    long long block_size;
+    long long repeat;
+
+    // run only this corpus, or all of them if -1.
+    int corpus;
+}
+options_t;
+
+typedef struct
+{
+    size_t input_length;
+    size_t compressed_length;
+    double compress_seconds;
+    double decompress_seconds;
+    long peak_rss;
+}
+result_t;
+
+/**********************************************************/
+
+PRIVATE void parse_arguments (int argc, char **argv, options_t *options);
+PRIVATE int run_benchmark (const options_t *options, int kind, int mode,
+  result_t *result);
+PRIVATE size_t compress (const sz_params_t *params,
+  const unsigned char *input, size_t length, unsigned char **output);
+PRIVATE size_t decompress (const unsigned char *input, size_t length,
+  unsigned char *output, size_t capacity);
+PRIVATE double now (void);
+PRIVATE void print_result (const options_t *options, int kind, int mode,
+  const result_t *result, bool first);
+
+/**********************************************************/
+
+    PUBLIC int
+main (int argc, char **argv)
+{
+    options_t options;
+    result_t result;
+    bool first = true;
+    int status = 0;
+
+    parse_arguments (argc, argv, &options);
+
+    if (options.json)
+        printf ("[\n");
+    else
+        printf ("corpus,mode,input_bytes,compressed_bytes,bytes_per_symbol,"
+          "compress_mb_s,decompress_mb_s,compress_ns_per_symbol,"
+          "decompress_ns_per_symbol,peak_rss_kb\n");
+
+    for (int kind = 0; kind < NUM_CORPORA; kind ++)
+    {
+        if (options.corpus != -1 && options.corpus != kind)
+            continue;
+
+        for (int mode = SZ_MODE_ADAPTIVE; mode <= SZ_MODE_LZ; mode ++)
+        {
+            if (run_benchmark (&options, kind, mode, &result) == -1)
+            {
+                fprintf (stderr, "%s: %s corpus did not round trip.\n",
+                  argv [0], corpus_name (kind));
+                status = EXIT_FAILURE;
+                continue;
+            }
+
+            print_result (&options, kind, mode, &result, first);
+            first = false;
+        }
+    }
+
+    if (options.json)
+        printf ("\n]\n");
+
+    return status;
+}
+
+/**********************************************************/
+
+/**
+ *  Check the command line options, and fill in the options structure.
+ *  Prints a usage message and exits if they are not valid.
+ */
+    PRIVATE void
+parse_arguments (int argc, char **argv, options_t *options)
+{
+    options->json = false;
+    options->size = 4 << 20;
+    options->block_size = 1 << 20;
+    options->repeat = 3;
+    options->corpus = -1;
+
+    for (int i = 1; i < argc; i ++)
+    {
+        if (strcmp (argv [i], "--json") == 0)
+        {
+            options->json = true;
+        }
+        else if (strcmp (argv [i], "--csv") == 0)
+        {
+            options->json = false;
+        }
+        else if (strncmp (argv [i], "--size=", 7) == 0)
+        {
+            options->size = parse_size (argv [i] + 7);
+        }
+        else if (strncmp (argv [i], "--block=", 8) == 0)
+        {
+            options->block_size = parse_size (argv [i] + 8);
+        }
+        else if (strncmp (argv [i], "--repeat=", 9) == 0)
+        {
+            options->repeat = parse_size (argv [i] + 9);
+        }
+        else if (strncmp (argv [i], "--corpus=", 9) == 0)
+        {
+            if ((options->corpus = corpus_kind (argv [i] + 9)) == -1)
+                options->size = -1;
+        }
+        else
+        {
+            options->size = -1;
+        }
+
+        if (options->size <= 0 || options->block_size <= 0 ||
+          options->repeat <= 0)
+        {
+            fprintf (stderr, "usage: %s [--csv | --json] [--size=SIZE] "
+              "[--block=SIZE] [--repeat=N] [--corpus=NAME]\n", argv [0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Generate a corpus, then time compressing and decompressing it in the
+ *  given mode. Returns 0, or -1 if the data did not survive the trip.
+ */
+    PRIVATE int
+run_benchmark (const options_t *options, int kind, int mode,
+  result_t *result)
+{
+    unsigned char *input, *compressed, *output;
+    sz_params_t params;
+    struct rusage usage;
+    double start, seconds;
+    size_t length, decompressed;
+    int status = 0;
+
+    input = generate_corpus (kind, options->size, &length);
+    output = checked_malloc (length + 1);
+
+    sz_default_params (&params);
+    params.mode = mode;
+    params.block_size = options->block_size;
+
+    result->input_length = length;
+    result->compress_seconds = -1;
+    result->decompress_seconds = -1;
+
+    for (int i = 0; i < options->repeat; i ++)
+    {
+        start = now ();
+        result->compressed_length = compress (&params, input, length,
+          &compressed);
+        seconds = now () - start;
+
+        if (result->compress_seconds < 0 || seconds < result->compress_seconds)
+            result->compress_seconds = seconds;
+
+        start = now ();
+        decompressed = decompress (compressed, result->compressed_length,
+          output, length + 1);
+        seconds = now () - start;
+
+        if (result->decompress_seconds < 0 ||
+          seconds < result->decompress_seconds)
+        {
+            result->decompress_seconds = seconds;
+        }
+
+        if (decompressed != length || memcmp (input, output, length) != 0)
+            status = -1;
+
+        free (compressed);
+    }
+
+    getrusage (RUSAGE_SELF, &usage);
+    result->peak_rss = usage.ru_maxrss;
+
+    free (input);
+    free (output);
+
+    return status;
+}
+
+/**********************************************************/
+
+/**
+ *  Compress length bytes of input into a buffer allocated here, which the
+ *  caller should free. Returns the compressed length.
+ */
+    PRIVATE size_t
+compress (const sz_params_t *params, const unsigned char *input,
+  size_t length, unsigned char **output)
+{
+    sz_encoder_t *encoder = sz_encoder_new (params);
+    size_t capacity = length + length / 2 + 4096, used = 0, consumed,
+      produced, position = 0;
+    int result;
+
+    *output = checked_malloc (capacity);
+
+    while (position < length)
+    {
+        if (capacity - used < 4096)
+        {
+            capacity *= 2;
+            *output = checked_realloc (*output, capacity);
+        }
+
+        sz_encode (encoder, input + position, length - position,
+          *output + used, capacity - used, &consumed, &produced);
+        position += consumed;
+        used += produced;
+    }
+
+    do
+    {
+        if (capacity - used < 4096)
+        {
+            capacity *= 2;
+            *output = checked_realloc (*output, capacity);
+        }
+
+        result = sz_encode_end (encoder, *output + used, capacity - used,
+          &produced);
+        used += produced;
+    }
+    while (result == SZ_MORE_OUTPUT);
+
+    sz_encoder_free (encoder);
+    return used;
+}
+
+/**********************************************************/
+
+/**
+ *  Decompress a whole stream into output. Returns the decompressed length,
+ *  or capacity + 1 if the stream is corrupt, truncated or too long.
+ */
+    PRIVATE size_t
+decompress (const unsigned char *input, size_t length, unsigned char *output,
+  size_t capacity)
+{
+    sz_decoder_t *decoder = sz_decoder_new ();
+    size_t used = 0, consumed, produced, position = 0;
+    int result;
+
+    do
+    {
+        result = sz_decode (decoder, input + position, length - position,
+          output + used, capacity - used, &consumed, &produced);
+        position += consumed;
+        used += produced;
+    }
+    while (result == SZ_OK && (consumed > 0 || produced > 0));
+
+    sz_decoder_free (decoder);
+
+    if (result != SZ_END)
+        return capacity + 1;
+
+    return used;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the current time, in seconds, from a monotonic clock.
+ */
+    PRIVATE double
+now (void)
+{
+    struct timespec time;
+
+    clock_gettime (CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**********************************************************/
+
+/**
+ *  Print one line of results. Rates for the empty corpus are given as 0.
+ */
+    PRIVATE void
+print_result (const options_t *options, int kind, int mode,
+  const result_t *result, bool first)
+{
+    double symbols = result->input_length;
+    double megabytes = symbols / (1 << 20);
+    double ratio = 0, compress_rate = 0, decompress_rate = 0;
+    double compress_ns = 0, decompress_ns = 0;
+    const char *mode_names [] = { "adaptive", "block", "context", "lz" };
+    const char *mode_name = mode_names [mode];
+
+    if (symbols > 0)
+    {
+        ratio = result->compressed_length / symbols;
+        compress_ns = result->compress_seconds * 1e9 / symbols;
+        decompress_ns = result->decompress_seconds * 1e9 / symbols;
+
+        if (result->compress_seconds > 0)
+            compress_rate = megabytes / result->compress_seconds;
+
+        if (result->decompress_seconds > 0)
+            decompress_rate = megabytes / result->decompress_seconds;
+    }
+
+    if (options->json)
+    {
+        printf ("%s  {\"corpus\": \"%s\", \"mode\": \"%s\", "
+          "\"input_bytes\": %zu, \"compressed_bytes\": %zu, "
+          "\"bytes_per_symbol\": %.4f, \"compress_mb_s\": %.2f, "
+          "\"decompress_mb_s\": %.2f, \"compress_ns_per_symbol\": %.2f, "
+          "\"decompress_ns_per_symbol\": %.2f, \"peak_rss_kb\": %ld}",
+          first ? "" : ",\n", corpus_name (kind), mode_name,
+          result->input_length, result->compressed_length, ratio,
+          compress_rate, decompress_rate, compress_ns, decompress_ns,
+          result->peak_rss);
+    }
+    else
+    {
+        printf ("%s,%s,%zu,%zu,%.4f,%.2f,%.2f,%.2f,%.2f,%ld\n",
+          corpus_name (kind), mode_name, result->input_length,
+          result->compressed_length, ratio, compress_rate, decompress_rate,
+          compress_ns, decompress_ns, result->peak_rss);
+    }
+
+    fflush (stdout);
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
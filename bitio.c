@@ -0,0 +1,520 @@
+/**
+ *  Buffered bit level input and output. Bits are accumulated in a 64 bit
+ *  word, and whole bytes are moved through a large buffer so that the
+ *  underlying file is only touched once every BITIO_BUFFER_SIZE bytes.
+ *
+ *  Both the writer and the reader also support a text mode, in which each
+ *  bit is represented by an ASCII '0' or '1' character. This is only
+ *  intended for debugging.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "fileio.h"
+#include "bitio.h"
+
+/**********************************************************/
+
+PRIVATE void put_byte (bit_writer_t *writer, int byte);
+PRIVATE void make_room (bit_writer_t *writer);
+PRIVATE void fill_bits (bit_reader_t *reader, int count);
+PRIVATE int get_byte (bit_reader_t *reader);
+PRIVATE size_t refill (bit_reader_t *reader);
+
+/**********************************************************/
+
+/**
+ *  Set up a bit writer that will send its output to the given file. If
+ *  output is NULL, the output is kept in writer->buffer instead, which
+ *  grows as needed; the first writer->length bytes are valid.
+ */
+    PUBLIC void
+writer_init (bit_writer_t *writer, output_file_t *output, bool text)
+{
+    writer->bits = 0;
+    writer->num_bits = 0;
+    writer->text = text;
+    writer->output = output;
+    writer->flushed = 0;
+    writer->length = 0;
+    writer->capacity = BITIO_BUFFER_SIZE;
+    writer->buffer = checked_malloc (writer->capacity);
+}
+
+/**********************************************************/
+
+/**
+ *  Release the writer's buffer. Any output not yet flushed is lost.
+ */
+    PUBLIC void
+writer_free (bit_writer_t *writer)
+{
+    free (writer->buffer);
+    writer->buffer = NULL;
+}
+
+/**********************************************************/
+
+/**
+ *  Append the lowest count bits of value to the output, most significant
+ *  bit first.
+ */
+    PUBLIC void
+write_bits (bit_writer_t *writer, uint64_t value, int count)
+{
+    assert (count >= 0 && count <= 64);
+
+    if (writer->text)
+    {
+        // num_bits is only kept so that writer_align knows how many
+        // numerals are needed to reach a byte boundary.
+        writer->num_bits = (writer->num_bits + count) % 8;
+
+        while (count > 0)
+        {
+            count -= 1;
+            put_byte (writer, ((value >> count) & 1) ? '1' : '0');
+        }
+
+        return;
+    }
+
+    // the accumulator holds fewer than 8 bits between calls, so adding up
+    // to 32 bits at a time can never overflow it.
+    if (count > 32)
+    {
+        write_bits (writer, value >> 32, count - 32);
+        count = 32;
+    }
+
+    value &= ((uint64_t) 1 << count) - 1;
+    writer->bits = (writer->bits << count) | value;
+    writer->num_bits += count;
+
+    while (writer->num_bits >= 8)
+    {
+        writer->num_bits -= 8;
+        put_byte (writer, (writer->bits >> writer->num_bits) & 0xff);
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Append a sequence of whole bytes to the output, which must be at a byte
+ *  boundary.
+ */
+    PUBLIC void
+write_bytes (bit_writer_t *writer, const unsigned char *data, size_t length)
+{
+    size_t count;
+
+    if (writer->text)
+    {
+        for (size_t i = 0; i < length; i ++)
+            write_bits (writer, data [i], 8);
+
+        return;
+    }
+
+    assert (writer->num_bits == 0);
+
+    while (length > 0)
+    {
+        if (writer->length == writer->capacity)
+            make_room (writer);
+
+        count = writer->capacity - writer->length;
+
+        if (count > length)
+            count = length;
+
+        memcpy (writer->buffer + writer->length, data, count);
+        writer->length += count;
+        data += count;
+        length -= count;
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Pad the output with zero bits up to the next byte boundary.
+ */
+    PUBLIC void
+writer_align (bit_writer_t *writer)
+{
+    if (writer->num_bits > 0)
+        write_bits (writer, 0, 8 - writer->num_bits);
+}
+
+/**********************************************************/
+
+/**
+ *  Write any buffered bytes to the underlying file. Bits that do not yet
+ *  make up a whole byte are kept; call writer_align first to force them
+ *  out. Does nothing for a writer that is working in memory.
+ */
+    PUBLIC void
+writer_flush (bit_writer_t *writer)
+{
+    if (writer->output == NULL)
+        return;
+
+    output_write (writer->output, writer->buffer, writer->length);
+    writer->flushed += writer->length;
+    writer->length = 0;
+    output_flush (writer->output);
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the number of whole bytes (or in text mode, numerals) written
+ *  so far, including those still in the buffer.
+ */
+    PUBLIC uint64_t
+writer_position (const bit_writer_t *writer)
+{
+    return writer->flushed + writer->length;
+}
+
+/**********************************************************/
+
+/**
+ *  Append a single byte to the output buffer, making room first if it has
+ *  filled up.
+ */
+    PRIVATE void
+put_byte (bit_writer_t *writer, int byte)
+{
+    if (writer->length == writer->capacity)
+        make_room (writer);
+
+    writer->buffer [writer->length] = byte;
+    writer->length += 1;
+}
+
+/**********************************************************/
+
+/**
+ *  Make space in a full output buffer, either by passing it on to the
+ *  file, or if there is no file, by making it bigger.
+ */
+    PRIVATE void
+make_room (bit_writer_t *writer)
+{
+    if (writer->output != NULL)
+    {
+        output_write (writer->output, writer->buffer, writer->length);
+        writer->flushed += writer->length;
+        writer->length = 0;
+    }
+    else
+    {
+        writer->capacity *= 2;
+        writer->buffer = checked_realloc (writer->buffer, writer->capacity);
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Set up a bit reader that takes its input from the given file.
+ */
+    PUBLIC void
+reader_init (bit_reader_t *reader, input_file_t *input, bool text)
+{
+    reader->bits = 0;
+    reader->num_bits = 0;
+    reader->padding = 0;
+    reader->consumed = 0;
+    reader->text = text;
+    reader->input = input;
+    reader->position = 0;
+    reader->length = 0;
+    reader->buffer = NULL;
+}
+
+/**********************************************************/
+
+/**
+ *  Set up a bit reader that takes its input from length bytes of binary
+ *  data in memory. The data must stay in place until the reader is done.
+ */
+    PUBLIC void
+reader_init_memory (bit_reader_t *reader, const unsigned char *data,
+  size_t length)
+{
+    reader->bits = 0;
+    reader->num_bits = 0;
+    reader->padding = 0;
+    reader->consumed = 0;
+    reader->text = false;
+    reader->input = NULL;
+    reader->position = 0;
+    reader->length = length;
+    reader->buffer = data;
+}
+
+/**********************************************************/
+
+/**
+ *  Release the reader. The input, or the data in memory, still belongs to
+ *  the caller.
+ */
+    PUBLIC void
+reader_free (bit_reader_t *reader)
+{
+    reader->buffer = NULL;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the next bit of input, 0 or 1, or -1 if the input is exhausted.
+ */
+    PUBLIC int
+read_bit (bit_reader_t *reader)
+{
+    return read_bits (reader, 1);
+}
+
+/**********************************************************/
+
+/**
+ *  Read count bits from the input, and return them as an int, with the
+ *  first bit read in the most significant position. Returns -1 if the
+ *  input runs out before count bits could be read.
+ */
+    PUBLIC int
+read_bits (bit_reader_t *reader, int count)
+{
+    int value = peek_bits (reader, count);
+
+    if (skip_bits (reader, count) == -1)
+        return -1;
+
+    return value;
+}
+
+/**********************************************************/
+
+/**
+ *  Look at the next count bits of input without consuming them. If the
+ *  input ends sooner, the missing bits are returned as zeros; it is up to
+ *  skip_bits to report the problem if they are actually consumed.
+ */
+    PUBLIC int
+peek_bits (bit_reader_t *reader, int count)
+{
+    assert (count > 0 && count < 32);
+
+    fill_bits (reader, count);
+    return (reader->bits >> (reader->num_bits - count)) &
+      (((uint64_t) 1 << count) - 1);
+}
+
+/**********************************************************/
+
+/**
+ *  Consume count bits of input, which must already have been peeked at.
+ *  Returns 0, or -1 if that would go past the end of the input.
+ */
+    PUBLIC int
+skip_bits (bit_reader_t *reader, int count)
+{
+    assert (count >= 0 && count <= reader->num_bits);
+
+    reader->num_bits -= count;
+    reader->consumed += count;
+
+    if (reader->num_bits < reader->padding)
+        return -1;
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Read a 32 bit value, MSB first, into *value. Returns 0, or -1 if the
+ *  input runs out.
+ */
+    PUBLIC int
+read_u32 (bit_reader_t *reader, uint32_t *value)
+{
+    int high = read_bits (reader, 16);
+    int low = read_bits (reader, 16);
+
+    if (high == -1 || low == -1)
+        return -1;
+
+    *value = ((uint32_t) high << 16) | low;
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Read a 64 bit value, MSB first, into *value. Returns 0, or -1 if the
+ *  input runs out.
+ */
+    PUBLIC int
+read_u64 (bit_reader_t *reader, uint64_t *value)
+{
+    uint32_t high, low;
+
+    if (read_u32 (reader, &high) == -1 || read_u32 (reader, &low) == -1)
+        return -1;
+
+    *value = ((uint64_t) high << 32) | low;
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Read length whole bytes into data. The input must be at a byte
+ *  boundary. Returns 0, or -1 if the input runs out first.
+ */
+    PUBLIC int
+read_bytes (bit_reader_t *reader, unsigned char *data, size_t length)
+{
+    size_t count;
+    int byte;
+
+    assert (reader->consumed % 8 == 0);
+
+    // use up any bytes already in the accumulator first. In text mode,
+    // everything has to go through it.
+    while (length > 0 && (reader->text || reader->num_bits > 0))
+    {
+        if ((byte = read_bits (reader, 8)) == -1)
+            return -1;
+
+        *data ++ = byte;
+        length -= 1;
+    }
+
+    while (length > 0)
+    {
+        if (reader->position == reader->length && refill (reader) == 0)
+            return -1;
+
+        count = reader->length - reader->position;
+
+        if (count > length)
+            count = length;
+
+        memcpy (data, reader->buffer + reader->position, count);
+        reader->position += count;
+        reader->consumed += 8 * count;
+        data += count;
+        length -= count;
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Discard bits up to the next byte boundary of the input. Returns 0, or
+ *  -1 if the input ends first.
+ */
+    PUBLIC int
+reader_align (bit_reader_t *reader)
+{
+    int count = (8 - reader->consumed % 8) % 8;
+
+    if (count == 0)
+        return 0;
+
+    fill_bits (reader, count);
+    return skip_bits (reader, count);
+}
+
+/**********************************************************/
+
+/**
+ *  Top up the accumulator until it holds at least count bits, padding
+ *  with zeros once the input has run out.
+ */
+    PRIVATE void
+fill_bits (bit_reader_t *reader, int count)
+{
+    int byte;
+
+    while (reader->num_bits < count)
+    {
+        byte = get_byte (reader);
+
+        // in text mode, anything other than a numeral ends the input.
+        if (reader->text && byte != '0' && byte != '1')
+            byte = EOF;
+
+        if (byte == EOF)
+        {
+            reader->bits <<= 8;
+            reader->num_bits += 8;
+            reader->padding += 8;
+        }
+        else if (reader->text)
+        {
+            reader->bits = (reader->bits << 1) | (byte == '1');
+            reader->num_bits += 1;
+        }
+        else
+        {
+            reader->bits = (reader->bits << 8) | byte;
+            reader->num_bits += 8;
+        }
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Fetch the next byte from the input buffer, refilling it from the
+ *  underlying file when it runs dry. Returns EOF at the end of input.
+ */
+    PRIVATE int
+get_byte (bit_reader_t *reader)
+{
+    if (reader->position == reader->length && refill (reader) == 0)
+        return EOF;
+
+    reader->position += 1;
+    return reader->buffer [reader->position - 1];
+}
+
+/**********************************************************/
+
+/**
+ *  Take the next piece of input from the file, once the last one has been
+ *  used up. Whatever input has arrived is taken, rather than waiting for
+ *  a buffer full, so that a stream coming down a pipe is decoded as it
+ *  comes. Returns the number of bytes now available, which is 0 at the
+ *  end of input.
+ */
+    PRIVATE size_t
+refill (bit_reader_t *reader)
+{
+    if (reader->input == NULL)
+        return 0;
+
+    reader->length = input_read_some (reader->input, &reader->buffer,
+      BITIO_BUFFER_SIZE);
+    reader->position = 0;
+
+    return reader->length;
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
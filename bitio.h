@@ -0,0 +1,85 @@
+/**
+ *  Buffered bit level input and output. Codewords are packed into bytes
+ *  MSB first, and bytes are moved to and from the underlying file in
+ *  large blocks rather than one character at a time. A writer or reader
+ *  may also work entirely in memory, without an underlying file.
+ */
+
+#ifndef BITIO_H
+#define BITIO_H
+
+#include <stdint.h>
+
+#include "utils.h"
+#include "fileio.h"
+
+#define BITIO_BUFFER_SIZE   65536
+
+
+typedef struct
+{
+    uint64_t bits;
+    int num_bits;
+    bool text;
+
+    // if output is NULL, the buffer grows to hold all of the output.
+    // flushed counts the bytes that have already left the buffer.
+    output_file_t *output;
+    uint64_t flushed;
+    size_t length;
+    size_t capacity;
+    unsigned char *buffer;
+}
+bit_writer_t;
+
+typedef struct
+{
+    uint64_t bits;
+    int num_bits;
+
+    // number of zero bits at the bottom of the accumulator that were made
+    // up after the end of input, so that peeking near the end still works.
+    int padding;
+
+    // total number of bits consumed so far, which tells us where the
+    // next byte boundary is.
+    uint64_t consumed;
+    bool text;
+
+    // if input is NULL, buffer holds the whole of the input, and is owned
+    // by the caller. Otherwise it points at the last piece taken from the
+    // input, which stays valid until the next one is taken.
+    input_file_t *input;
+    size_t position;
+    size_t length;
+    const unsigned char *buffer;
+}
+bit_reader_t;
+
+
+void writer_init (bit_writer_t *writer, output_file_t *output, bool text);
+void writer_free (bit_writer_t *writer);
+void write_bits (bit_writer_t *writer, uint64_t value, int count);
+void write_bytes (bit_writer_t *writer, const unsigned char *data,
+  size_t length);
+void writer_align (bit_writer_t *writer);
+void writer_flush (bit_writer_t *writer);
+uint64_t writer_position (const bit_writer_t *writer);
+
+void reader_init (bit_reader_t *reader, input_file_t *input, bool text);
+void reader_init_memory (bit_reader_t *reader, const unsigned char *data,
+  size_t length);
+void reader_free (bit_reader_t *reader);
+int read_bit (bit_reader_t *reader);
+int read_bits (bit_reader_t *reader, int count);
+int peek_bits (bit_reader_t *reader, int count);
+int skip_bits (bit_reader_t *reader, int count);
+int read_u32 (bit_reader_t *reader, uint32_t *value);
+int read_u64 (bit_reader_t *reader, uint64_t *value);
+int read_bytes (bit_reader_t *reader, unsigned char *data, size_t length);
+int reader_align (bit_reader_t *reader);
+
+
+#endif // BITIO_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
@@ -0,0 +1,221 @@
+/**
+ *  Functions for writing and reading blocks of statically coded data.
+ *
+ *  Each block is laid out as follows, starting on a byte boundary:
+ *
+ *      32 bits     uncompressed length (0 marks the end of the stream)
+ *      32 bits     compressed length, in bytes, of the rest of the block
+ *      32 bits     CRC32C of the uncompressed data, if the stream has
+ *                  checksums (0 in the block that ends the stream)
+ *      ...         codeword lengths, see write_code_lengths
+ *      ...         codewords for each byte of the block
+ *      ...         zero bits up to the next byte boundary
+ */
+
+#include <stdint.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "alphabet.h"
+#include "huffman.h"
+#include "canonical.h"
+#include "node.h"
+#include "bitio.h"
+#include "checksum.h"
+#include "block.h"
+
+PRIVATE void count_lengths (block_stats_t *stats, const int *count,
+  const uint8_t *lengths);
+
+/**********************************************************/
+
+/**
+ *  Compress a block of data, and append it to the output, which must be at
+ *  a byte boundary. No codeword will be longer than max_length bits. If
+ *  checksum is true, the header holds the checksum of the data, which is
+ *  returned as well; otherwise, returns 0. Statistics for the block are
+ *  stored in stats, unless it is NULL.
+ */
+    PUBLIC uint32_t
+encode_block (bit_writer_t *writer, const unsigned char *data,
+  uint32_t length, int max_length, bool checksum, block_stats_t *stats)
+{
+    histogram_t histogram;
+    uint8_t lengths [NUM_SYMBOLS];
+    codeword_t codes [NUM_SYMBOLS];
+    node_arena_t arena;
+    uint64_t bits, time = 0;
+    uint32_t crc = checksum ? crc32c (data, length) : 0;
+    int root;
+
+    assert (length > 0 && length <= MAX_BLOCK_SIZE);
+
+    if (stats != NULL)
+        time = monotonic_time ();
+
+    initialise_histogram (&histogram);
+    count_symbols (&histogram, data, length);
+
+    root = build_huffman_tree (&arena, histogram.count, false);
+    build_code_lengths (&arena, root, lengths);
+    limit_code_lengths (histogram.count, lengths, max_length);
+    canonical_codes (lengths, codes);
+
+    if (stats != NULL)
+    {
+        stats->model_time = monotonic_time () - time;
+        count_lengths (stats, histogram.count, lengths);
+    }
+
+    // the size of a block coded with a static code can be worked out
+    // exactly in advance, so there is no need to buffer the block to find
+    // out its compressed length.
+    bits = code_lengths_size (lengths);
+
+    for (int i = 0; i < ALPHABET_LENGTH; i ++)
+        bits += (uint64_t) histogram.count [i] * lengths [i];
+
+    write_bits (writer, length, 32);
+    write_bits (writer, (bits + 7) / 8, 32);
+
+    if (checksum)
+        write_bits (writer, crc, 32);
+
+    write_code_lengths (writer, lengths);
+
+    for (uint32_t i = 0; i < length; i ++)
+        write_bits (writer, codes [data [i]].bits, codes [data [i]].length);
+
+    writer_align (writer);
+    return crc;
+}
+
+/**********************************************************/
+
+/**
+ *  Write the empty block header that marks the end of the stream, with a
+ *  checksum field if the stream has checksums.
+ */
+    PUBLIC void
+end_blocks (bit_writer_t *writer, bool checksum)
+{
+    write_bits (writer, 0, 32);
+    write_bits (writer, 0, 32);
+
+    if (checksum)
+        write_bits (writer, 0, 32);
+}
+
+/**********************************************************/
+
+/**
+ *  Read the fixed part of a block header, which has a checksum field if
+ *  checksum is true. Returns 0, or -1 if the input ends or the header is
+ *  not valid, which includes a compressed length too big for the block.
+ */
+    PUBLIC int
+read_block_header (bit_reader_t *reader, block_header_t *header,
+  bool checksum)
+{
+    header->checksum = 0;
+
+    if (read_u32 (reader, &header->length) == -1 ||
+      read_u32 (reader, &header->compressed_length) == -1 ||
+      (checksum && read_u32 (reader, &header->checksum) == -1))
+    {
+        return -1;
+    }
+
+    // no codeword is longer than MAX_CODE_LENGTH bits, which puts a limit
+    // on the compressed length, so that a damaged header cannot ask for
+    // more memory than any block of its length could need.
+    if (header->length > MAX_BLOCK_SIZE || header->compressed_length >
+      (NUM_SYMBOLS * (1 + LENGTH_BITS) + (uint64_t) header->length *
+      MAX_CODE_LENGTH + 7) / 8)
+    {
+        return -1;
+    }
+
+    // the rest of the header of the empty block at the end is zero, so
+    // that damage to the length of a block is not taken for the end.
+    if (header->length == 0 && (header->compressed_length != 0 ||
+      header->checksum != 0))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Decode the rest of a block whose header has just been read, storing the
+ *  length bytes of uncompressed data in output. Returns 0, or -1 if the
+ *  block is corrupt or the input ends first. Statistics for the block are
+ *  stored in stats, unless it is NULL.
+ */
+    PUBLIC int
+decode_block (bit_reader_t *reader, unsigned char *output, uint32_t length,
+  block_stats_t *stats)
+{
+    uint8_t lengths [NUM_SYMBOLS];
+    canonical_decoder_t decoder;
+    histogram_t histogram;
+    uint64_t time = 0;
+    int symbol;
+
+    if (read_code_lengths (reader, lengths) == -1)
+        return -1;
+
+    if (stats != NULL)
+        time = monotonic_time ();
+
+    if (canonical_decoder_init (&decoder, lengths) == -1)
+        return -1;
+
+    if (stats != NULL)
+        stats->model_time = monotonic_time () - time;
+
+    for (uint32_t i = 0; i < length; i ++)
+    {
+        symbol = canonical_decode (&decoder, reader);
+
+        if (symbol < 0)
+            return -1;
+
+        output [i] = symbol;
+    }
+
+    // counting the bytes again afterwards keeps the decoding loop free of
+    // tests.
+    if (stats != NULL)
+    {
+        initialise_histogram (&histogram);
+        count_symbols (&histogram, output, length);
+        count_lengths (stats, histogram.count, lengths);
+    }
+
+    return reader_align (reader);
+}
+
+/**********************************************************/
+
+/**
+ *  Store in stats the number of bytes coded with codewords of each length,
+ *  given the count of each byte in the block and the code lengths.
+ */
+    PRIVATE void
+count_lengths (block_stats_t *stats, const int *count,
+  const uint8_t *lengths)
+{
+    for (int i = 0; i <= MAX_CODE_LENGTH; i ++)
+        stats->counts [i] = 0;
+
+    for (int i = 0; i < ALPHABET_LENGTH; i ++)
+        stats->counts [lengths [i]] += count [i];
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
@@ -0,0 +1,62 @@
+/**
+ *  Block static compression. The input is split into blocks, and each
+ *  block is coded with a fixed canonical Huffman code built from that
+ *  block's own symbol counts. The code is stored in the block's header, so
+ *  every block can be decoded on its own.
+ */
+
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+
+#include "utils.h"
+#include "huffman.h"
+#include "bitio.h"
+
+// largest block that may be written or will be accepted when reading.
+#define MAX_BLOCK_SIZE      (1 << 30)
+
+// block size used when none is given, eg. when threads are requested.
+#define DEFAULT_BLOCK_SIZE      (1 << 20)
+
+// longest codeword used in a block, unless told otherwise.
+#define DEFAULT_LENGTH_LIMIT    15
+
+
+// the fixed part of a block header. The length is the number of bytes of
+// uncompressed data, and is 0 for the block that ends the stream. The
+// compressed length is the number of bytes that follow the header. The
+// checksum is the CRC32C of the uncompressed data, if the stream has
+// checksums, and 0 otherwise.
+typedef struct
+{
+    uint32_t length;
+    uint32_t compressed_length;
+    uint32_t checksum;
+}
+block_header_t;
+
+// statistics for one block, for --stats: the number of bytes coded with
+// codewords of each length, and the time in nanoseconds spent building the
+// code from the symbol counts, or the decoder from the code lengths.
+typedef struct
+{
+    uint32_t counts [MAX_CODE_LENGTH + 1];
+    uint64_t model_time;
+}
+block_stats_t;
+
+
+uint32_t encode_block (bit_writer_t *writer, const unsigned char *data,
+  uint32_t length, int max_length, bool checksum, block_stats_t *stats);
+void end_blocks (bit_writer_t *writer, bool checksum);
+int read_block_header (bit_reader_t *reader, block_header_t *header,
+  bool checksum);
+int decode_block (bit_reader_t *reader, unsigned char *output,
+  uint32_t length, block_stats_t *stats);
+
+
+#endif // BLOCK_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
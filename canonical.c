@@ -0,0 +1,271 @@
+/**
+ *  Functions for assigning, storing and decoding canonical Huffman codes.
+ *  All of the tables here have NUM_SYMBOLS entries, indexed with
+ *  SYMBOL_INDEX, and canonical order is the order of those indices.
+ */
+
+#include <stdint.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "huffman.h"
+#include "canonical.h"
+#include "bitio.h"
+
+/**********************************************************/
+
+PRIVATE int decode_slowly (const canonical_decoder_t *decoder,
+  bit_reader_t *reader);
+
+/**********************************************************/
+
+/**
+ *  Assign the canonical codeword for each symbol, given the codeword
+ *  lengths. Symbols with a length of 0 get no codeword.
+ */
+    PUBLIC void
+canonical_codes (const uint8_t *lengths, codeword_t *table)
+{
+    int count [MAX_CODE_LENGTH + 1] = { 0 };
+    uint64_t next_code [MAX_CODE_LENGTH + 1];
+    uint64_t code = 0;
+
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+        count [lengths [i]] += 1;
+
+    // the first codeword of each length follows on from the last codeword
+    // of the previous length, with a 0 bit appended.
+    count [0] = 0;
+
+    for (int length = 1; length <= MAX_CODE_LENGTH; length ++)
+    {
+        code = (code + count [length - 1]) << 1;
+        next_code [length] = code;
+    }
+
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+    {
+        table [i].length = lengths [i];
+        table [i].bits = 0;
+
+        if (lengths [i] != 0)
+        {
+            table [i].bits = next_code [lengths [i]];
+            next_code [lengths [i]] += 1;
+        }
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the number of bits write_code_lengths will use to store the
+ *  given lengths.
+ */
+    PUBLIC int
+code_lengths_size (const uint8_t *lengths)
+{
+    int bits = 0;
+
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+        bits += (lengths [i] == 0) ? 1 : 1 + LENGTH_BITS;
+
+    return bits;
+}
+
+/**********************************************************/
+
+/**
+ *  Store the codeword lengths in the output. Each symbol gets a single 0
+ *  bit if it has no codeword, or a 1 bit followed by the length.
+ */
+    PUBLIC void
+write_code_lengths (bit_writer_t *writer, const uint8_t *lengths)
+{
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+    {
+        if (lengths [i] == 0)
+        {
+            write_bits (writer, 0, 1);
+        }
+        else
+        {
+            assert (lengths [i] < (1 << LENGTH_BITS));
+            write_bits (writer, 1, 1);
+            write_bits (writer, lengths [i], LENGTH_BITS);
+        }
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Read a set of codeword lengths stored by write_code_lengths. Returns 0,
+ *  or -1 if the input ends first.
+ */
+    PUBLIC int
+read_code_lengths (bit_reader_t *reader, uint8_t *lengths)
+{
+    int present, length;
+
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+    {
+        if ((present = read_bit (reader)) == -1)
+            return -1;
+
+        lengths [i] = 0;
+
+        if (present)
+        {
+            if ((length = read_bits (reader, LENGTH_BITS)) == -1)
+                return -1;
+
+            lengths [i] = length;
+        }
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Prepare to decode the canonical code with the given codeword lengths.
+ *  Returns 0, or -1 if the lengths do not describe a valid prefix code
+ *  (there are more codewords of some length than can fit).
+ */
+    PUBLIC int
+canonical_decoder_init (canonical_decoder_t *decoder, const uint8_t *lengths)
+{
+    codeword_t codes [NUM_SYMBOLS];
+    int offset [MAX_CODE_LENGTH + 1];
+    uint64_t available = 1;
+    int first, span;
+
+    for (int length = 0; length <= MAX_CODE_LENGTH; length ++)
+        decoder->count [length] = 0;
+
+    decoder->max_length = 0;
+
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+    {
+        if (lengths [i] > MAX_CODE_LENGTH)
+            return -1;
+
+        decoder->count [lengths [i]] += 1;
+
+        if (lengths [i] > decoder->max_length)
+            decoder->max_length = lengths [i];
+    }
+
+    // each extra bit of length doubles the number of codewords available;
+    // those used up at one length are not available to longer ones.
+    decoder->count [0] = 0;
+
+    for (int length = 1; length <= decoder->max_length; length ++)
+    {
+        available <<= 1;
+
+        if ((uint64_t) decoder->count [length] > available)
+            return -1;
+
+        available -= decoder->count [length];
+    }
+
+    // list the symbols in order of codeword, for the slow decoder.
+    offset [1] = 0;
+
+    for (int length = 1; length < MAX_CODE_LENGTH; length ++)
+        offset [length + 1] = offset [length] + decoder->count [length];
+
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+    {
+        if (lengths [i] != 0)
+            decoder->sorted [offset [lengths [i]] ++] = INDEX_SYMBOL (i);
+    }
+
+    // fill in the table. Every entry that starts with a short enough
+    // codeword points at that codeword's symbol; the rest are left with a
+    // length of 0, to send the decoder down the slow path.
+    for (int i = 0; i < (1 << CANONICAL_BITS); i ++)
+    {
+        decoder->table [i].symbol = DECODE_ERROR;
+        decoder->table [i].length = 0;
+    }
+
+    canonical_codes (lengths, codes);
+
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+    {
+        if (codes [i].length == 0 || codes [i].length > CANONICAL_BITS)
+            continue;
+
+        first = codes [i].bits << (CANONICAL_BITS - codes [i].length);
+        span = 1 << (CANONICAL_BITS - codes [i].length);
+
+        for (int j = first; j < first + span; j ++)
+        {
+            decoder->table [j].symbol = INDEX_SYMBOL (i);
+            decoder->table [j].length = codes [i].length;
+        }
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Decode one symbol. Returns the symbol, or DECODE_ERROR if the input
+ *  ends part way through a codeword or the bits are not a codeword.
+ */
+    PUBLIC int
+canonical_decode (const canonical_decoder_t *decoder, bit_reader_t *reader)
+{
+    const canonical_entry_t *entry;
+
+    entry = decoder->table + peek_bits (reader, CANONICAL_BITS);
+
+    if (entry->length == 0)
+        return decode_slowly (decoder, reader);
+
+    if (skip_bits (reader, entry->length) == -1)
+        return DECODE_ERROR;
+
+    return entry->symbol;
+}
+
+/**********************************************************/
+
+/**
+ *  Decode one symbol a bit at a time. At each length, the codewords of
+ *  that length form a contiguous range of values starting at first, so
+ *  we only have to check whether the bits read so far fall in that range.
+ */
+    PRIVATE int
+decode_slowly (const canonical_decoder_t *decoder, bit_reader_t *reader)
+{
+    uint64_t code = 0, first = 0;
+    int index = 0, bit;
+
+    for (int length = 1; length <= decoder->max_length; length ++)
+    {
+        if ((bit = read_bit (reader)) == -1)
+            return DECODE_ERROR;
+
+        code |= bit;
+
+        if (code - first < (uint64_t) decoder->count [length])
+            return decoder->sorted [index + (code - first)];
+
+        index += decoder->count [length];
+        first = (first + decoder->count [length]) << 1;
+        code <<= 1;
+    }
+
+    return DECODE_ERROR;
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
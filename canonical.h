@@ -0,0 +1,60 @@
+/**
+ *  Canonical Huffman codes. A canonical code is completely determined by
+ *  the length of each symbol's codeword: codewords of the same length are
+ *  consecutive binary numbers, assigned in symbol order, and shorter
+ *  codewords come before longer ones. That means only the lengths have
+ *  to be stored in the compressed stream.
+ */
+
+#ifndef CANONICAL_H
+#define CANONICAL_H
+
+#include <stdint.h>
+
+#include "huffman.h"
+#include "bitio.h"
+
+// number of bits resolved by a single lookup in the decode table. Longer
+// codewords are decoded by the slower counting method.
+#define CANONICAL_BITS  11
+
+// number of bits used to store each codeword length.
+#define LENGTH_BITS     6
+
+
+typedef struct
+{
+    int16_t symbol;
+
+    // length of the codeword, or 0 if the codeword starting with these
+    // bits is longer than CANONICAL_BITS.
+    uint8_t length;
+}
+canonical_entry_t;
+
+typedef struct
+{
+    canonical_entry_t table [1 << CANONICAL_BITS];
+
+    // number of codewords of each length, and the symbols in order of
+    // their codewords, for decoding codewords that miss the table.
+    int count [MAX_CODE_LENGTH + 1];
+    int16_t sorted [NUM_SYMBOLS];
+    int max_length;
+}
+canonical_decoder_t;
+
+
+void canonical_codes (const uint8_t *lengths, codeword_t *table);
+int code_lengths_size (const uint8_t *lengths);
+void write_code_lengths (bit_writer_t *writer, const uint8_t *lengths);
+int read_code_lengths (bit_reader_t *reader, uint8_t *lengths);
+int canonical_decoder_init (canonical_decoder_t *decoder,
+  const uint8_t *lengths);
+int canonical_decode (const canonical_decoder_t *decoder,
+  bit_reader_t *reader);
+
+
+#endif // CANONICAL_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
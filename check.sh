@@ -0,0 +1,259 @@
+#!/bin/sh
+#
+# Round trip the generated corpora through the squash and puff binaries,
+# with a selection of options. The programs to test can be given on the
+# command line, so that the sanitizer builds can be checked the same way.
+#
+# usage: check.sh [squash] [puff] [roundtrip]
+#
+
+SQUASH=${1:-./squash}
+PUFF=${2:-./puff}
+ROUNDTRIP=${3:-./roundtrip}
+
+TMP=`mktemp -d`
+trap 'rm -rf "$TMP"' EXIT
+
+failures=0
+
+for corpus in uniform zipf text runs single empty
+do
+    "$ROUNDTRIP" --write=$corpus --size=300k > "$TMP/input" || exit 1
+
+    for options in "" "--text" "--block=1k" "--block=64k --max-length=9" \
+      "-T 3 --block=16k" "-T 2 --in-flight=1 --block=4k --text" \
+      "--context=1" "--context=2 --text" "--age=10" "--context=1 --age=12" \
+      "--lz" "--window=1k --text" "--lz --window=16m" "--seekable=4k" \
+      "--block=16k --seekable=40k" "--context=2 --seekable" \
+      "--no-checksum" "-T 2 --block=4k --no-checksum" \
+      "--lz --seekable=8k --no-checksum" "--flush-every=10k" \
+      "--context=1 --flush-every=4k --text" "--lz --flush-every=2ms" \
+      "--block=16k --flush-every=7k" "-1" "-3 --text" "-4" "-6" "-9" \
+      "-T 2 -2" "--drift=0" "--context=2 --drift=1" "--lz --drift=12" \
+      "--drift=0 --flush-every=5k" "-8 --drift=3"
+    do
+        # puff needs to know about text mode, and may as well use threads
+        # whenever squash did.
+        puff_options=""
+
+        case "$options" in
+            *--text*) puff_options="--text" ;;
+        esac
+
+        case "$options" in
+            -T*) puff_options="$puff_options -T 2" ;;
+        esac
+
+        if ! "$SQUASH" $options < "$TMP/input" > "$TMP/compressed" ||
+          ! "$PUFF" $puff_options < "$TMP/compressed" > "$TMP/output" ||
+          ! cmp -s "$TMP/input" "$TMP/output"
+        then
+            echo "check.sh: $corpus failed with options: $options"
+            failures=`expr $failures + 1`
+        fi
+    done
+
+    # input through a pipe is read rather than mapped, and may arrive in
+    # pieces of any size; named files are mapped.
+    if ! cat "$TMP/input" | "$SQUASH" --block=4k | cat > "$TMP/compressed" ||
+      ! cat "$TMP/compressed" | "$PUFF" > "$TMP/output" ||
+      ! cmp -s "$TMP/input" "$TMP/output" ||
+      ! "$SQUASH" --lz "$TMP/input" > "$TMP/compressed" ||
+      ! "$PUFF" "$TMP/compressed" > "$TMP/output" ||
+      ! cmp -s "$TMP/input" "$TMP/output"
+    then
+        echo "check.sh: $corpus failed through a pipe or a named file"
+        failures=`expr $failures + 1`
+    fi
+
+    # a range of a seekable stream, which starts part way through one
+    # segment and ends part way through another.
+    "$SQUASH" --lz --seekable=16k "$TMP/input" > "$TMP/compressed"
+    tail -c +10001 "$TMP/input" | head -c 50000 > "$TMP/expected"
+
+    if ! "$PUFF" --range=10000:50000 "$TMP/compressed" > "$TMP/output" ||
+      ! cmp -s "$TMP/expected" "$TMP/output"
+    then
+        echo "check.sh: $corpus failed to decode a range"
+        failures=`expr $failures + 1`
+    fi
+done
+
+# a level picks the mode, so it cannot be combined with options that pick
+# one themselves, or with threads unless it is a block level.
+for options in "-5 --lz" "-1 --context=2" "-T 2 -7"
+do
+    if "$SQUASH" $options < /dev/null > /dev/null 2>&1
+    then
+        echo "check.sh: clashing options were accepted: $options"
+        failures=`expr $failures + 1`
+    fi
+done
+
+# a range is always decoded on a single thread, with its checksums, so
+# options that would change that are refused rather than ignored.
+for options in "--text" "-T 2" "--no-checksum"
+do
+    if "$PUFF" $options --range=100:50 "$TMP/compressed" > /dev/null 2>&1
+    then
+        echo "check.sh: clashing options were accepted: $options --range"
+        failures=`expr $failures + 1`
+    fi
+done
+
+# a file that cannot be opened must be reported.
+if "$SQUASH" "$TMP/missing" > /dev/null 2>&1
+then
+    echo "check.sh: missing input file was not detected"
+    failures=`expr $failures + 1`
+fi
+
+# a truncated block stream must be reported.
+"$ROUNDTRIP" --write=text --size=300k | "$SQUASH" --block=16k |
+  head -c 20000 > "$TMP/compressed"
+
+if "$PUFF" < "$TMP/compressed" > /dev/null 2>&1
+then
+    echo "check.sh: truncated stream was not detected"
+    failures=`expr $failures + 1`
+fi
+
+# a block whose compressed length is wrong must be rejected the same way
+# with and without threads, whether the length is a little out, or too
+# big for any block. The first block's compressed length is at byte 10.
+"$ROUNDTRIP" --write=text --size=100k | "$SQUASH" --block=16k \
+  > "$TMP/compressed"
+
+for length in '\000\000\040\000' '\377\377\377\377'
+do
+    cp "$TMP/compressed" "$TMP/damaged"
+    printf "$length" | dd of="$TMP/damaged" bs=1 seek=10 conv=notrunc \
+      2> /dev/null
+    "$PUFF" < "$TMP/damaged" > /dev/null 2>&1
+    status=$?
+    "$PUFF" -T 2 < "$TMP/damaged" > /dev/null 2>&1
+    threaded_status=$?
+
+    if [ $status -eq 0 ] || [ $threaded_status -ne $status ]
+    then
+        echo "check.sh: wrong compressed length was not detected"
+        failures=`expr $failures + 1`
+    fi
+done
+
+# a damaged stream must be rejected, both when decoding and when only
+# verifying. Damage to a block leaves it decodable, so it can only be
+# caught by its checksum, which has an exit status of its own; in the
+# other modes, it may just as well make the stream undecodable.
+"$ROUNDTRIP" --write=text --size=300k > "$TMP/input"
+
+for options in "--block=64k" "--context=2" "--lz --seekable=64k"
+do
+    "$SQUASH" $options "$TMP/input" > "$TMP/compressed"
+
+    if ! "$PUFF" --verify "$TMP/compressed" > "$TMP/output" ||
+      [ -s "$TMP/output" ]
+    then
+        echo "check.sh: --verify failed with options: $options"
+        failures=`expr $failures + 1`
+    fi
+
+    printf '\125' | dd of="$TMP/compressed" bs=1 seek=50000 conv=notrunc \
+      2> /dev/null
+    "$PUFF" "$TMP/compressed" > /dev/null 2>&1
+    status=$?
+    "$PUFF" --verify "$TMP/compressed" > /dev/null 2>&1
+    verify_status=$?
+
+    case "$options" in
+        --block*) expected=2 ;;
+        *) expected=$status ;;
+    esac
+
+    if [ $status -eq 0 ] || [ $status -ne $expected ] ||
+      [ $verify_status -ne $status ]
+    then
+        echo "check.sh: damage was not detected with options: $options"
+        failures=`expr $failures + 1`
+    fi
+done
+
+# statistics go to stderr, and leave the output alone, and puff must
+# report writing exactly as many bytes as squash read.
+size=`wc -c < "$TMP/input" | tr -d ' '`
+
+for options in "" "--context=2" "--lz" "-T 2 --block=16k"
+do
+    if ! "$SQUASH" $options --stats=json "$TMP/input" > "$TMP/compressed" \
+      2> "$TMP/stats" || ! grep -q "\"bytes_in\": $size," "$TMP/stats" ||
+      ! "$PUFF" --stats=json "$TMP/compressed" > "$TMP/output" \
+      2> "$TMP/stats" || ! grep -q "\"bytes_out\": $size," "$TMP/stats" ||
+      ! cmp -s "$TMP/input" "$TMP/output" ||
+      ! "$PUFF" --stats "$TMP/compressed" 2>&1 > /dev/null |
+      grep -q "bytes out: *$size\$"
+    then
+        echo "check.sh: --stats failed with options: $options"
+        failures=`expr $failures + 1`
+    fi
+done
+
+# every mode times its model and counts its codewords, and puff counts the
+# same codewords as squash did.
+for options in "" "--context=2" "--lz" "-8" "--block=16k" "-T 2 --block=16k"
+do
+    "$SQUASH" $options --stats=json "$TMP/input" > "$TMP/compressed" \
+      2> "$TMP/stats"
+    "$PUFF" --stats=json "$TMP/compressed" 2> "$TMP/stats2" > /dev/null
+
+    if grep -q '"model_seconds": null' "$TMP/stats" "$TMP/stats2" ||
+      grep -q '"codeword_lengths": {}' "$TMP/stats" ||
+      [ "`sed 's/.*"codeword_lengths"//' "$TMP/stats"`" != \
+      "`sed 's/.*"codeword_lengths"//' "$TMP/stats2"`" ]
+    then
+        echo "check.sh: codeword statistics differ with options: $options"
+        failures=`expr $failures + 1`
+    fi
+done
+
+# the statistics for a range give the mode of the stream, and the whole
+# of it as read, since its index is at the end.
+"$SQUASH" --lz --seekable=64k "$TMP/input" > "$TMP/compressed"
+size=`wc -c < "$TMP/compressed" | tr -d ' '`
+
+if ! "$PUFF" --stats=json --range=100k:50k "$TMP/compressed" \
+  2> "$TMP/stats" > /dev/null || ! grep -q '"mode": "lz"' "$TMP/stats" ||
+  ! grep -q "\"bytes_in\": $size," "$TMP/stats" ||
+  ! grep -q '"bytes_out": 51200,' "$TMP/stats"
+then
+    echo "check.sh: --stats failed with --range"
+    failures=`expr $failures + 1`
+fi
+
+# with --flush-every, a message has to get through squash and puff while
+# the pipe it came down is still open.
+for options in "" "--context=2" "--lz" "--block=64k"
+do
+    (printf 'hello\n'; sleep 3) | "$SQUASH" $options --flush-every=10ms |
+      "$PUFF" > "$TMP/flushed$options" &
+done
+
+sleep 1
+
+for options in "" "--context=2" "--lz" "--block=64k"
+do
+    if [ "`cat "$TMP/flushed$options"`" != hello ]
+    then
+        echo "check.sh: message was held back with options: $options"
+        failures=`expr $failures + 1`
+    fi
+done
+
+wait
+
+if [ $failures -gt 0 ]
+then
+    echo "check.sh: $failures failures."
+    exit 1
+fi
+
+echo "check.sh: all round trips passed."
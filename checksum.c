@@ -0,0 +1,218 @@
+/**
+ *  CRC32C, computed sixteen bytes at a time ("slicing by 16"). Table k
+ *  holds the CRC of each byte value followed by k zero bytes, so the
+ *  effect of sixteen bytes on the CRC can be looked up independently and
+ *  combined with XOR, rather than going through them one after the other.
+ *  Slicing by 8 is more usual, but each step waits on the one before, and
+ *  taking twice as much per step makes it run about 1.6 times as fast, at
+ *  2.5GB/s or so, for only 8kB more of tables. Either way, it is far
+ *  faster than any of the coders.
+ *
+ *  CRCs of consecutive pieces of data can also be combined, without going
+ *  over the data again, by multiplying polynomials modulo the CRC
+ *  polynomial, as zlib's crc32_combine does. That is how the checksum of
+ *  a whole stream of blocks is put together from those of its blocks.
+ *
+ *  The tables are built the first time they are needed, from whichever
+ *  thread gets there first.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "checksum.h"
+
+/**********************************************************/
+
+// the Castagnoli polynomial, bit reversed.
+#define CRC32C_POLYNOMIAL   0x82f63b78
+
+#define NUM_TABLES          16
+
+// a polynomial with only the x^0 term, which is the top bit, since the
+// bits are reversed.
+#define X_TO_THE_0          0x80000000
+
+PRIVATE uint32_t tables [NUM_TABLES] [256];
+
+// entry n is x^(2^n) modulo the CRC polynomial, which is enough for
+// lengths of up to 2^61 bytes.
+#define NUM_POWERS          64
+
+PRIVATE uint32_t powers [NUM_POWERS];
+
+PRIVATE pthread_once_t tables_built = PTHREAD_ONCE_INIT;
+
+/**********************************************************/
+
+PRIVATE void build_tables (void);
+PRIVATE uint32_t multiply (uint32_t a, uint32_t b);
+PRIVATE uint32_t load_word (const unsigned char *data);
+
+/**********************************************************/
+
+/**
+ *  Returns the CRC of some data followed by length more bytes, given the
+ *  CRC of the data before them. The CRC of no data at all is 0, so
+ *  crc32c_update (crc32c (a), b) is the CRC of a followed by b.
+ */
+    PUBLIC uint32_t
+crc32c_update (uint32_t crc, const unsigned char *data, size_t length)
+{
+    uint32_t word;
+
+    pthread_once (&tables_built, build_tables);
+    crc = ~crc;
+
+    // the first byte of the sixteen has the furthest to go, and so is
+    // looked up in the last table.
+    while (length >= 16)
+    {
+        word = crc ^ load_word (data);
+        crc = tables [15] [word & 0xff] ^
+          tables [14] [(word >> 8) & 0xff] ^
+          tables [13] [(word >> 16) & 0xff] ^ tables [12] [word >> 24];
+
+        word = load_word (data + 4);
+        crc ^= tables [11] [word & 0xff] ^
+          tables [10] [(word >> 8) & 0xff] ^
+          tables [9] [(word >> 16) & 0xff] ^ tables [8] [word >> 24];
+
+        word = load_word (data + 8);
+        crc ^= tables [7] [word & 0xff] ^ tables [6] [(word >> 8) & 0xff] ^
+          tables [5] [(word >> 16) & 0xff] ^ tables [4] [word >> 24];
+
+        word = load_word (data + 12);
+        crc ^= tables [3] [word & 0xff] ^ tables [2] [(word >> 8) & 0xff] ^
+          tables [1] [(word >> 16) & 0xff] ^ tables [0] [word >> 24];
+
+        data += 16;
+        length -= 16;
+    }
+
+    while (length > 0)
+    {
+        crc = tables [0] [(crc ^ *data) & 0xff] ^ (crc >> 8);
+        data += 1;
+        length -= 1;
+    }
+
+    return ~crc;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the CRC of length bytes of data.
+ */
+    PUBLIC uint32_t
+crc32c (const unsigned char *data, size_t length)
+{
+    return crc32c_update (0, data, length);
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the CRC of a piece of data followed by another, given the CRC
+ *  of each, and the length of the second.
+ */
+    PUBLIC uint32_t
+crc32c_combine (uint32_t first, uint32_t second, uint64_t length)
+{
+    uint32_t shift = X_TO_THE_0;
+
+    pthread_once (&tables_built, build_tables);
+
+    // appending length bytes multiplies the first CRC by x^(8 length),
+    // which is made up from the powers for each bit of 8 length.
+    for (int n = 3; length > 0 && n < NUM_POWERS; n ++, length >>= 1)
+    {
+        if (length & 1)
+            shift = multiply (powers [n], shift);
+    }
+
+    return multiply (shift, first) ^ second;
+}
+
+/**********************************************************/
+
+/**
+ *  Fill in the tables. Table 0 is the usual one for a byte at a time;
+ *  each of the others pushes the entries of the one before through one
+ *  more zero byte. Each power of x is the square of the one before.
+ */
+    PRIVATE void
+build_tables (void)
+{
+    uint32_t crc;
+
+    for (int byte = 0; byte < 256; byte ++)
+    {
+        crc = byte;
+
+        for (int bit = 0; bit < 8; bit ++)
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+
+        tables [0] [byte] = crc;
+    }
+
+    for (int k = 1; k < NUM_TABLES; k ++)
+    {
+        for (int byte = 0; byte < 256; byte ++)
+        {
+            crc = tables [k - 1] [byte];
+            tables [k] [byte] = tables [0] [crc & 0xff] ^ (crc >> 8);
+        }
+    }
+
+    // x^1 is the bit after x^0.
+    powers [0] = X_TO_THE_0 >> 1;
+
+    for (int n = 1; n < NUM_POWERS; n ++)
+        powers [n] = multiply (powers [n - 1], powers [n - 1]);
+}
+
+/**********************************************************/
+
+/**
+ *  Returns a times b, modulo the CRC polynomial, where both are bit
+ *  reversed polynomials.
+ */
+    PRIVATE uint32_t
+multiply (uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+
+    // go through the terms of a from x^0 up, multiplying b by x as we go.
+    for (uint32_t term = X_TO_THE_0; term != 0; term >>= 1)
+    {
+        if (a & term)
+            product ^= b;
+
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLYNOMIAL : b >> 1;
+    }
+
+    return product;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the little endian word at data. It is put together a byte at a
+ *  time, so that this works on any byte order; compilers turn it into a
+ *  single load where they can.
+ */
+    PRIVATE uint32_t
+load_word (const unsigned char *data)
+{
+    return (uint32_t) data [0] | (uint32_t) data [1] << 8 |
+      (uint32_t) data [2] << 16 | (uint32_t) data [3] << 24;
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
@@ -0,0 +1,30 @@
+/**
+ *  CRC32C (the Castagnoli polynomial, as used by iSCSI and ext4) of the
+ *  uncompressed data, used to check that a stream decodes to what was
+ *  compressed. A stream with FLAG_SEEKABLE clear ends with the checksum
+ *  of everything in it; a seekable stream has one at the end of each
+ *  segment instead. In block mode, every block header holds the checksum
+ *  of that block as well, so that a corrupt block is caught as soon as it
+ *  is decoded. See format.h.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// returned by the decoding functions when the data decoded does not match
+// its checksum. It is distinct from the results in node.h.
+#define CHECKSUM_MISMATCH   (-4)
+
+
+uint32_t crc32c_update (uint32_t crc, const unsigned char *data,
+  size_t length);
+uint32_t crc32c (const unsigned char *data, size_t length);
+uint32_t crc32c_combine (uint32_t first, uint32_t second, uint64_t length);
+
+
+#endif // CHECKSUM_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
@@ -0,0 +1,274 @@
+/**
+ *  Order 1 and order 2 context models, built from adaptive trees. See
+ *  context.h.
+ */
+
+#include <stdint.h>
+
+#include "utils.h"
+#include "node.h"
+#include "adaptive.h"
+#include "bitio.h"
+#include "context.h"
+
+/**********************************************************/
+
+PRIVATE adaptive_tree_t * context_tree (context_model_t *model);
+PRIVATE int take_table (context_model_t *model);
+
+/**********************************************************/
+
+/**
+ *  Create a model of the given order, with no context trees yet, whose
+ *  trees are aged at 2^age_bits and have a drift limit of drift_bits.
+ *  Returns NULL if the order is not one we know about.
+ */
+    PUBLIC context_model_t *
+context_new (int order, int age_bits, int drift_bits)
+{
+    context_model_t *model;
+
+    if (order < MIN_CONTEXT_ORDER || order > MAX_CONTEXT_ORDER)
+        return NULL;
+
+    model = checked_malloc (sizeof (context_model_t));
+    model->order = order;
+    model->age_bits = age_bits;
+    model->drift_bits = drift_bits;
+    model->num_slots = (order == 1) ? 256 : 1 << CONTEXT_HASH_BITS;
+    model->slots = checked_malloc (model->num_slots * sizeof (int));
+    model->cache = NULL;
+    model->cached = 0;
+    model->capacity = 0;
+    model->hand = 0;
+    model->history = 0;
+    model->rebuilds = 0;
+    model->escapes = 0;
+
+    for (int i = 0; i < model->num_slots; i ++)
+        model->slots [i] = -1;
+
+    adaptive_init (&model->fallback, age_bits, drift_bits);
+    return model;
+}
+
+/**********************************************************/
+
+/**
+ *  Release a model, and all of its trees.
+ */
+    PUBLIC void
+context_free (context_model_t *model)
+{
+    if (model == NULL)
+        return;
+
+    free (model->slots);
+    free (model->cache);
+    free (model);
+}
+
+/**********************************************************/
+
+/**
+ *  Write the codeword for a symbol in the current context, escaping to the
+ *  order 0 tree if the context has not seen it. The end of stream symbol
+ *  is always coded in the context. The model is not updated. Returns the
+ *  number of bits written.
+ */
+    PUBLIC int
+context_write (context_model_t *model, bit_writer_t *writer, int symbol)
+{
+    adaptive_tree_t *tree = context_tree (model);
+    const codeword_t *codeword;
+
+    if (!adaptive_seen (tree, symbol))
+    {
+        codeword = adaptive_lookup (tree, NOT_SEEN);
+        write_bits (writer, codeword->bits, codeword->length);
+        return codeword->length + adaptive_write (&model->fallback, writer,
+          symbol);
+    }
+
+    codeword = adaptive_lookup (tree, symbol);
+    write_bits (writer, codeword->bits, codeword->length);
+    return codeword->length;
+}
+
+/**********************************************************/
+
+/**
+ *  Read a symbol written by context_write. The model is not updated,
+ *  although a tree may be created for the current context. Returns the
+ *  byte value, END_OF_STREAM, or DECODE_ERROR if the input ends first or
+ *  the escape does not make sense.
+ */
+    PUBLIC int
+context_read (context_model_t *model, bit_reader_t *reader)
+{
+    adaptive_tree_t *tree = context_tree (model);
+    int symbol = adaptive_decode (tree, reader);
+
+    if (symbol != NOT_SEEN)
+        return symbol;
+
+    // the encoder only escapes bytes the context has not seen, and never
+    // escapes the end of the stream.
+    symbol = adaptive_read (&model->fallback, reader);
+
+    if (symbol < 0 || adaptive_seen (tree, symbol))
+        return DECODE_ERROR;
+
+    return symbol;
+}
+
+/**********************************************************/
+
+/**
+ *  Update the model after a byte has been coded: the context's tree, the
+ *  order 0 tree if the byte was escaped to it, and the history that picks
+ *  the next context.
+ */
+    PUBLIC void
+context_update (context_model_t *model, int symbol)
+{
+    adaptive_tree_t *tree = context_tree (model);
+
+    if (!adaptive_seen (tree, symbol))
+        adaptive_update (&model->fallback, symbol);
+
+    adaptive_update (tree, symbol);
+    model->history = ((model->history << 8) | symbol) & 0xffff;
+}
+
+/**********************************************************/
+
+/**
+ *  Add the number of times the model's trees have been rebuilt, and the
+ *  number of escapes they have coded, to *rebuilds and *escapes. Escapes
+ *  from a context to the order 0 tree and from there to a literal both
+ *  count.
+ */
+    PUBLIC void
+context_counts (const context_model_t *model, uint64_t *rebuilds,
+  uint64_t *escapes)
+{
+    *rebuilds += model->rebuilds + model->fallback.rebuilds;
+    *escapes += model->escapes + model->fallback.escapes;
+
+    for (int i = 0; i < model->cached; i ++)
+    {
+        *rebuilds += model->cache [i].tree.rebuilds;
+        *escapes += model->cache [i].tree.escapes;
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Write the order of the model, which follows the stream header in
+ *  context mode.
+ */
+    PUBLIC void
+write_context_order (bit_writer_t *writer, int order)
+{
+    write_bits (writer, order, 8);
+}
+
+/**********************************************************/
+
+/**
+ *  Read the order written by write_context_order. Returns the order, or
+ *  -1 if the input ends first or the order is not valid.
+ */
+    PUBLIC int
+read_context_order (bit_reader_t *reader)
+{
+    int order = read_bits (reader, 8);
+
+    if (order < MIN_CONTEXT_ORDER || order > MAX_CONTEXT_ORDER)
+        return -1;
+
+    return order;
+}
+
+/**********************************************************/
+
+/**
+ *  Find the tree for the current context, taking one from the cache if it
+ *  does not have one yet. Doing this again without coding anything in
+ *  between finds the same tree and leaves the model as it was, so the
+ *  decoder can safely retry a symbol it did not have enough input for.
+ */
+    PRIVATE adaptive_tree_t *
+context_tree (context_model_t *model)
+{
+    uint32_t slot = model->history & 0xff;
+    int index;
+
+    // multiplying by an odd constant spreads the pair of bytes over the
+    // top bits, which are the ones kept.
+    if (model->order == 2)
+        slot = (model->history * 0x9e3779b1u) >> (32 - CONTEXT_HASH_BITS);
+
+    if ((index = model->slots [slot]) == -1)
+    {
+        index = take_table (model);
+        model->cache [index].slot = slot;
+        model->slots [slot] = index;
+        adaptive_init (&model->cache [index].tree, model->age_bits,
+          model->drift_bits);
+    }
+
+    model->cache [index].referenced = true;
+    return &model->cache [index].tree;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the index of a cache entry to use for a new context. The cache
+ *  grows until it is full; after that, the clock hand goes round it,
+ *  giving each tree that has been used since it last passed another
+ *  chance, and takes the first one that has not.
+ */
+    PRIVATE int
+take_table (context_model_t *model)
+{
+    context_table_t *table;
+    int index;
+
+    if (model->cached < CONTEXT_CACHE_SIZE)
+    {
+        if (model->cached == model->capacity)
+        {
+            model->capacity = (model->capacity == 0) ? 16 :
+              2 * model->capacity;
+            model->cache = checked_realloc (model->cache,
+              model->capacity * sizeof (context_table_t));
+        }
+
+        return model->cached ++;
+    }
+
+    while (true)
+    {
+        index = model->hand;
+        table = model->cache + index;
+        model->hand = (model->hand + 1) % CONTEXT_CACHE_SIZE;
+
+        if (!table->referenced)
+        {
+            model->rebuilds += table->tree.rebuilds;
+            model->escapes += table->tree.escapes;
+            model->slots [table->slot] = -1;
+            return index;
+        }
+
+        table->referenced = false;
+    }
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
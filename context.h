@@ -0,0 +1,97 @@
+/**
+ *  Context modelling: instead of a single adaptive tree for the whole
+ *  stream, each byte is coded with a tree chosen by the byte before it
+ *  (order 1), or by a hash of the two bytes before it (order 2). A byte
+ *  that has not been seen yet in its context is sent as that context's not
+ *  seen codeword, and then coded with an order 0 tree, which falls back
+ *  on a literal in turn for bytes it has not seen either.
+ *
+ *  Context trees are created as their contexts turn up, and at most
+ *  CONTEXT_CACHE_SIZE of them are kept. Once the cache is full, the tree
+ *  of a context that has not been used lately is thrown away, and started
+ *  again from scratch for the new context. Both ends of the stream do
+ *  exactly the same, so they always agree on the trees. Every tree, the
+ *  order 0 one included, is aged with the same limit.
+ */
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdint.h>
+
+#include "utils.h"
+#include "adaptive.h"
+#include "bitio.h"
+
+// the orders of context that can be used.
+#define MIN_CONTEXT_ORDER   1
+#define MAX_CONTEXT_ORDER   2
+
+// number of bits of the hash that picks an order 2 context. Pairs of
+// bytes that hash to the same value share a tree.
+#define CONTEXT_HASH_BITS   12
+
+// most context trees that are held at once. Each one is about 15kB, so a
+// full cache comes to about 16MB.
+#define CONTEXT_CACHE_SIZE  1024
+
+
+// a cached context tree, and the context it currently belongs to.
+typedef struct
+{
+    adaptive_tree_t tree;
+    int slot;
+
+    // set whenever the tree is used, and cleared as the clock hand that
+    // picks a tree to throw away passes over it.
+    bool referenced;
+}
+context_table_t;
+
+typedef struct
+{
+    int order;
+    int age_bits;
+    int drift_bits;
+
+    // index in the cache of the tree for each context, or -1 if it has
+    // none at the moment.
+    int num_slots;
+    int *slots;
+
+    // the cache of trees, which grows as needed up to CONTEXT_CACHE_SIZE,
+    // and the position of the clock hand within it.
+    context_table_t *cache;
+    int cached;
+    int capacity;
+    int hand;
+
+    // the order 0 tree that bytes are escaped to.
+    adaptive_tree_t fallback;
+
+    // the last two bytes coded, the most recent in the low 8 bits.
+    unsigned int history;
+
+    // the counts of rebuilds and escapes of trees that have been thrown
+    // away, which context_counts adds to those of the trees still held.
+    uint64_t rebuilds;
+    uint64_t escapes;
+}
+context_model_t;
+
+
+context_model_t * context_new (int order, int age_bits, int drift_bits);
+void context_free (context_model_t *model);
+int context_write (context_model_t *model, bit_writer_t *writer,
+  int symbol);
+int context_read (context_model_t *model, bit_reader_t *reader);
+void context_update (context_model_t *model, int symbol);
+void context_counts (const context_model_t *model, uint64_t *rebuilds,
+  uint64_t *escapes);
+void write_context_order (bit_writer_t *writer, int order);
+int read_context_order (bit_reader_t *reader);
+
+
+#endif // CONTEXT_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
@@ -0,0 +1,267 @@
+/**
+ *  Generators for the test corpora. Each one uses its own xorshift
+ *  generator with a fixed seed, so the output does not depend on the C
+ *  library's rand().
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+#include "alphabet.h"
+#include "corpus.h"
+
+/**********************************************************/
+
+// number of distinct words in the text corpus.
+#define VOCABULARY_SIZE     512
+
+// average length of a run in the runs corpus.
+#define AVERAGE_RUN         64
+
+/**********************************************************/
+
+PRIVATE uint64_t next_random (uint64_t *state);
+PRIVATE double random_fraction (uint64_t *state);
+PRIVATE void zipf_table (double *cumulative, int count);
+PRIVATE int zipf_pick (const double *cumulative, int count,
+  uint64_t *state);
+PRIVATE void fill_text (unsigned char *data, size_t length,
+  uint64_t *state);
+
+/**********************************************************/
+
+PRIVATE const char *names [NUM_CORPORA] =
+{
+    "uniform", "zipf", "text", "runs", "single", "empty"
+};
+
+/**********************************************************/
+
+/**
+ *  Returns the name of a kind of corpus.
+ */
+    PUBLIC const char *
+corpus_name (int kind)
+{
+    return names [kind];
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the kind of corpus with the given name, or -1 if there is none.
+ */
+    PUBLIC int
+corpus_kind (const char *name)
+{
+    for (int i = 0; i < NUM_CORPORA; i ++)
+    {
+        if (strcmp (names [i], name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/**********************************************************/
+
+/**
+ *  Generate length bytes of the given kind of corpus, apart from the empty
+ *  corpus, which has no bytes at all. The length actually generated is
+ *  stored in *actual. The caller should free the result.
+ */
+    PUBLIC unsigned char *
+generate_corpus (int kind, size_t length, size_t *actual)
+{
+    unsigned char *data = checked_malloc (length + 1);
+    double cumulative [ALPHABET_LENGTH];
+    uint64_t state = 0x9e3779b97f4a7c15ULL + kind;
+    size_t i = 0, run;
+    int byte;
+
+    *actual = length;
+
+    switch (kind)
+    {
+    case CORPUS_UNIFORM:
+        for (i = 0; i < length; i ++)
+            data [i] = next_random (&state) & 0xff;
+
+        break;
+
+    // byte i turns up in proportion to 1 / (i + 1).
+    case CORPUS_ZIPF:
+        zipf_table (cumulative, ALPHABET_LENGTH);
+
+        for (i = 0; i < length; i ++)
+            data [i] = zipf_pick (cumulative, ALPHABET_LENGTH, &state);
+
+        break;
+
+    case CORPUS_TEXT:
+        fill_text (data, length, &state);
+        break;
+
+    // runs of a random byte, with lengths spread evenly up to twice the
+    // average.
+    case CORPUS_RUNS:
+        while (i < length)
+        {
+            byte = next_random (&state) & 0xff;
+            run = 1 + next_random (&state) % (2 * AVERAGE_RUN);
+
+            while (run > 0 && i < length)
+            {
+                data [i ++] = byte;
+                run -= 1;
+            }
+        }
+
+        break;
+
+    case CORPUS_SINGLE:
+        memset (data, 'a', length);
+        break;
+
+    default:
+        *actual = 0;
+        break;
+    }
+
+    return data;
+}
+
+/**********************************************************/
+
+/**
+ *  Step an xorshift64* generator, and return the next value.
+ */
+    PRIVATE uint64_t
+next_random (uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns a random number in the range [0, 1).
+ */
+    PRIVATE double
+random_fraction (uint64_t *state)
+{
+    return (next_random (state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**********************************************************/
+
+/**
+ *  Fill in the cumulative probabilities of a Zipf distribution over count
+ *  values, where value i has weight 1 / (i + 1).
+ */
+    PRIVATE void
+zipf_table (double *cumulative, int count)
+{
+    double total = 0;
+
+    for (int i = 0; i < count; i ++)
+    {
+        total += 1.0 / (i + 1);
+        cumulative [i] = total;
+    }
+
+    for (int i = 0; i < count; i ++)
+        cumulative [i] /= total;
+}
+
+/**********************************************************/
+
+/**
+ *  Pick a value from a Zipf distribution set up by zipf_table.
+ */
+    PRIVATE int
+zipf_pick (const double *cumulative, int count, uint64_t *state)
+{
+    double fraction = random_fraction (state);
+    int low = 0, high = count - 1, middle;
+
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+
+        if (cumulative [middle] <= fraction)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/**********************************************************/
+
+/**
+ *  Fill the buffer with something that looks like prose: words from a
+ *  made up vocabulary, picked with a Zipf distribution, separated by
+ *  spaces, with the odd comma, full stop and line break.
+ */
+    PRIVATE void
+fill_text (unsigned char *data, size_t length, uint64_t *state)
+{
+    const char *alphabet = "etaoinshrdlucmfwypvbgkqjxz";
+    double cumulative [VOCABULARY_SIZE];
+    char words [VOCABULARY_SIZE] [12];
+    size_t i = 0, column = 0;
+    const char *word;
+    int letters;
+
+    // the letters of each word are also picked with a Zipf distribution,
+    // in roughly the order of their frequency in English.
+    zipf_table (cumulative, 26);
+
+    for (int w = 0; w < VOCABULARY_SIZE; w ++)
+    {
+        letters = 2 + next_random (state) % 8;
+
+        for (int l = 0; l < letters; l ++)
+            words [w] [l] = alphabet [zipf_pick (cumulative, 26, state)];
+
+        words [w] [letters] = '\0';
+    }
+
+    zipf_table (cumulative, VOCABULARY_SIZE);
+
+    while (i < length)
+    {
+        word = words [zipf_pick (cumulative, VOCABULARY_SIZE, state)];
+
+        while (*word != '\0' && i < length)
+            data [i ++] = *word ++;
+
+        if (i == length)
+            break;
+
+        switch (next_random (state) % 16)
+        {
+        case 0:
+            data [i ++] = ',';
+            break;
+
+        case 1:
+            data [i ++] = '.';
+            break;
+        }
+
+        if (i < length)
+            data [i ++] = (column ++ % 12 == 11) ? '\n' : ' ';
+    }
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
@@ -0,0 +1,30 @@
+/**
+ *  Generated test data, for measuring and checking the compressor. Every
+ *  corpus is produced by a fixed pseudo random sequence, so the same kind
+ *  and length always gives the same bytes.
+ */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stddef.h>
+
+// the kinds of corpus that can be generated.
+#define CORPUS_UNIFORM      0
+#define CORPUS_ZIPF         1
+#define CORPUS_TEXT         2
+#define CORPUS_RUNS         3
+#define CORPUS_SINGLE       4
+#define CORPUS_EMPTY        5
+
+#define NUM_CORPORA         6
+
+
+const char * corpus_name (int kind);
+int corpus_kind (const char *name);
+unsigned char * generate_corpus (int kind, size_t length, size_t *actual);
+
+
+#endif // CORPUS_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
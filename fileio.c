@@ -0,0 +1,453 @@
+/**
+ *  File input and output without stdio. See fileio.h.
+ *
+ *  Mapped input is given a sequential access hint, so that the kernel
+ *  reads ahead aggressively and drops pages once they have been passed.
+ *  Input that has to be read is read FILEIO_BUFFER_SIZE bytes at a time,
+ *  or more if a caller asks for a bigger piece at once.
+ *
+ *  The time spent in read() and writev() is kept for --stats. Taking the
+ *  time costs far less than the system call, so it is always done. Time
+ *  spent faulting in pages of a mapping cannot be told apart from the
+ *  work done on them, and is not counted.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "utils.h"
+#include "fileio.h"
+
+/**********************************************************/
+
+PRIVATE bool map_input (input_file_t *input);
+PRIVATE void fill_storage (input_file_t *input, size_t length);
+PRIVATE void send_data (output_file_t *output, const unsigned char *data,
+  size_t length);
+
+/**********************************************************/
+
+/**
+ *  Open the named file for input. Returns 0, or -1 if it cannot be opened,
+ *  in which case errno says why.
+ */
+    PUBLIC int
+input_open (input_file_t *input, const char *path)
+{
+    int fd = open (path, O_RDONLY);
+
+    if (fd == -1)
+        return -1;
+
+    input_init (input, fd);
+    input->owned = true;
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Set up input from a file that is already open, such as stdin. The file
+ *  is not closed by input_close. Input starts from the current offset of
+ *  the file.
+ */
+    PUBLIC void
+input_init (input_file_t *input, int fd)
+{
+    input->fd = fd;
+    input->owned = false;
+    input->data = NULL;
+    input->position = 0;
+    input->length = 0;
+    input->mapped = false;
+    input->mapped_length = 0;
+    input->storage = NULL;
+    input->capacity = 0;
+    input->end_of_file = false;
+    input->failed = false;
+    input->total = 0;
+    input->busy = 0;
+
+    if (!map_input (input))
+    {
+        input->capacity = FILEIO_BUFFER_SIZE;
+        input->storage = checked_malloc (input->capacity);
+        input->data = input->storage;
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Take the next length bytes of input, setting *data to point at them.
+ *  They stay valid until the next call. Returns the number of bytes,
+ *  which is less than length only at the end of the input, and 0 after it.
+ */
+    PUBLIC size_t
+input_read (input_file_t *input, const unsigned char **data, size_t length)
+{
+    if (!input->mapped && input->length - input->position < length)
+        fill_storage (input, length);
+
+    if (length > input->length - input->position)
+        length = input->length - input->position;
+
+    *data = input->data + input->position;
+    input->position += length;
+    input->total += length;
+    return length;
+}
+
+/**********************************************************/
+
+/**
+ *  Take up to length bytes of input, as input_read does, but without
+ *  waiting for more than is already to hand: if none of it is, this waits
+ *  for a single read() to return something. Returns the number of bytes,
+ *  which is 0 only at the end of the input.
+ */
+    PUBLIC size_t
+input_read_some (input_file_t *input, const unsigned char **data,
+  size_t length)
+{
+    if (!input->mapped && input->position == input->length)
+        fill_storage (input, 1);
+
+    if (length > input->length - input->position)
+        length = input->length - input->position;
+
+    *data = input->data + input->position;
+    input->position += length;
+    input->total += length;
+    return length;
+}
+
+/**********************************************************/
+
+/**
+ *  Wait up to the given number of milliseconds for input to arrive.
+ *  Returns true if input_read_some would not have to wait now, because
+ *  there is input to hand, or the input has ended, or false if the time
+ *  ran out first.
+ */
+    PUBLIC bool
+input_wait (input_file_t *input, int milliseconds)
+{
+    struct pollfd poller = { input->fd, POLLIN, 0 };
+    int result;
+
+    if (input->mapped || input->position < input->length ||
+      input->end_of_file)
+    {
+        return true;
+    }
+
+    // an error shows up as soon as the file is read, which is as good as
+    // input arriving.
+    while ((result = poll (&poller, 1, milliseconds)) == -1 &&
+      errno == EINTR)
+    {
+        continue;
+    }
+
+    return result != 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns true if there is no more input, reading more first if need be.
+ */
+    PUBLIC bool
+input_end (input_file_t *input)
+{
+    if (!input->mapped && input->position == input->length)
+        fill_storage (input, 1);
+
+    return input->position == input->length;
+}
+
+/**********************************************************/
+
+/**
+ *  If the input is mapped, returns the whole of the rest of it, and stores
+ *  its length in *length, without taking any of it. Returns NULL if the
+ *  input is being read instead.
+ */
+    PUBLIC const unsigned char *
+input_mapping (input_file_t *input, size_t *length)
+{
+    if (!input->mapped)
+        return NULL;
+
+    *length = input->length - input->position;
+    return input->data + input->position;
+}
+
+/**********************************************************/
+
+/**
+ *  Release the input, closing the file if input_open opened it. Returns 0,
+ *  or -1 if there was an error reading the file.
+ */
+    PUBLIC int
+input_close (input_file_t *input)
+{
+    if (input->mapped)
+        munmap ((void *) input->data, input->mapped_length);
+
+    if (input->owned)
+        close (input->fd);
+
+    free (input->storage);
+    input->storage = NULL;
+    input->data = NULL;
+
+    return input->failed ? -1 : 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Set up buffered output to a file that is already open, such as stdout.
+ *  If fd is -1, the output is thrown away.
+ */
+    PUBLIC void
+output_init (output_file_t *output, int fd)
+{
+    output->fd = fd;
+    output->buffer = checked_aligned_malloc (FILEIO_ALIGNMENT,
+      FILEIO_BUFFER_SIZE);
+    output->length = 0;
+    output->failed = false;
+    output->total = 0;
+    output->busy = 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Append length bytes to the output. Data that would overflow the buffer
+ *  is sent along with it, rather than being copied in.
+ */
+    PUBLIC void
+output_write (output_file_t *output, const unsigned char *data,
+  size_t length)
+{
+    if (output->length + length > FILEIO_BUFFER_SIZE)
+    {
+        send_data (output, data, length);
+        return;
+    }
+
+    memcpy (output->buffer + output->length, data, length);
+    output->length += length;
+}
+
+/**********************************************************/
+
+/**
+ *  Append a single byte to the output.
+ */
+    PUBLIC void
+output_byte (output_file_t *output, int byte)
+{
+    if (output->length == FILEIO_BUFFER_SIZE)
+        send_data (output, NULL, 0);
+
+    output->buffer [output->length] = byte;
+    output->length += 1;
+}
+
+/**********************************************************/
+
+/**
+ *  Send everything in the buffer to the file. Returns 0, or -1 if any of
+ *  the output so far could not be written.
+ */
+    PUBLIC int
+output_flush (output_file_t *output)
+{
+    if (output->length > 0)
+        send_data (output, NULL, 0);
+
+    return output->failed ? -1 : 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Flush the output and release its buffer. The file is left open.
+ *  Returns 0, or -1 if any of the output could not be written.
+ */
+    PUBLIC int
+output_close (output_file_t *output)
+{
+    int status = output_flush (output);
+
+    free (output->buffer);
+    output->buffer = NULL;
+
+    return status;
+}
+
+/**********************************************************/
+
+/**
+ *  Map the rest of a regular file into memory. Returns true if that
+ *  worked, or false if the input has to be read instead.
+ */
+    PRIVATE bool
+map_input (input_file_t *input)
+{
+    struct stat status;
+    off_t offset;
+    void *mapping;
+
+    if (fstat (input->fd, &status) == -1 || !S_ISREG (status.st_mode) ||
+      (offset = lseek (input->fd, 0, SEEK_CUR)) == -1 ||
+      offset >= status.st_size || (uintmax_t) status.st_size > SIZE_MAX)
+    {
+        return false;
+    }
+
+    mapping = mmap (NULL, status.st_size, PROT_READ, MAP_PRIVATE,
+      input->fd, 0);
+
+    if (mapping == MAP_FAILED)
+        return false;
+
+    posix_madvise (mapping, status.st_size, POSIX_MADV_SEQUENTIAL);
+
+    input->data = mapping;
+    input->position = offset;
+    input->length = status.st_size;
+    input->mapped = true;
+    input->mapped_length = status.st_size;
+    return true;
+}
+
+/**********************************************************/
+
+/**
+ *  Read from the file until the storage holds at least length bytes that
+ *  have not been handed out, or the file ends. What is left of the last
+ *  piece is moved to the start of the storage first, and the storage
+ *  grows if it is too small.
+ */
+    PRIVATE void
+fill_storage (input_file_t *input, size_t length)
+{
+    size_t available = input->length - input->position;
+    uint64_t start = monotonic_time ();
+    ssize_t count;
+
+    memmove (input->storage, input->storage + input->position, available);
+    input->position = 0;
+    input->length = available;
+
+    if (length > input->capacity)
+    {
+        input->capacity = length;
+        input->storage = checked_realloc (input->storage, input->capacity);
+        input->data = input->storage;
+    }
+
+    while (input->length < length && !input->end_of_file)
+    {
+        count = read (input->fd, input->storage + input->length,
+          input->capacity - input->length);
+
+        if (count > 0)
+        {
+            input->length += count;
+        }
+        else if (count == 0)
+        {
+            input->end_of_file = true;
+        }
+        else if (errno != EINTR)
+        {
+            input->failed = true;
+            input->end_of_file = true;
+        }
+    }
+
+    input->busy += monotonic_time () - start;
+}
+
+/**********************************************************/
+
+/**
+ *  Write out the buffer followed by length bytes of data, in a single
+ *  system call if possible, and empty the buffer. Once a write has failed,
+ *  nothing more is written.
+ */
+    PRIVATE void
+send_data (output_file_t *output, const unsigned char *data, size_t length)
+{
+    struct iovec pieces [2];
+    int first = 0, count = 0;
+    uint64_t start = monotonic_time ();
+    ssize_t written;
+
+    if (output->length > 0)
+    {
+        pieces [count].iov_base = output->buffer;
+        pieces [count].iov_len = output->length;
+        count += 1;
+    }
+
+    if (length > 0)
+    {
+        pieces [count].iov_base = (void *) data;
+        pieces [count].iov_len = length;
+        count += 1;
+    }
+
+    output->total += output->length + length;
+    output->length = 0;
+
+    while (first < count && !output->failed && output->fd != -1)
+    {
+        written = writev (output->fd, pieces + first, count - first);
+
+        if (written == -1)
+        {
+            if (errno != EINTR)
+                output->failed = true;
+
+            continue;
+        }
+
+        // skip over what was written, which may end part way through a
+        // piece.
+        while (first < count && (size_t) written >= pieces [first].iov_len)
+        {
+            written -= pieces [first].iov_len;
+            first += 1;
+        }
+
+        if (first < count)
+        {
+            pieces [first].iov_base = (char *) pieces [first].iov_base +
+              written;
+            pieces [first].iov_len -= written;
+        }
+    }
+
+    output->busy += monotonic_time () - start;
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
@@ -0,0 +1,89 @@
+/**
+ *  File input and output for the command line programs, without going
+ *  through stdio. A regular file is mapped into memory, and handed out
+ *  straight from the mapping; anything else, such as a pipe, is read with
+ *  read() into a large buffer. Output is gathered in a large, page aligned
+ *  buffer, and sent with write(), or with writev() when a large piece of
+ *  data would overflow it, so that the data does not have to be copied.
+ *  Input can also be taken as it arrives, rather than a buffer full at a
+ *  time, for streams that have to keep up with a slow writer.
+ */
+
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "utils.h"
+
+// size of the buffers used for input that cannot be mapped, and for
+// output.
+#define FILEIO_BUFFER_SIZE  (1 << 20)
+
+// alignment of the output buffer, which is that of a page on most
+// machines.
+#define FILEIO_ALIGNMENT    4096
+
+
+typedef struct
+{
+    int fd;
+    bool owned;
+
+    // data from position up to length has not been handed out yet. If the
+    // file is mapped, data is the mapping, which holds the whole file.
+    // Otherwise it is storage, which is refilled from the file.
+    const unsigned char *data;
+    size_t position;
+    size_t length;
+    bool mapped;
+    size_t mapped_length;
+
+    unsigned char *storage;
+    size_t capacity;
+    bool end_of_file;
+    bool failed;
+
+    // number of bytes handed out so far, and nanoseconds spent in read().
+    uint64_t total;
+    uint64_t busy;
+}
+input_file_t;
+
+typedef struct
+{
+    int fd;
+    unsigned char *buffer;
+    size_t length;
+    bool failed;
+
+    // number of bytes output so far, and nanoseconds spent in writev().
+    uint64_t total;
+    uint64_t busy;
+}
+output_file_t;
+
+
+int input_open (input_file_t *input, const char *path);
+void input_init (input_file_t *input, int fd);
+size_t input_read (input_file_t *input, const unsigned char **data,
+  size_t length);
+size_t input_read_some (input_file_t *input, const unsigned char **data,
+  size_t length);
+bool input_wait (input_file_t *input, int milliseconds);
+bool input_end (input_file_t *input);
+const unsigned char * input_mapping (input_file_t *input, size_t *length);
+int input_close (input_file_t *input);
+
+void output_init (output_file_t *output, int fd);
+void output_write (output_file_t *output, const unsigned char *data,
+  size_t length);
+void output_byte (output_file_t *output, int byte);
+int output_flush (output_file_t *output);
+int output_close (output_file_t *output);
+
+
+#endif // FILEIO_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
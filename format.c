@@ -0,0 +1,108 @@
+/**
+ *  Functions for writing and checking the header of a compressed stream,
+ *  and the sync points of a stream with FLAG_FLUSH.
+ */
+
+#include "utils.h"
+#include "node.h"
+#include "bitio.h"
+#include "format.h"
+
+/**********************************************************/
+
+/**
+ *  Write the stream header: the magic bytes followed by the version, the
+ *  mode and the flags.
+ */
+    PUBLIC void
+write_header (bit_writer_t *writer, int mode, int flags)
+{
+    for (int i = 0; i < STREAM_MAGIC_LENGTH; i ++)
+        write_bits (writer, STREAM_MAGIC [i], 8);
+
+    write_bits (writer, STREAM_VERSION, 8);
+    write_bits (writer, mode, 8);
+    write_bits (writer, flags, 8);
+}
+
+/**********************************************************/
+
+/**
+ *  Read and check the stream header, and store its flags in *flags.
+ *  Returns the mode if the header is valid, of a version we understand
+ *  and uses no features we do not know about, -1 otherwise.
+ */
+    PUBLIC int
+read_header (bit_reader_t *reader, int *flags)
+{
+    int mode;
+
+    for (int i = 0; i < STREAM_MAGIC_LENGTH; i ++)
+    {
+        if (read_bits (reader, 8) != STREAM_MAGIC [i])
+            return -1;
+    }
+
+    if (read_bits (reader, 8) != STREAM_VERSION)
+        return -1;
+
+    mode = read_bits (reader, 8);
+
+    if (mode < MODE_ADAPTIVE || mode > MODE_LZ)
+        return -1;
+
+    *flags = read_bits (reader, 8);
+
+    if (*flags == -1 || (*flags & ~KNOWN_FLAGS) != 0)
+        return -1;
+
+    return mode;
+}
+
+/**********************************************************/
+
+/**
+ *  Write what follows an end of stream codeword in a stream with
+ *  FLAG_FLUSH: a sync point if sync is true, or the mark of the real end
+ *  otherwise.
+ */
+    PUBLIC void
+write_sync (bit_writer_t *writer, bool sync)
+{
+    write_bits (writer, sync ? 1 : 0, 1);
+
+    if (sync)
+    {
+        writer_align (writer);
+        write_bits (writer, 0, 8);
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Read what follows an end of stream codeword in a stream with
+ *  FLAG_FLUSH. Returns SYNC_POINT, with the input left just after it,
+ *  END_OF_STREAM, or DECODE_ERROR if the input ends first or the sync
+ *  point is not well formed.
+ */
+    PUBLIC int
+read_sync (bit_reader_t *reader)
+{
+    int sync = read_bit (reader);
+
+    if (sync == 0)
+        return END_OF_STREAM;
+
+    if (sync == -1 || reader_align (reader) == -1 ||
+      read_bits (reader, 8) != 0)
+    {
+        return DECODE_ERROR;
+    }
+
+    return SYNC_POINT;
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
@@ -0,0 +1,73 @@
+/**
+ *  Layout of the compressed stream. A stream begins with a short header
+ *  identifying the format, the mode it was compressed in and any optional
+ *  features it uses, followed by the packed codewords.
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "bitio.h"
+
+// the first three bytes of every compressed stream.
+#define STREAM_MAGIC        "SQZ"
+#define STREAM_MAGIC_LENGTH 3
+
+// bumped whenever the layout of the stream changes incompatibly.
+#define STREAM_VERSION      5
+
+// the modes a stream may be compressed in. In adaptive mode, the whole
+// stream is coded with a single adaptive Huffman tree. In block mode, it
+// is a sequence of independently coded blocks; see block.c. In context
+// mode, the header is followed by a byte giving the order of the context
+// model, and each byte is coded with the tree for its context; see
+// context.c. In LZ mode, the header is followed by a byte giving the size
+// of the window, in bits, and the input is coded as literals and matches;
+// see lz.c. In adaptive, context and LZ modes, the next byte is the age
+// limit of the trees, in bits; see adaptive.h.
+#define MODE_ADAPTIVE       0
+#define MODE_BLOCK          1
+#define MODE_CONTEXT        2
+#define MODE_LZ             3
+
+// flags for optional features, in the byte after the mode. A seekable
+// stream is made up of segments, each coded from scratch, followed by an
+// index of where they start; see seekable.h. With FLAG_CHECKSUM, the end
+// of the stream, or of each segment, is padded to a byte boundary and
+// followed by a 32 bit CRC32C of the data it holds, and each block header
+// holds one of its block; see checksum.h and block.c.
+//
+// With FLAG_FLUSH, the stream may hold sync points, where the encoder has
+// pushed out everything it was given so far. In adaptive, context and LZ
+// modes, every end of stream codeword is then followed by a bit: 0 at the
+// real end, or 1 at a sync point, which is padded to a byte boundary and
+// followed by a zero byte, after which coding carries on with the same
+// models. The zero byte makes sure that the decoder, which looks up to
+// DECODE_BITS bits ahead, can decode the codeword without any input from
+// beyond the sync point. In block mode, blocks already end at a byte
+// boundary, and a sync point is just a short block.
+//
+// With FLAG_DEFERRED, which only applies to adaptive, context and LZ
+// modes, the trees defer their updates, and the age limit is followed by
+// a byte giving the drift limit, in bits; see adaptive.h.
+#define FLAG_SEEKABLE       0x01
+#define FLAG_CHECKSUM       0x02
+#define FLAG_FLUSH          0x04
+#define FLAG_DEFERRED       0x08
+#define KNOWN_FLAGS         (FLAG_SEEKABLE | FLAG_CHECKSUM | FLAG_FLUSH | \
+                              FLAG_DEFERRED)
+
+// returned by read_sync at a sync point. It is distinct from the results
+// in node.h and checksum.h.
+#define SYNC_POINT          (-5)
+
+
+void write_header (bit_writer_t *writer, int mode, int flags);
+int read_header (bit_reader_t *reader, int *flags);
+void write_sync (bit_writer_t *writer, bool sync);
+int read_sync (bit_reader_t *reader);
+
+
+#endif // FORMAT_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
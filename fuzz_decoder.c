@@ -0,0 +1,113 @@
+/**
+ *  Fuzz target for the decoder. Built with clang -fsanitize=fuzzer, it is
+ *  a libFuzzer target (see make fuzz). Built with -DSTANDALONE_FUZZ, it
+ *  has a main of its own, which decodes stdin or each file named on the
+ *  command line, so it can be driven by AFL or used to replay a crash.
+ *
+ *  The input is fed to the decoder in two pieces, split at a point chosen
+ *  by the input's first byte, so that the decoder's handling of steps that
+ *  run out of input gets fuzzed as well.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "utils.h"
+#include "streamzip.h"
+
+/**********************************************************/
+
+// output is decoded into a small buffer, and thrown away.
+#define OUTPUT_SIZE     4096
+
+/**********************************************************/
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t length);
+
+PRIVATE int feed (sz_decoder_t *decoder, const uint8_t *data,
+  size_t length);
+
+/**********************************************************/
+
+/**
+ *  Decode one input. Corrupt streams are expected; the only failures are
+ *  the ones the sanitizers or the fuzzer notice.
+ */
+    PUBLIC int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t length)
+{
+    sz_decoder_t *decoder = sz_decoder_new ();
+    size_t split = (length > 0) ? data [0] % (length + 1) : 0;
+
+    if (feed (decoder, data, split) == SZ_OK)
+        feed (decoder, data + split, length - split);
+
+    sz_decoder_free (decoder);
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Give the decoder all of the data, and collect whatever it decodes,
+ *  until it stops making progress. Returns its last result.
+ */
+    PRIVATE int
+feed (sz_decoder_t *decoder, const uint8_t *data, size_t length)
+{
+    unsigned char output [OUTPUT_SIZE];
+    size_t consumed, produced;
+    int result;
+
+    do
+    {
+        result = sz_decode (decoder, data, length, output, OUTPUT_SIZE,
+          &consumed, &produced);
+        data += consumed;
+        length -= consumed;
+    }
+    while (result == SZ_OK && (consumed > 0 || produced > 0));
+
+    return result;
+}
+
+/**********************************************************/
+
+#ifdef STANDALONE_FUZZ
+
+/**
+ *  Decode stdin, or each file named on the command line, as one input.
+ */
+    PUBLIC int
+main (int argc, char **argv)
+{
+    static uint8_t data [1 << 24];
+    size_t length;
+    FILE *file;
+
+    for (int i = 1; i < argc || i == 1; i ++)
+    {
+        file = (i < argc) ? fopen (argv [i], "rb") : stdin;
+
+        if (file == NULL)
+        {
+            perror (argv [i]);
+            return EXIT_FAILURE;
+        }
+
+        length = fread (data, 1, sizeof (data), file);
+        LLVMFuzzerTestOneInput (data, length);
+
+        if (file != stdin)
+            fclose (file);
+    }
+
+    return 0;
+}
+
+#endif // STANDALONE_FUZZ
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
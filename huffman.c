@@ -4,170 +4,392 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "alphabet.h"
+#include "huffman.h"
 #include "node.h"
-#include "heap.h"
 #include "utils.h"
 
 
-PRIVATE void build_heap (heap_t *heap);
-PRIVATE int do_lookup (const node_t *tree, int ch, char *buffer, int length);
+// an item in one of the package merge lists: either a leaf for a single
+// symbol, or a package of two items from the list below.
+typedef struct
+{
+    uint64_t weight;
 
+    // index of the symbol for a leaf, or -1 for a package.
+    int symbol;
+    int left, right;
+}
+package_t;
 
-// this is a dummy node in the huffman tree that represents any symbol
-// that has not yet been encountered.
-node_t not_seen;
+// most items the package merge can create: a leaf for every symbol, and
+// fewer packages than that at each level.
+#define PACKAGE_POOL    (NUM_SYMBOLS * (MAX_CODE_LENGTH + 1))
 
-// another dummy node used to indicate the end of the compressed stream.
-node_t end_stream;
 
+PRIVATE int make_leaves (node_arena_t *arena, const int *counts,
+  bool escapes, int *leaves);
+PRIVATE void sort_leaves (const node_arena_t *arena, int *leaves,
+  int count);
+PRIVATE void fill_codewords (const node_arena_t *arena, int node,
+  codeword_t *table, uint64_t bits, int length);
+PRIVATE void fill_lengths (const node_arena_t *arena, int node,
+  uint8_t *lengths, int length);
+PRIVATE void count_leaves (const package_t *pool, int item,
+  uint8_t *lengths);
 
-/**
- *  Initialise an array of node_t's one for each of the 256 values that
- *  can be represented with a byte.
- */
-    PUBLIC void
-huffman_init (void)
-{
-    // set the values for the not seen dummy symbol.
-    not_seen.frequency = 0;
-    not_seen.ch = NOT_SEEN;
-    not_seen.left = not_seen.right = NULL;
-
-    end_stream.frequency = 0;
-    end_stream.ch = END_OF_STREAM;
-    end_stream.left = end_stream.right = NULL;
-}
 
 /**
- *  Builds a Huffman tree using the collected character frequencies.
+ *  Builds a Huffman tree from the given character frequencies, which has
+ *  an entry for each of the ALPHABET_LENGTH byte values. Bytes with a
+ *  count of zero are left out of the tree. If escapes is true, zero weight
+ *  leaves for the not seen and end of stream symbols are added as well.
+ *
+ *  The tree is built with the two queue method. The leaves are sorted by
+ *  weight once, and new internal nodes are created in order of weight, so
+ *  they can simply be appended to a second queue. The two lightest items
+ *  are then always at the front of one queue or the other. Ties are
+ *  broken as described in huffman.h, so the same counts always give the
+ *  same tree.
+ *
+ *  Any tree previously held in the arena is discarded, and the new tree's
+ *  nodes are taken from it. Returns the index of the root node, or NO_NODE
+ *  if the tree would be empty.
  */
-    PUBLIC node_t *
-build_huffman_tree (void)
+    PUBLIC int
+build_huffman_tree (node_arena_t *arena, const int *counts, bool escapes)
 {
-    node_t *array [ALPHABET_LENGTH + 2];
-    node_t *parent, *child1, *child2;
-    heap_t heap;
+    int leaves [MAX_LEAVES], internal [MAX_LEAVES];
+    int num_leaves, next_leaf = 0, head = 0, tail = 0;
+    int child [2];
 
-    heap.array = array;
-    heap.num_items = 0;
-    heap.num_free_slots = ALPHABET_LENGTH + 2;
+    arena_reset (arena);
+    num_leaves = make_leaves (arena, counts, escapes, leaves);
 
-    build_heap (&heap);
+    if (num_leaves == 0)
+        return NO_NODE;
 
-    while (heap.num_items > 1)
-    {
-        child1 = heap_dequeue (&heap);
-        child2 = heap_dequeue (&heap);
+    if (num_leaves == 1)
+        return leaves [0];
+
+    sort_leaves (arena, leaves, num_leaves);
 
-        parent = new_node (size (child1) + size (child2), child1, child2);
+    for (int joined = 1; joined < num_leaves; joined ++)
+    {
+        for (int c = 0; c < 2; c ++)
+        {
+            if (head == tail || (next_leaf < num_leaves &&
+              size (arena, leaves [next_leaf]) <=
+              size (arena, internal [head])))
+            {
+                child [c] = leaves [next_leaf ++];
+            }
+            else
+            {
+                child [c] = internal [head ++];
+            }
+        }
 
-        heap_enqueue (&heap, parent);
+        internal [tail ++] = new_node (arena,
+          size (arena, child [0]) + size (arena, child [1]),
+          child [0], child [1]);
     }
 
-    return heap_dequeue (&heap);
+    return internal [tail - 1];
 }
 
 /**
- *  Look up the codeword for a given 8 bit value. If the value does not
- *  appear in the tree, this function will provide the codeword for not
- *  seen, and return 0.
+ *  Fill in a table giving the codeword of every symbol in the tree, so
+ *  that encoding a symbol is a single table lookup rather than a search
+ *  of the tree. The table must have NUM_SYMBOLS entries, and is indexed
+ *  with SYMBOL_INDEX. Symbols that are not in the tree get a length of 0.
  */
-    PUBLIC int
-lookup_codeword (const node_t *tree, int ch, char *buffer, int length)
+    PUBLIC void
+build_codeword_table (const node_arena_t *arena, int root,
+  codeword_t *table)
 {
-    if (seen_symbol (ch) != 1 && ch != END_OF_STREAM)
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
     {
-        // look up the codeword for NOT_SEEN
-        do_lookup (tree, NOT_SEEN, buffer, length);
-        return 0;
+        table [i].bits = 0;
+        table [i].length = 0;
     }
+
+    fill_codewords (arena, root, table, 0, 0);
+}
+
+/**
+ *  Record the length of each symbol's codeword in lengths, which has
+ *  NUM_SYMBOLS entries indexed with SYMBOL_INDEX. Symbols that are not in
+ *  the tree get a length of 0. If the tree is a single leaf, that symbol
+ *  is given a length of 1, so that every symbol coded uses at least one
+ *  bit.
+ */
+    PUBLIC void
+build_code_lengths (const node_arena_t *arena, int root, uint8_t *lengths)
+{
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+        lengths [i] = 0;
+
+    if (root == NO_NODE)
+        return;
+
+    if (is_leaf (arena, root))
+        lengths [SYMBOL_INDEX (arena->nodes [root].ch)] = 1;
     else
-    {
-        do_lookup (tree, ch, buffer, length);
-        return 1;
-    }
+        fill_lengths (arena, root, lengths, 0);
 }
 
 /**
- *  Traverse the Huffman tree searching for the node corresponding to
- *  the given 8 bit value.
+ *  Make sure that no codeword is longer than max_length bits. If one is,
+ *  the lengths of all the symbols with codewords are replaced with the
+ *  best lengths that fit the limit, found with the package merge
+ *  algorithm. counts gives the weight of each of the ALPHABET_LENGTH byte
+ *  values; any other symbol with a codeword has a weight of 0.
  *
- *  Return value is 1 if ch was found, 0 if not found.
+ *  Package merge works down from the longest allowed length. Each list
+ *  holds the leaves, plus the items of the list for the next longer
+ *  length, paired up into packages, all sorted by weight. The cheapest
+ *  2n - 2 items of the list for length 1 make up the code, and each
+ *  symbol's codeword is as long as the number of those items it is in.
  */
-    PRIVATE int
-do_lookup (const node_t *tree, int ch, char *buffer, int length)
+    PUBLIC void
+limit_code_lengths (const int *counts, uint8_t *lengths, int max_length)
 {
-    assert (length > 0);
+    int list [2 * NUM_SYMBOLS], merged [2 * NUM_SYMBOLS];
+    int num_leaves = 0, list_length, num_packages, used, next, leaf, j;
+    int longest = 0;
+    package_t *pool, item;
+
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+    {
+        if (lengths [i] > longest)
+            longest = lengths [i];
+    }
+
+    if (longest <= max_length)
+        return;
+
+    pool = checked_malloc (PACKAGE_POOL * sizeof (package_t));
+
+    // the leaves go at the start of the pool, in order of weight. Equal
+    // weights stay in symbol order, so the result is deterministic.
+    for (int i = 0; i < NUM_SYMBOLS; i ++)
+    {
+        if (lengths [i] == 0)
+            continue;
 
-    // have we reached a leaf node? If so, check if it is the
-    // one we are looking for.
-    if (tree->left == NULL && tree->right == NULL)
+        item.weight = (i < ALPHABET_LENGTH) ? counts [i] : 0;
+        item.symbol = i;
+        item.left = item.right = -1;
+
+        for (j = num_leaves; j > 0 && pool [j - 1].weight > item.weight; j --)
+            pool [j] = pool [j - 1];
+
+        pool [j] = item;
+        num_leaves += 1;
+    }
+
+    assert (max_length >= MIN_LENGTH_LIMIT && max_length <= MAX_CODE_LENGTH);
+    assert (num_leaves <= (1 << MIN_LENGTH_LIMIT));
+
+    for (int i = 0; i < num_leaves; i ++)
+        list [i] = i;
+
+    list_length = num_leaves;
+    used = num_leaves;
+
+    for (int length = max_length; length > 1; length --)
     {
-        *buffer = '\0';
+        num_packages = list_length / 2;
 
-        if (tree->ch == ch)
+        for (int i = 0; i < num_packages; i ++)
         {
-            return 1;
+            pool [used + i].weight = pool [list [2 * i]].weight +
+              pool [list [2 * i + 1]].weight;
+            pool [used + i].symbol = -1;
+            pool [used + i].left = list [2 * i];
+            pool [used + i].right = list [2 * i + 1];
         }
-        else
+
+        // merge the packages with the leaves. Leaves go first when the
+        // weights are equal.
+        leaf = 0;
+        next = 0;
+        list_length = 0;
+
+        while (leaf < num_leaves || next < num_packages)
         {
-            return 0;
+            if (next == num_packages || (leaf < num_leaves &&
+              pool [leaf].weight <= pool [used + next].weight))
+            {
+                merged [list_length ++] = leaf ++;
+            }
+            else
+            {
+                merged [list_length ++] = used + next ++;
+            }
         }
-    }
 
-    // not a leaf node. Continue to search any child of the current node.
-    if (tree->left != NULL)
-    {
-        *buffer = '0';
+        used += num_packages;
 
-        if (do_lookup (tree->left, ch, buffer + 1, length - 1) == 1)
-            return 1;
+        for (int i = 0; i < list_length; i ++)
+            list [i] = merged [i];
     }
 
-    if (tree->right != NULL)
-    {
-        *buffer = '1';
+    for (int i = 0; i < num_leaves; i ++)
+        lengths [pool [i].symbol] = 0;
+
+    for (int i = 0; i < 2 * num_leaves - 2; i ++)
+        count_leaves (pool, list [i], lengths);
 
-        if (do_lookup (tree->right, ch, buffer + 1, length - 1) == 1)
-            return 1;
+    free (pool);
+}
+
+/**
+ *  Add one to the codeword length of every leaf in a package merge item.
+ */
+    PRIVATE void
+count_leaves (const package_t *pool, int item, uint8_t *lengths)
+{
+    if (pool [item].symbol >= 0)
+    {
+        lengths [pool [item].symbol] += 1;
+        return;
     }
 
-    return 0;
+    count_leaves (pool, pool [item].left, lengths);
+    count_leaves (pool, pool [item].right, lengths);
 }
 
 /**
- *  Constructs a heap out of the character frequency table.
+ *  Traverse the Huffman tree, recording the depth of each leaf.
  */
     PRIVATE void
-build_heap (heap_t *heap)
+fill_lengths (const node_arena_t *arena, int node, uint8_t *lengths,
+  int length)
 {
-    enqueue_symbols (heap);
-    heap_enqueue (heap, &not_seen);
-    heap_enqueue (heap, &end_stream);
+    const node_t *tree = arena->nodes + node;
+
+    if (is_leaf (arena, node))
+    {
+        assert (length <= MAX_CODE_LENGTH);
+        lengths [SYMBOL_INDEX (tree->ch)] = length;
+        return;
+    }
+
+    fill_lengths (arena, tree->left, lengths, length + 1);
+    fill_lengths (arena, tree->right, lengths, length + 1);
 }
 
 /**
- *  Traverse the Huffman tree and free all the malloced nodes.
+ *  Traverse the Huffman tree, recording the path taken to reach each leaf
+ *  node in the codeword table. Left branches are 0 bits, and right
+ *  branches are 1 bits.
  */
-    PUBLIC void
-free_huffman_tree (node_t *tree)
+    PRIVATE void
+fill_codewords (const node_arena_t *arena, int node, codeword_t *table,
+  uint64_t bits, int length)
 {
-    // do not free leaf nodes, as they are not allocated with malloc.
-    if (tree->left == NULL && tree->right == NULL)
+    const node_t *tree = arena->nodes + node;
+
+    // have we reached a leaf node? If so, the path taken so far is its
+    // codeword.
+    if (is_leaf (arena, node))
+    {
+        assert (length < 64);
+        table [SYMBOL_INDEX (tree->ch)].bits = bits;
+        table [SYMBOL_INDEX (tree->ch)].length = length;
         return;
+    }
 
-    // first free the left and right branches, if they exist.
-    if (tree->left != NULL)
-        free_huffman_tree (tree->left);
+    if (tree->left != NO_NODE)
+        fill_codewords (arena, tree->left, table, bits << 1, length + 1);
 
-    if (tree->right != NULL)
-        free_huffman_tree (tree->right);
+    if (tree->right != NO_NODE)
+        fill_codewords (arena, tree->right, table, (bits << 1) | 1,
+          length + 1);
+}
 
-    // now free the node itself.
-    free (tree);
+/**
+ *  Create a leaf node in the arena for each symbol that has a non zero
+ *  count, along with leaves for the not seen and end of stream dummy
+ *  symbols if they are wanted. The leaves are listed in symbol index
+ *  order. Returns the number of leaves.
+ */
+    PRIVATE int
+make_leaves (node_arena_t *arena, const int *counts, bool escapes,
+  int *leaves)
+{
+    int count = 0;
+
+    for (int i = 0; i < ALPHABET_LENGTH; i ++)
+    {
+        if (counts [i] > 0)
+            leaves [count ++] = new_leaf (arena, counts [i], i);
+    }
+
+    if (escapes)
+    {
+        leaves [count ++] = new_leaf (arena, 0, NOT_SEEN);
+        leaves [count ++] = new_leaf (arena, 0, END_OF_STREAM);
+    }
+
+    return count;
+}
+
+/**
+ *  Sort a list of leaves into order of weight, with a radix sort, one byte
+ *  of the weight at a time, starting from the least significant. Each pass
+ *  is stable, so leaves of equal weight stay in the order they started
+ *  in. Passes stop once the remaining bytes of every weight are zero.
+ */
+    PRIVATE void
+sort_leaves (const node_arena_t *arena, int *leaves, int count)
+{
+    int buffer [MAX_LEAVES], position [256];
+    int *from = leaves, *to = buffer, *swap;
+    unsigned int largest = 0, digit;
+
+    for (int i = 0; i < count; i ++)
+    {
+        if ((unsigned int) size (arena, leaves [i]) > largest)
+            largest = size (arena, leaves [i]);
+    }
+
+    for (int shift = 0; shift < 32 && (largest >> shift) != 0; shift += 8)
+    {
+        for (int d = 0; d < 256; d ++)
+            position [d] = 0;
+
+        for (int i = 0; i < count; i ++)
+            position [(size (arena, from [i]) >> shift) & 0xff] += 1;
+
+        // turn the counts into the position of the first leaf with each
+        // digit.
+        for (int d = 0, total = 0; d < 256; d ++)
+        {
+            digit = position [d];
+            position [d] = total;
+            total += digit;
+        }
+
+        for (int i = 0; i < count; i ++)
+            to [position [(size (arena, from [i]) >> shift) & 0xff] ++] =
+              from [i];
+
+        swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != leaves)
+    {
+        for (int i = 0; i < count; i ++)
+            leaves [i] = from [i];
+    }
 }
 
 /** vim: set ts=4 sw=4 et : */
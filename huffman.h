@@ -6,16 +6,66 @@
 #ifndef HUFFMAN_H
 #define HUFFMAN_H
 
+#include <stdint.h>
+
 #include "node.h"
 #include "alphabet.h"
 
 #define NUM_CODEWORDS   (ALPHABET_LENGTH + 1)
 
+// every byte value, plus the not seen and end of stream symbols.
+#define NUM_SYMBOLS     (ALPHABET_LENGTH + 2)
+
+// symbols for the lengths of LZ matches, which only appear in adaptive
+// trees; see lz.h. They are numbered from NUM_SYMBOLS upwards, so they
+// follow the special symbols in index order.
+#define NUM_LENGTH_CODES    16
+#define ADAPTIVE_SYMBOLS    (NUM_SYMBOLS + NUM_LENGTH_CODES)
+
+// map a symbol, which may be one of the negative special values, onto an
+// index in the range 0 to ADAPTIVE_SYMBOLS - 1.
+#define SYMBOL_INDEX(s) ((s) >= 0 ? (s) : ALPHABET_LENGTH - 1 - (s))
+
+// inverse of SYMBOL_INDEX.
+#define INDEX_SYMBOL(i) ((i) < ALPHABET_LENGTH || (i) >= NUM_SYMBOLS ? (i) : \
+                          ALPHABET_LENGTH - 1 - (i))
+
+// longest codeword a static tree may have. No tree built from fewer than
+// 2^31 symbols can be deeper than this.
+#define MAX_CODE_LENGTH 63
+
+// shortest limit that may be put on the codeword length of a static code.
+// There must be at least as many codewords of that length as there are
+// symbols.
+#define MIN_LENGTH_LIMIT 9
+
+
+// Static trees are built deterministically, so that every build of the
+// encoder produces the same code from the same counts:
+//
+//  - leaves are ordered by weight, and leaves of equal weight by symbol
+//    index (bytes first, then not seen, then end of stream);
+//  - when a leaf and an internal node have the same weight, the leaf is
+//    taken first;
+//  - the first item taken becomes the left (0) child of the new node.
+
+// a codeword, right aligned in bits, with its length. A length of 0 means
+// the symbol has no codeword.
+typedef struct
+{
+    uint64_t bits;
+    int length;
+}
+codeword_t;
+
 
-void huffman_init (void);
-node_t * build_huffman_tree (void);
-int lookup_codeword (const node_t *tree, int ch, char *buffer, int length);
-void free_huffman_tree (node_t *tree);
+int build_huffman_tree (node_arena_t *arena, const int *counts, bool escapes);
+void build_code_lengths (const node_arena_t *arena, int root,
+  uint8_t *lengths);
+void build_codeword_table (const node_arena_t *arena, int root,
+  codeword_t *table);
+void limit_code_lengths (const int *counts, uint8_t *lengths,
+  int max_length);
 
 
 #endif // HUFFMAN_H
@@ -0,0 +1,672 @@
+/**
+ *  LZ77 parsing and coding of literals and matches. See lz.h.
+ *
+ *  Match lengths (less LZ_MIN_MATCH) and distances (less one) are both
+ *  sent as a code and some extra bits. Values below 4 have codes of their
+ *  own; above that, each power of two is split into two codes, picked by
+ *  the bit below the top one, and the bits below that are sent as they
+ *  are. A value of up to 2^n therefore needs at most 2n codes.
+ *
+ *  The encoder only codes a position once it has LOOKAHEAD bytes of input
+ *  after it, or the stream is ending: enough for the longest match, and to
+ *  put every position in the match on the hash chains. So the matches it
+ *  finds, and its output, do not depend on how the input was split up.
+ *
+ *  For statistics, each literal, length and distance counts as a codeword,
+ *  along with its extra bits, and each tree update is timed as one model
+ *  update.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "node.h"
+#include "huffman.h"
+#include "adaptive.h"
+#include "bitio.h"
+#include "stats.h"
+#include "lz.h"
+
+/**********************************************************/
+
+// input the encoder needs after a position before it codes it.
+#define LOOKAHEAD           (LZ_MAX_MATCH + LZ_MIN_MATCH)
+
+/**********************************************************/
+
+PRIVATE void seed_trees (adaptive_tree_t *symbols,
+  adaptive_tree_t *distances, int window_bits);
+PRIVATE void code_input (lz_encoder_t *encoder, bit_writer_t *writer,
+  bool ending);
+PRIVATE uint32_t hash_at (const lz_encoder_t *encoder, uint64_t position);
+PRIVATE void insert_position (lz_encoder_t *encoder, uint64_t position);
+PRIVATE void rebase_chains (lz_encoder_t *encoder);
+PRIVATE uint32_t find_match (lz_encoder_t *encoder, uint32_t limit,
+  uint32_t *distance);
+PRIVATE void write_match (lz_encoder_t *encoder, bit_writer_t *writer,
+  uint32_t length, uint32_t distance);
+PRIVATE void update_tree (adaptive_tree_t *tree, int symbol, int bits,
+  stats_t *stats);
+PRIVATE int read_extra (bit_reader_t *reader, int extra_bits);
+PRIVATE int value_code (uint32_t value, int *extra_bits);
+PRIVATE uint32_t code_base (int code, int *extra_bits);
+
+/**********************************************************/
+
+/**
+ *  Create an encoder with a window of 2^window_bits bytes, whose trees are
+ *  aged at 2^age_bits and have a drift limit of drift_bits.
+ */
+    PUBLIC lz_encoder_t *
+lz_encoder_new (int window_bits, int age_bits, int drift_bits)
+{
+    lz_encoder_t *encoder = checked_malloc (sizeof (lz_encoder_t));
+
+    assert (window_bits >= LZ_MIN_WINDOW_BITS &&
+      window_bits <= LZ_MAX_WINDOW_BITS);
+
+    encoder->window_bits = window_bits;
+    encoder->window = (size_t) 1 << window_bits;
+    encoder->max_chain = LZ_MAX_CHAIN;
+
+    if (window_bits > LZ_DEFAULT_WINDOW_BITS)
+    {
+        encoder->max_chain <<= (window_bits - LZ_DEFAULT_WINDOW_BITS) /
+          LZ_CHAIN_STEP_BITS;
+    }
+
+    // the buffer holds a window of coded input, plus room for a window of
+    // new input and its lookahead before it has to slide down.
+    encoder->capacity = 2 * encoder->window + LOOKAHEAD;
+    encoder->buffer = checked_malloc (encoder->capacity);
+    encoder->length = 0;
+    encoder->base = 0;
+    encoder->position = 0;
+
+    encoder->head = checked_malloc ((1 << LZ_HASH_BITS) * sizeof (uint32_t));
+    encoder->prev = checked_malloc (encoder->window * sizeof (uint32_t));
+
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i ++)
+        encoder->head [i] = 0;
+
+    adaptive_init (&encoder->symbols, age_bits, drift_bits);
+    adaptive_init (&encoder->distances, age_bits, drift_bits);
+    seed_trees (&encoder->symbols, &encoder->distances, window_bits);
+    encoder->stats = NULL;
+
+    return encoder;
+}
+
+/**********************************************************/
+
+/**
+ *  Add length bytes of input, and code as much of it as can be coded
+ *  without knowing what comes next.
+ */
+    PUBLIC void
+lz_encode (lz_encoder_t *encoder, bit_writer_t *writer,
+  const unsigned char *data, size_t length)
+{
+    size_t count;
+
+    while (length > 0)
+    {
+        // once the buffer is full, the oldest window of it can no longer
+        // be matched, since the next position to code is more than a
+        // window past it.
+        if (encoder->length == encoder->capacity)
+        {
+            memmove (encoder->buffer, encoder->buffer + encoder->window,
+              encoder->length - encoder->window);
+            encoder->length -= encoder->window;
+            encoder->base += encoder->window;
+            rebase_chains (encoder);
+        }
+
+        count = encoder->capacity - encoder->length;
+
+        if (count > length)
+            count = length;
+
+        memcpy (encoder->buffer + encoder->length, data, count);
+        encoder->length += count;
+        data += count;
+        length -= count;
+
+        code_input (encoder, writer, false);
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Code the rest of the input, followed by the end of stream symbol. At a
+ *  sync point, coding carries on afterwards, with the same window and
+ *  trees; see format.h.
+ */
+    PUBLIC void
+lz_encode_end (lz_encoder_t *encoder, bit_writer_t *writer)
+{
+    int bits;
+
+    code_input (encoder, writer, true);
+    bits = adaptive_write (&encoder->symbols, writer, END_OF_STREAM);
+
+    if (encoder->stats != NULL)
+        stats_symbol (encoder->stats, bits);
+}
+
+/**********************************************************/
+
+/**
+ *  Release an encoder.
+ */
+    PUBLIC void
+lz_encoder_free (lz_encoder_t *encoder)
+{
+    if (encoder == NULL)
+        return;
+
+    free (encoder->buffer);
+    free (encoder->head);
+    free (encoder->prev);
+    free (encoder);
+}
+
+/**********************************************************/
+
+/**
+ *  Create a decoder for a stream coded with a window of 2^window_bits
+ *  bytes, and trees aged at 2^age_bits with a drift limit of drift_bits.
+ */
+    PUBLIC lz_decoder_t *
+lz_decoder_new (int window_bits, int age_bits, int drift_bits)
+{
+    lz_decoder_t *decoder = checked_malloc (sizeof (lz_decoder_t));
+
+    assert (window_bits >= LZ_MIN_WINDOW_BITS &&
+      window_bits <= LZ_MAX_WINDOW_BITS);
+
+    decoder->window_bits = window_bits;
+    decoder->window = (size_t) 1 << window_bits;
+    decoder->history = checked_malloc (decoder->window);
+    decoder->position = 0;
+    decoder->delivered = 0;
+
+    adaptive_init (&decoder->symbols, age_bits, drift_bits);
+    adaptive_init (&decoder->distances, age_bits, drift_bits);
+    seed_trees (&decoder->symbols, &decoder->distances, window_bits);
+    decoder->stats = NULL;
+
+    return decoder;
+}
+
+/**********************************************************/
+
+/**
+ *  Read the next literal or match, without changing the decoder. Returns
+ *  0, END_OF_STREAM, or DECODE_ERROR if the input ends first or the token
+ *  does not make sense.
+ */
+    PUBLIC int
+lz_read (lz_decoder_t *decoder, bit_reader_t *reader, lz_token_t *token)
+{
+    uint64_t start = reader->consumed;
+    int symbol, code, extra_bits, extra;
+
+    *token = (lz_token_t) { 0 };
+    symbol = adaptive_read (&decoder->symbols, reader);
+    token->symbol = symbol;
+    token->symbol_bits = reader->consumed - start;
+
+    if (symbol < 0)
+        return symbol;
+
+    if (symbol < ALPHABET_LENGTH)
+        return 0;
+
+    if (symbol < NUM_SYMBOLS || symbol >= ADAPTIVE_SYMBOLS)
+        return DECODE_ERROR;
+
+    token->length = code_base (symbol - NUM_SYMBOLS, &extra_bits);
+
+    if ((extra = read_extra (reader, extra_bits)) == -1)
+        return DECODE_ERROR;
+
+    token->length += extra + LZ_MIN_MATCH;
+    token->symbol_bits = reader->consumed - start;
+    start = reader->consumed;
+
+    // the distance tree only has codes for distances within the window.
+    code = adaptive_decode (&decoder->distances, reader);
+
+    if (code < 0 || code >= LZ_DISTANCE_CODES (decoder->window_bits))
+        return DECODE_ERROR;
+
+    token->distance_code = code;
+    token->distance = code_base (code, &extra_bits);
+
+    if ((extra = read_extra (reader, extra_bits)) == -1)
+        return DECODE_ERROR;
+
+    token->distance += extra + 1;
+    token->distance_bits = reader->consumed - start;
+
+    if (token->distance > decoder->window ||
+      token->distance > decoder->position)
+    {
+        return DECODE_ERROR;
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Apply a token read by lz_read: update the trees, and add the bytes it
+ *  stands for to the history. Everything decoded before must have been
+ *  handed out with lz_drain first.
+ */
+    PUBLIC void
+lz_apply (lz_decoder_t *decoder, const lz_token_t *token)
+{
+    size_t mask = decoder->window - 1;
+    uint64_t from;
+
+    assert (decoder->delivered == decoder->position);
+    update_tree (&decoder->symbols, token->symbol, token->symbol_bits,
+      decoder->stats);
+
+    if (token->length == 0)
+    {
+        decoder->history [decoder->position ++ & mask] = token->symbol;
+        return;
+    }
+
+    update_tree (&decoder->distances, token->distance_code,
+      token->distance_bits, decoder->stats);
+
+    // a match may overlap the bytes it produces, so it is copied one byte
+    // at a time.
+    from = decoder->position - token->distance;
+
+    for (uint32_t i = 0; i < token->length; i ++)
+    {
+        decoder->history [decoder->position ++ & mask] =
+          decoder->history [from ++ & mask];
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Copy as many decoded bytes that have not been handed out yet as will
+ *  fit into output. Returns the number of bytes copied.
+ */
+    PUBLIC size_t
+lz_drain (lz_decoder_t *decoder, unsigned char *output, size_t capacity)
+{
+    size_t mask = decoder->window - 1;
+    size_t count = decoder->position - decoder->delivered;
+
+    if (count > capacity)
+        count = capacity;
+
+    for (size_t i = 0; i < count; i ++)
+        output [i] = decoder->history [decoder->delivered ++ & mask];
+
+    return count;
+}
+
+/**********************************************************/
+
+/**
+ *  Release a decoder.
+ */
+    PUBLIC void
+lz_decoder_free (lz_decoder_t *decoder)
+{
+    if (decoder == NULL)
+        return;
+
+    free (decoder->history);
+    free (decoder);
+}
+
+/**********************************************************/
+
+/**
+ *  Write the size of the window, which follows the stream header in LZ
+ *  mode.
+ */
+    PUBLIC void
+write_window_bits (bit_writer_t *writer, int window_bits)
+{
+    write_bits (writer, window_bits, 8);
+}
+
+/**********************************************************/
+
+/**
+ *  Read the window size written by write_window_bits. Returns the number
+ *  of bits, or -1 if the input ends first or the size is not valid.
+ */
+    PUBLIC int
+read_window_bits (bit_reader_t *reader)
+{
+    int window_bits = read_bits (reader, 8);
+
+    if (window_bits < LZ_MIN_WINDOW_BITS || window_bits > LZ_MAX_WINDOW_BITS)
+        return -1;
+
+    return window_bits;
+}
+
+/**********************************************************/
+
+/**
+ *  Add every length symbol, and every distance code the window needs, to
+ *  the trees, so that none of them is ever sent with the not seen escape.
+ */
+    PRIVATE void
+seed_trees (adaptive_tree_t *symbols, adaptive_tree_t *distances,
+  int window_bits)
+{
+    for (int code = 0; code < NUM_LENGTH_CODES; code ++)
+        adaptive_update (symbols, LENGTH_SYMBOL (code));
+
+    for (int code = 0; code < LZ_DISTANCE_CODES (window_bits); code ++)
+        adaptive_update (distances, code);
+
+    // and so none of them counts as one, nor do the rebuilds of trees
+    // with deferred updates that came with them.
+    symbols->escapes = 0;
+    distances->escapes = 0;
+    symbols->rebuilds = 0;
+    distances->rebuilds = 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Code literals and matches for the buffered input. Unless the stream is
+ *  ending, positions are only coded while there are LOOKAHEAD bytes of
+ *  input after them.
+ */
+    PRIVATE void
+code_input (lz_encoder_t *encoder, bit_writer_t *writer, bool ending)
+{
+    uint64_t end = encoder->base + encoder->length;
+    uint32_t limit, length, distance;
+    int byte, bits;
+
+    while (encoder->position < end &&
+      (ending || end - encoder->position >= LOOKAHEAD))
+    {
+        limit = LZ_MAX_MATCH;
+
+        if (end - encoder->position < limit)
+            limit = end - encoder->position;
+
+        length = find_match (encoder, limit, &distance);
+
+        if (length >= LZ_MIN_MATCH)
+        {
+            write_match (encoder, writer, length, distance);
+
+            // the positions inside the match go on the hash chains too,
+            // so that later matches can start from them.
+            for (uint32_t i = 1; i < length; i ++)
+            {
+                if (encoder->position + i + LZ_MIN_MATCH <= end)
+                    insert_position (encoder, encoder->position + i);
+            }
+
+            encoder->position += length;
+            continue;
+        }
+
+        byte = encoder->buffer [encoder->position - encoder->base];
+        bits = adaptive_write (&encoder->symbols, writer, byte);
+        update_tree (&encoder->symbols, byte, bits, encoder->stats);
+        encoder->position += 1;
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the hash of the LZ_MIN_MATCH bytes at the given position.
+ */
+    PRIVATE uint32_t
+hash_at (const lz_encoder_t *encoder, uint64_t position)
+{
+    const unsigned char *bytes = encoder->buffer + (position - encoder->base);
+    uint32_t key = (bytes [0] << 16) | (bytes [1] << 8) | bytes [2];
+
+    return (key * 0x9e3779b1u) >> (32 - LZ_HASH_BITS);
+}
+
+/**********************************************************/
+
+/**
+ *  Put a position at the head of its hash chain.
+ */
+    PRIVATE void
+insert_position (lz_encoder_t *encoder, uint64_t position)
+{
+    uint32_t hash = hash_at (encoder, position);
+
+    encoder->prev [position & (encoder->window - 1)] = encoder->head [hash];
+    encoder->head [hash] = position - encoder->base + 1;
+}
+
+/**********************************************************/
+
+/**
+ *  Move the hash chains down by a window, after the buffer has slid down
+ *  by that much. Positions before the new base are further back than any
+ *  match can reach, so they become 0, which ends their chains.
+ */
+    PRIVATE void
+rebase_chains (lz_encoder_t *encoder)
+{
+    uint32_t shift = encoder->window;
+
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i ++)
+    {
+        encoder->head [i] = (encoder->head [i] > shift) ?
+          encoder->head [i] - shift : 0;
+    }
+
+    for (size_t i = 0; i < encoder->window; i ++)
+    {
+        encoder->prev [i] = (encoder->prev [i] > shift) ?
+          encoder->prev [i] - shift : 0;
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Look for the longest match, of at most limit bytes, for the input at
+ *  the current position, and then add the position to its hash chain.
+ *  Returns the length of the match, storing its distance in *distance, or
+ *  0 if there is no match worth using.
+ */
+    PRIVATE uint32_t
+find_match (lz_encoder_t *encoder, uint32_t limit, uint32_t *distance)
+{
+    const unsigned char *here, *there;
+    uint64_t position = encoder->position, candidate;
+    uint32_t next;
+    uint32_t best = 0, length;
+    int chain = 0;
+
+    if (limit < LZ_MIN_MATCH)
+        return 0;
+
+    here = encoder->buffer + (position - encoder->base);
+    next = encoder->head [hash_at (encoder, position)];
+
+    while (next != 0 && chain ++ < encoder->max_chain)
+    {
+        candidate = encoder->base + next - 1;
+
+        // the chain runs back in order of position, so once one entry is
+        // out of the window, the rest are too. Slots of prev that far
+        // back may have been reused, so they must not be followed.
+        if (position - candidate > encoder->window)
+            break;
+
+        there = encoder->buffer + (candidate - encoder->base);
+        next = encoder->prev [candidate & (encoder->window - 1)];
+
+        // a candidate can only beat the best so far if it matches at the
+        // byte that ended that match.
+        if (there [best] != here [best])
+            continue;
+
+        for (length = 0; length < limit; length ++)
+        {
+            if (there [length] != here [length])
+                break;
+        }
+
+        if (length > best)
+        {
+            best = length;
+            *distance = position - candidate;
+
+            if (best == limit)
+                break;
+        }
+    }
+
+    insert_position (encoder, position);
+
+    if (best < LZ_MIN_MATCH || (best == LZ_MIN_MATCH &&
+      *distance > LZ_TOO_FAR))
+    {
+        return 0;
+    }
+
+    return best;
+}
+
+/**********************************************************/
+
+/**
+ *  Write a match: its length symbol and extra bits, then its distance
+ *  code and extra bits. The trees are updated as they are used.
+ */
+    PRIVATE void
+write_match (lz_encoder_t *encoder, bit_writer_t *writer, uint32_t length,
+  uint32_t distance)
+{
+    const codeword_t *codeword;
+    int code, extra_bits, bits;
+
+    code = value_code (length - LZ_MIN_MATCH, &extra_bits);
+    bits = adaptive_write (&encoder->symbols, writer, LENGTH_SYMBOL (code));
+    update_tree (&encoder->symbols, LENGTH_SYMBOL (code), bits + extra_bits,
+      encoder->stats);
+    write_bits (writer, (length - LZ_MIN_MATCH) & ((1u << extra_bits) - 1),
+      extra_bits);
+
+    code = value_code (distance - 1, &extra_bits);
+    codeword = adaptive_lookup (&encoder->distances, code);
+    write_bits (writer, codeword->bits, codeword->length);
+    update_tree (&encoder->distances, code, codeword->length + extra_bits,
+      encoder->stats);
+    write_bits (writer, (distance - 1) & ((1u << extra_bits) - 1),
+      extra_bits);
+}
+
+/**********************************************************/
+
+/**
+ *  Update a tree with a symbol that has just been coded with the given
+ *  number of bits, recording the codeword in stats, and timing the update
+ *  if it is one of those to be timed, unless stats is NULL.
+ */
+    PRIVATE void
+update_tree (adaptive_tree_t *tree, int symbol, int bits, stats_t *stats)
+{
+    uint64_t time = 0;
+
+    if (stats != NULL)
+        time = stats_symbol (stats, bits);
+
+    adaptive_update (tree, symbol);
+
+    if (stats != NULL)
+        stats_model (stats, time);
+}
+
+/**********************************************************/
+
+/**
+ *  Read the extra bits that follow a length or distance code, of which
+ *  there may be none. Returns their value, or -1 if the input ends first.
+ */
+    PRIVATE int
+read_extra (bit_reader_t *reader, int extra_bits)
+{
+    if (extra_bits == 0)
+        return 0;
+
+    return read_bits (reader, extra_bits);
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the code for a match length or distance, storing the number of
+ *  extra bits that go with it in *extra_bits.
+ */
+    PRIVATE int
+value_code (uint32_t value, int *extra_bits)
+{
+    int top = 0;
+
+    if (value < 4)
+    {
+        *extra_bits = 0;
+        return value;
+    }
+
+    while ((value >> (top + 1)) != 0)
+        top += 1;
+
+    *extra_bits = top - 1;
+    return 2 * top + ((value >> (top - 1)) & 1);
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the smallest value with the given code, storing the number of
+ *  extra bits that go with it in *extra_bits.
+ */
+    PRIVATE uint32_t
+code_base (int code, int *extra_bits)
+{
+    int top = code / 2;
+
+    if (code < 4)
+    {
+        *extra_bits = 0;
+        return code;
+    }
+
+    *extra_bits = top - 1;
+    return (uint32_t) (2 | (code & 1)) << (top - 1);
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
@@ -0,0 +1,153 @@
+/**
+ *  LZ77 front end for the adaptive coder. The input is parsed into
+ *  literal bytes and matches, each of which repeats length bytes from
+ *  distance bytes back, found with hash chains over a sliding window.
+ *
+ *  Literals, match lengths and the end of the stream share one adaptive
+ *  tree: lengths are sent as one of NUM_LENGTH_CODES length symbols, which
+ *  follow the byte values in the alphabet, and some extra bits. The
+ *  distance of a match follows, as a symbol from a second adaptive tree
+ *  and some more extra bits. Symbols other than bytes are added to the
+ *  trees up front, so the not seen escape is only ever used for bytes.
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "utils.h"
+#include "huffman.h"
+#include "adaptive.h"
+#include "bitio.h"
+#include "stats.h"
+
+// shortest and longest matches. A match length less LZ_MIN_MATCH fits in
+// a byte, and is coded with the NUM_LENGTH_CODES length symbols.
+#define LZ_MIN_MATCH        3
+#define LZ_MAX_MATCH        258
+
+// the window is 2^bits bytes; matches are at most that far back.
+#define LZ_MIN_WINDOW_BITS  10
+#define LZ_MAX_WINDOW_BITS  24
+#define LZ_DEFAULT_WINDOW_BITS 16
+
+// number of distance symbols a window of the given size needs.
+#define LZ_DISTANCE_CODES(bits) (2 * (bits))
+
+// number of bits of the hash of the next LZ_MIN_MATCH bytes that picks a
+// hash chain.
+#define LZ_HASH_BITS        15
+
+// most positions tried on a hash chain when looking for a match, with a
+// window of up to 2^LZ_DEFAULT_WINDOW_BITS bytes. This bounds the time
+// spent per byte on data with many candidates. A bigger window would
+// mostly be filled with candidates that are never reached, so the limit
+// doubles for every LZ_CHAIN_STEP_BITS more bits of window.
+#define LZ_MAX_CHAIN        32
+#define LZ_CHAIN_STEP_BITS  4
+
+// a match of the shortest length further back than this costs more to
+// send than its literals would, so it is not used.
+#define LZ_TOO_FAR          4096
+
+// the symbol for the length code with the given index.
+#define LENGTH_SYMBOL(code) (NUM_SYMBOLS + (code))
+
+
+typedef struct
+{
+    int window_bits;
+    size_t window;
+
+    // most positions tried on a hash chain, for this window size.
+    int max_chain;
+
+    // input that has been given but not coded yet, after as much of what
+    // has already been coded as matches may refer to. base is the
+    // position in the stream of the first byte in the buffer.
+    unsigned char *buffer;
+    size_t capacity;
+    size_t length;
+    uint64_t base;
+    uint64_t position;
+
+    // hash chains. head gives the last position, plus one, whose next
+    // LZ_MIN_MATCH bytes have each hash, or 0 if none; prev gives the
+    // position before that with the same hash, indexed by position
+    // modulo the window size. Positions are relative to base, so they fit
+    // in 32 bits, and are moved down whenever the buffer slides.
+    uint32_t *head;
+    uint32_t *prev;
+
+    adaptive_tree_t symbols;
+    adaptive_tree_t distances;
+
+    // statistics are added to stats, unless it is NULL, which it is until
+    // the caller sets it.
+    stats_t *stats;
+}
+lz_encoder_t;
+
+typedef struct
+{
+    int window_bits;
+    size_t window;
+
+    // the last window bytes decoded, indexed by position modulo the window
+    // size. Bytes from delivered up to position have not been handed out
+    // yet.
+    unsigned char *history;
+    uint64_t position;
+    uint64_t delivered;
+
+    adaptive_tree_t symbols;
+    adaptive_tree_t distances;
+
+    // statistics are added to stats by lz_apply, unless it is NULL, which
+    // it is until the caller sets it.
+    stats_t *stats;
+}
+lz_decoder_t;
+
+// a literal or match read by lz_read, before it has been applied to the
+// decoder. For a literal, length is 0. The number of bits read for the
+// symbol, and for the distance of a match, are kept for statistics; they
+// include any extra bits that follow each code. At the end of the stream,
+// the symbol is END_OF_STREAM, and its bits are counted too.
+typedef struct
+{
+    int symbol;
+    int distance_code;
+    uint32_t length;
+    uint32_t distance;
+    int symbol_bits;
+    int distance_bits;
+}
+lz_token_t;
+
+
+lz_encoder_t * lz_encoder_new (int window_bits, int age_bits,
+  int drift_bits);
+void lz_encode (lz_encoder_t *encoder, bit_writer_t *writer,
+  const unsigned char *data, size_t length);
+void lz_encode_end (lz_encoder_t *encoder, bit_writer_t *writer);
+void lz_encoder_free (lz_encoder_t *encoder);
+
+lz_decoder_t * lz_decoder_new (int window_bits, int age_bits,
+  int drift_bits);
+int lz_read (lz_decoder_t *decoder, bit_reader_t *reader,
+  lz_token_t *token);
+void lz_apply (lz_decoder_t *decoder, const lz_token_t *token);
+size_t lz_drain (lz_decoder_t *decoder, unsigned char *output,
+  size_t capacity);
+void lz_decoder_free (lz_decoder_t *decoder);
+
+void write_window_bits (bit_writer_t *writer, int window_bits);
+int read_window_bits (bit_reader_t *reader);
+
+
+#endif // LZ_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
@@ -10,17 +10,49 @@
 /**********************************************************/
 
 /**
- *  Creates a new Huffman tree node with the specified weight and two child
- *  nodes. This function should be used to create tree nodes; the leaf nodes
- *  should already be allocated.
+ *  Release every node in the arena, so that a new tree can be built in
+ *  it.
+ */
+    PUBLIC void
+arena_reset (node_arena_t *arena)
+{
+    arena->used = 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Creates a new leaf node for the given symbol, with the specified
+ *  weight. Returns the index of the new node.
  */
-    PUBLIC node_t *
-new_node (int weight, node_t *left, node_t *right)
+    PUBLIC int
+new_leaf (node_arena_t *arena, int weight, int ch)
 {
-    node_t *created = checked_malloc (sizeof (node_t));
+    node_t *created;
+
+    assert (arena->used < ARENA_SIZE);
+    created = arena->nodes + arena->used;
     created->frequency = weight;
-    created->left = left;
-    created->right = right;
+    created->ch = ch;
+    created->left = NO_NODE;
+    created->right = NO_NODE;
+
+    return arena->used ++;
+}
+
+/**********************************************************/
+
+/**
+ *  Creates a new Huffman tree node with the specified weight and two child
+ *  nodes. Returns the index of the new node.
+ */
+    PUBLIC int
+new_node (node_arena_t *arena, int weight, int left, int right)
+{
+    int created = new_leaf (arena, weight, 0);
+
+    arena->nodes [created].left = left;
+    arena->nodes [created].right = right;
 
     return created;
 }
@@ -32,9 +64,21 @@ new_node (int weight, node_t *left, node_t *right)
  *  the number of times the corresponding byte has occurred.
  */
     PUBLIC int
-size (node_t *node)
+size (const node_arena_t *arena, int node)
+{
+    return arena->nodes [node].frequency;
+}
+
+/**********************************************************/
+
+/**
+ *  Test if the specified node is a leaf, ie. it has no children.
+ */
+    PUBLIC bool
+is_leaf (const node_arena_t *arena, int node)
 {
-    return node->frequency;
+    return arena->nodes [node].left == NO_NODE &&
+      arena->nodes [node].right == NO_NODE;
 }
 
 /**********************************************************/
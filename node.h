@@ -5,25 +5,55 @@
 #ifndef NODE_H
 #define NODE_H
 
+#include <stdint.h>
+
+#include "utils.h"
+
 // value used in the Huffman tree for a character that has not been used.
 #define NOT_SEEN        (-1)
 
 // special value used to indicate the end of the compressed stream.
 #define END_OF_STREAM   (-2)
 
+// returned in place of a symbol by the decoders if the input ends in the
+// middle of a codeword, or the codeword is not valid.
+#define DECODE_ERROR    (-3)
+
+// value of a child link that does not lead anywhere.
+#define NO_NODE         (-1)
+
+// a tree has at most one leaf for each of the 256 byte values, plus not
+// seen and end of stream, and one fewer internal nodes than leaves.
+#define MAX_LEAVES      258
+#define ARENA_SIZE      (2 * MAX_LEAVES - 1)
 
+
+// nodes refer to their children by index within the arena that holds
+// them, rather than by pointer.
 typedef struct node
 {
     int frequency;
-    int ch;
-    struct node *left;
-    struct node *right;
+    int16_t ch;
+    int16_t left;
+    int16_t right;
 }
 node_t;
 
+// fixed size storage for all of the nodes of one tree. Nodes are handed
+// out in order, and are all released at once by resetting the arena.
+typedef struct
+{
+    node_t nodes [ARENA_SIZE];
+    int used;
+}
+node_arena_t;
+
 
-node_t *new_node (int weight, node_t *left, node_t *right);
-int size (node_t *node);
+void arena_reset (node_arena_t *arena);
+int new_leaf (node_arena_t *arena, int weight, int ch);
+int new_node (node_arena_t *arena, int weight, int left, int right);
+int size (const node_arena_t *arena, int node);
+bool is_leaf (const node_arena_t *arena, int node);
 
 
 #endif // NODE_H
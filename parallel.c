@@ -0,0 +1,510 @@
+/**
+ *  Block parallel compression and decompression, using a pool of POSIX
+ *  threads.
+ *
+ *  The main thread does all of the I/O. It reads blocks into a ring of
+ *  jobs and hands them to the workers, then collects the finished jobs in
+ *  the order they were submitted and writes out the results. At most
+ *  in_flight blocks are held in memory at once; when the ring is full,
+ *  the main thread waits for the oldest job to finish before reading any
+ *  more input.
+ *
+ *  Checksums of blocks are worked out by the workers, along with the rest
+ *  of the work on the block. The main thread combines them, in order, into
+ *  the checksum of the whole stream.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "fileio.h"
+#include "bitio.h"
+#include "block.h"
+#include "checksum.h"
+#include "stats.h"
+#include "parallel.h"
+
+/**********************************************************/
+
+typedef struct
+{
+    // the data to work on, and the result. Both buffers are kept between
+    // jobs, and only grow.
+    unsigned char *input;
+    size_t input_length;
+    size_t input_capacity;
+    unsigned char *output;
+    size_t output_length;
+    size_t output_capacity;
+
+    // uncompressed length of a block being decoded, and the checksum of
+    // the block, from its header when decoding.
+    uint32_t length;
+    uint32_t checksum;
+
+    // longest codeword allowed in a block being encoded.
+    int max_length;
+
+    // whether the block's checksum is to be written when encoding, or
+    // checked when decoding.
+    bool use_checksum;
+
+    // statistics for the block, worked out only if they are wanted, and
+    // added to the run's by the main thread when it collects the job.
+    bool want_stats;
+    block_stats_t stats;
+
+    int status;
+    bool done;
+}
+job_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    pthread_t *threads;
+    int num_threads;
+
+    // ring of jobs. Jobs are submitted, started and collected in order, so
+    // a count of each is enough to know which job is which.
+    job_t *jobs;
+    int num_jobs;
+    unsigned long submitted;
+    unsigned long started;
+    unsigned long collected;
+    bool shutdown;
+
+    void (*process) (job_t *job);
+}
+pool_t;
+
+/**********************************************************/
+
+PRIVATE void pool_start (pool_t *pool, int num_threads, int in_flight,
+  void (*process) (job_t *job));
+PRIVATE job_t * pool_next (pool_t *pool);
+PRIVATE void pool_submit (pool_t *pool);
+PRIVATE job_t * pool_collect (pool_t *pool);
+PRIVATE void pool_finish (pool_t *pool);
+PRIVATE void * worker (void *argument);
+PRIVATE void compress_job (job_t *job);
+PRIVATE void decompress_job (job_t *job);
+PRIVATE void reserve (unsigned char **buffer, size_t *capacity,
+  size_t length);
+
+/**********************************************************/
+
+/**
+ *  Compress everything from input as a sequence of blocks, using the given
+ *  number of threads, and append the blocks and the end of stream marker
+ *  to the writer. If checksum is true, each block holds its checksum, and
+ *  the checksum of the whole input follows the marker, at the next byte
+ *  boundary. Statistics for each block are added to stats, unless it is
+ *  NULL. Returns 0.
+ */
+    PUBLIC int
+parallel_squash (bit_writer_t *writer, input_file_t *input,
+  size_t block_size, int max_length, bool checksum, int num_threads,
+  int in_flight, stats_t *stats)
+{
+    pool_t pool;
+    job_t *job;
+    const unsigned char *data;
+    bool end_of_input = false;
+    uint32_t crc = 0;
+
+    pool_start (&pool, num_threads, in_flight, compress_job);
+
+    while (true)
+    {
+        // read and submit blocks for as long as there is room for them.
+        while (!end_of_input && (job = pool_next (&pool)) != NULL)
+        {
+            // the input may be mapped, and so could be handed straight to
+            // the worker, but a job owns its buffer and copying a block is
+            // cheap next to compressing it.
+            job->input_length = input_read (input, &data, block_size);
+            job->max_length = max_length;
+            job->use_checksum = checksum;
+            job->want_stats = stats != NULL;
+
+            if (job->input_length == 0)
+            {
+                end_of_input = true;
+                break;
+            }
+
+            reserve (&job->input, &job->input_capacity, job->input_length);
+            memcpy (job->input, data, job->input_length);
+            pool_submit (&pool);
+        }
+
+        if ((job = pool_collect (&pool)) == NULL)
+            break;
+
+        write_bytes (writer, job->output, job->output_length);
+
+        if (checksum)
+            crc = crc32c_combine (crc, job->checksum, job->input_length);
+
+        if (stats != NULL)
+            stats_block (stats, &job->stats);
+    }
+
+    end_blocks (writer, checksum);
+    pool_finish (&pool);
+
+    if (checksum)
+    {
+        writer_align (writer);
+        write_bits (writer, crc, 32);
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Decompress a block mode stream, whose header has already been read,
+ *  using the given number of threads, and write the output to the given
+ *  file. If checksum is true, the stream has checksums, and the block
+ *  headers are read accordingly; the checksums are only checked if verify
+ *  is true as well. The checksum of the whole stream is left for the
+ *  caller to read, but its value is stored in *crc. Returns 0, -1 if the
+ *  stream is corrupt, or CHECKSUM_MISMATCH; everything before the corrupt
+ *  block is still written. Statistics for each block written are added to
+ *  stats, unless it is NULL.
+ */
+    PUBLIC int
+parallel_puff (bit_reader_t *reader, output_file_t *output,
+  bool checksum, bool verify, uint32_t *crc, int num_threads,
+  int in_flight, stats_t *stats)
+{
+    pool_t pool;
+    job_t *job;
+    block_header_t header;
+    bool end_of_input = false, truncated = false;
+    int status = 0;
+
+    *crc = 0;
+
+    pool_start (&pool, num_threads, in_flight, decompress_job);
+
+    while (true)
+    {
+        while (!end_of_input && (job = pool_next (&pool)) != NULL)
+        {
+            if (read_block_header (reader, &header, checksum) == -1)
+            {
+                truncated = true;
+                end_of_input = true;
+                break;
+            }
+
+            if (header.length == 0)
+            {
+                end_of_input = true;
+                break;
+            }
+
+            reserve (&job->input, &job->input_capacity,
+              header.compressed_length);
+
+            if (read_bytes (reader, job->input,
+              header.compressed_length) == -1)
+            {
+                truncated = true;
+                end_of_input = true;
+                break;
+            }
+
+            job->input_length = header.compressed_length;
+            job->length = header.length;
+            job->checksum = header.checksum;
+            job->use_checksum = checksum && verify;
+            job->want_stats = stats != NULL;
+            pool_submit (&pool);
+        }
+
+        // once a block has failed, the blocks after it are still waited
+        // for, but not written.
+        if ((job = pool_collect (&pool)) == NULL)
+            break;
+
+        if (job->status != 0 && status == 0)
+        {
+            status = job->status;
+            end_of_input = true;
+        }
+
+        if (status == 0)
+        {
+            output_write (output, job->output, job->length);
+
+            // a block that has been checked matches its checksum.
+            if (checksum && verify)
+                *crc = crc32c_combine (*crc, job->checksum, job->length);
+
+            if (stats != NULL)
+                stats_block (stats, &job->stats);
+        }
+    }
+
+    pool_finish (&pool);
+
+    // a header or block that could not be read only counts once all of
+    // the blocks before it have been written.
+    if (truncated)
+        status = -1;
+
+    return status;
+}
+
+/**********************************************************/
+
+/**
+ *  Set up a pool of worker threads, and a ring of in_flight jobs for them
+ *  to work on. Each job is passed to the process function.
+ */
+    PRIVATE void
+pool_start (pool_t *pool, int num_threads, int in_flight,
+  void (*process) (job_t *job))
+{
+    pthread_mutex_init (&pool->lock, NULL);
+    pthread_cond_init (&pool->work_ready, NULL);
+    pthread_cond_init (&pool->work_done, NULL);
+
+    pool->num_jobs = in_flight;
+    pool->jobs = checked_malloc (in_flight * sizeof (job_t));
+    pool->submitted = 0;
+    pool->started = 0;
+    pool->collected = 0;
+    pool->shutdown = false;
+    pool->process = process;
+
+    for (int i = 0; i < in_flight; i ++)
+    {
+        pool->jobs [i].input = NULL;
+        pool->jobs [i].input_capacity = 0;
+        pool->jobs [i].output = NULL;
+        pool->jobs [i].output_capacity = 0;
+    }
+
+    pool->num_threads = num_threads;
+    pool->threads = checked_malloc (num_threads * sizeof (pthread_t));
+
+    for (int i = 0; i < num_threads; i ++)
+    {
+        if (pthread_create (pool->threads + i, NULL, worker, pool) != 0)
+        {
+            fprintf (stderr, "Unable to start worker thread.\n");
+            exit (EXIT_FAILURE);
+        }
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the job that will be submitted next, or NULL if the ring is
+ *  full of jobs that have not been collected yet. Only the main thread
+ *  changes the submitted and collected counts, so it does not need the
+ *  lock to read them.
+ */
+    PRIVATE job_t *
+pool_next (pool_t *pool)
+{
+    if (pool->submitted - pool->collected == (unsigned long) pool->num_jobs)
+        return NULL;
+
+    return pool->jobs + pool->submitted % pool->num_jobs;
+}
+
+/**********************************************************/
+
+/**
+ *  Hand the job returned by pool_next over to the workers.
+ */
+    PRIVATE void
+pool_submit (pool_t *pool)
+{
+    pthread_mutex_lock (&pool->lock);
+    pool->jobs [pool->submitted % pool->num_jobs].done = false;
+    pool->submitted += 1;
+    pthread_cond_signal (&pool->work_ready);
+    pthread_mutex_unlock (&pool->lock);
+}
+
+/**********************************************************/
+
+/**
+ *  Wait for the oldest submitted job to be finished by one of the workers,
+ *  and return it. Returns NULL if there are no jobs left to collect. The
+ *  job stays valid until the next call to pool_next.
+ */
+    PRIVATE job_t *
+pool_collect (pool_t *pool)
+{
+    job_t *job;
+
+    if (pool->collected == pool->submitted)
+        return NULL;
+
+    job = pool->jobs + pool->collected % pool->num_jobs;
+    pthread_mutex_lock (&pool->lock);
+
+    while (!job->done)
+        pthread_cond_wait (&pool->work_done, &pool->lock);
+
+    pthread_mutex_unlock (&pool->lock);
+    pool->collected += 1;
+
+    return job;
+}
+
+/**********************************************************/
+
+/**
+ *  Tell the workers to exit once they run out of work, wait for them, and
+ *  release everything the pool was using.
+ */
+    PRIVATE void
+pool_finish (pool_t *pool)
+{
+    pthread_mutex_lock (&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast (&pool->work_ready);
+    pthread_mutex_unlock (&pool->lock);
+
+    for (int i = 0; i < pool->num_threads; i ++)
+        pthread_join (pool->threads [i], NULL);
+
+    for (int i = 0; i < pool->num_jobs; i ++)
+    {
+        free (pool->jobs [i].input);
+        free (pool->jobs [i].output);
+    }
+
+    free (pool->jobs);
+    free (pool->threads);
+    pthread_cond_destroy (&pool->work_done);
+    pthread_cond_destroy (&pool->work_ready);
+    pthread_mutex_destroy (&pool->lock);
+}
+
+/**********************************************************/
+
+/**
+ *  Main loop of a worker thread: take the oldest job that nobody has
+ *  started on, process it, and mark it as done.
+ */
+    PRIVATE void *
+worker (void *argument)
+{
+    pool_t *pool = argument;
+    job_t *job;
+
+    pthread_mutex_lock (&pool->lock);
+
+    while (true)
+    {
+        while (pool->started == pool->submitted && !pool->shutdown)
+            pthread_cond_wait (&pool->work_ready, &pool->lock);
+
+        if (pool->started == pool->submitted)
+            break;
+
+        job = pool->jobs + pool->started % pool->num_jobs;
+        pool->started += 1;
+
+        pthread_mutex_unlock (&pool->lock);
+        pool->process (job);
+        pthread_mutex_lock (&pool->lock);
+
+        job->done = true;
+        pthread_cond_broadcast (&pool->work_done);
+    }
+
+    pthread_mutex_unlock (&pool->lock);
+    return NULL;
+}
+
+/**********************************************************/
+
+/**
+ *  Compress the job's input as a single block.
+ */
+    PRIVATE void
+compress_job (job_t *job)
+{
+    bit_writer_t writer;
+
+    writer_init (&writer, NULL, false);
+    job->checksum = encode_block (&writer, job->input, job->input_length,
+      job->max_length, job->use_checksum,
+      job->want_stats ? &job->stats : NULL);
+
+    // take over the writer's buffer as the job's output.
+    free (job->output);
+    job->output = writer.buffer;
+    job->output_length = writer.length;
+    job->output_capacity = writer.capacity;
+    job->status = 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Decode the job's input, which is the body of a single block, and check
+ *  that the block used up exactly its stated compressed length, and if
+ *  need be, that it matches its checksum.
+ */
+    PRIVATE void
+decompress_job (job_t *job)
+{
+    bit_reader_t reader;
+
+    reserve (&job->output, &job->output_capacity, job->length);
+    reader_init_memory (&reader, job->input, job->input_length);
+
+    job->status = decode_block (&reader, job->output, job->length,
+      job->want_stats ? &job->stats : NULL);
+
+    if (reader.consumed != 8 * (uint64_t) job->input_length)
+        job->status = -1;
+
+    if (job->status == 0 && job->use_checksum &&
+      crc32c (job->output, job->length) != job->checksum)
+    {
+        job->status = CHECKSUM_MISMATCH;
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Make sure a buffer can hold at least length bytes. The old contents are
+ *  not kept.
+ */
+    PRIVATE void
+reserve (unsigned char **buffer, size_t *capacity, size_t length)
+{
+    if (length <= *capacity)
+        return;
+
+    free (*buffer);
+    *buffer = checked_malloc (length);
+    *capacity = length;
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
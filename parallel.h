@@ -0,0 +1,31 @@
+/**
+ *  Block parallel compression and decompression. Blocks are handed out to
+ *  a pool of worker threads, and the results are written out in their
+ *  original order as they complete.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "fileio.h"
+#include "bitio.h"
+#include "block.h"
+#include "stats.h"
+
+// limits on the number of worker threads, and on the number of blocks that
+// can be in progress at once.
+#define MAX_THREADS         256
+#define MAX_IN_FLIGHT       1024
+
+
+int parallel_squash (bit_writer_t *writer, input_file_t *input,
+  size_t block_size, int max_length, bool checksum, int num_threads,
+  int in_flight, stats_t *stats);
+int parallel_puff (bit_reader_t *reader, output_file_t *output,
+  bool checksum, bool verify, uint32_t *crc, int num_threads,
+  int in_flight, stats_t *stats);
+
+
+#endif // PARALLEL_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
@@ -1,145 +1,944 @@
 /**
- *  Program to decompress a stream of bytes compressed with huffman-encode.
+ *  Program to decompress a stream of bytes compressed with squash. The
+ *  compressed stream is read from the file named on the command line, or
+ *  from stdin, and must be in the packed binary format unless the --text
+ *  option is given. The mode the stream was compressed in is read from its
+ *  header.
+ *
+ *  Block mode streams can be decoded by several threads at once with the
+ *  -T N option; --in-flight=N limits the number of blocks held in memory
+ *  while that happens. Adaptive, context and LZ mode streams are always
+ *  decoded in order on a single thread.
+ *
+ *  With --range=OFFSET:LEN, only LEN bytes starting at OFFSET are written.
+ *  The stream must have been written with squash --seekable, and be in a
+ *  regular file, so that its index can be read first; only the segments
+ *  that hold the range are then decoded, on a single thread, and their
+ *  checksums are always checked.
+ *
+ *  The checksums squash stores are checked as the stream is decoded, and
+ *  if the data does not match them, puff stops with an exit status of 2,
+ *  rather than the 1 it gives for other errors; everything up to the
+ *  block or segment that failed has been written by then. The --verify
+ *  option checks the stream without writing anything, and --no-checksum
+ *  skips the checks.
+ *
+ *  The --stats and --stats=json options print a summary of the run on
+ *  stderr, as squash does. The codeword lengths are those read from the
+ *  stream, so they match what squash reported for it.
+ *
+ *  The stream is decoded as it arrives. At each sync point written by
+ *  squash --flush-every, and after each block of such a stream in block
+ *  mode, everything decoded so far is written out straight away. Such a
+ *  stream is always decoded on a single thread.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "utils.h"
 #include "huffman.h"
 #include "node.h"
 #include "alphabet.h"
+#include "adaptive.h"
+#include "fileio.h"
+#include "bitio.h"
+#include "format.h"
+#include "block.h"
+#include "parallel.h"
+#include "context.h"
+#include "lz.h"
+#include "seekable.h"
+#include "checksum.h"
+#include "streamzip.h"
+#include "stats.h"
+
+/**********************************************************/
+
+typedef struct
+{
+    bool text;
+
+    // number of worker threads for block mode, or 0 to decode on the main
+    // thread, and the number of blocks that may be in progress at once.
+    long long threads;
+    long long in_flight;
+
+    // whether to throw the output away, having checked the stream, and
+    // whether to check the checksums at all.
+    bool verify;
+    bool checksum;
+
+    // whether to print statistics at the end, and whether as JSON.
+    bool stats;
+    bool stats_json;
+
+    // part of the output wanted with --range, if it was given.
+    bool range;
+    long long range_offset;
+    long long range_length;
+
+    // file to decompress, or NULL for stdin.
+    const char *input;
+}
+options_t;
+
+// the parameters a stream was compressed with, which follow its header,
+// whether it has checksums, and whether it may have sync points. The
+// drift limit is NO_DRIFT_BITS unless the trees defer their updates.
+typedef struct
+{
+    int order;
+    int window_bits;
+    int age_bits;
+    int drift_bits;
+    bool checksum;
+    bool flush;
+}
+params_t;
+
+// most output decoded by each call for a range. Each call decodes its
+// first segment from the start, so this should be large next to a segment.
+#define RANGE_PIECE         (1 << 24)
+
+// size of the buffer that adaptive, context and LZ modes decode into, so
+// that the checksum can be worked out a piece at a time.
+#define DECODE_PIECE        4096
+
+// exit status when the data does not match its checksum.
+#define EXIT_CHECKSUM       2
 
 /**********************************************************/
 
-PRIVATE int decode_next_codeword (const node_t *tree);
-PRIVATE int traverse_tree (const node_t *tree);
-PRIVATE int read_next_byte (void);
-PRIVATE int next_codeword_bit (void);
+PRIVATE void parse_arguments (int argc, char **argv, options_t *options);
+PRIVATE int parse_range (const char *text, options_t *options);
+PRIVATE int read_params (bit_reader_t *reader, int mode, int flags,
+  params_t *params);
+PRIVATE int puff_range (input_file_t *input, output_file_t *output,
+  uint64_t offset, uint64_t length, int *mode);
+PRIVATE int puff_seekable (bit_reader_t *reader, output_file_t *output,
+  int mode, const params_t *params, const options_t *options,
+  stats_t *stats);
+PRIVATE int puff_segment (bit_reader_t *reader, output_file_t *output,
+  int mode, const params_t *params, const options_t *options,
+  stats_t *stats);
+PRIVATE int puff_adaptive (bit_reader_t *reader, output_file_t *output,
+  int age_bits, int drift_bits, bool flush, uint32_t *crc, stats_t *stats);
+PRIVATE int puff_blocks (bit_reader_t *reader, output_file_t *output,
+  bool checksum, bool flush, uint32_t *crc, stats_t *stats);
+PRIVATE int puff_context (bit_reader_t *reader, output_file_t *output,
+  int order, int age_bits, int drift_bits, bool flush, uint32_t *crc,
+  stats_t *stats);
+PRIVATE int puff_lz (bit_reader_t *reader, output_file_t *output,
+  int window_bits, int age_bits, int drift_bits, bool flush, uint32_t *crc,
+  stats_t *stats);
+PRIVATE void write_output (output_file_t *output, const unsigned char *data,
+  size_t length, uint32_t *crc);
+PRIVATE void sync_output (output_file_t *output, const unsigned char *data,
+  size_t *length, uint32_t *crc);
 
 /**********************************************************/
 
     int
 main (int argc, char **argv)
 {
-    int nextchar;
-    node_t *huffman_tree;
+    options_t options;
+    input_file_t input;
+    output_file_t output;
+    bit_reader_t reader;
+    params_t params;
+    stats_t stats, *gather = NULL;
+    int mode, flags, status;
+
+    parse_arguments (argc, argv, &options);
+
+    // the statistics are always set up, which costs next to nothing, but
+    // only gathered if they are wanted.
+    stats_init (&stats, true);
 
-    huffman_init ();
-    initialise_histogram ();
-    huffman_tree = build_huffman_tree ();
+    if (options.stats)
+        gather = &stats;
 
-    while ((nextchar = decode_next_codeword (huffman_tree)) != -1)
+    if (options.input == NULL)
     {
-        putchar (nextchar);
-        update_symbol (nextchar);
-        huffman_tree = build_huffman_tree ();
+        input_init (&input, STDIN_FILENO);
+    }
+    else if (input_open (&input, options.input) == -1)
+    {
+        fprintf (stderr, "%s: cannot open %s: %s\n", argv [0],
+          options.input, strerror (errno));
+        return EXIT_FAILURE;
     }
 
-    return 0;
+    reader_init (&reader, &input, options.text);
+    output_init (&output, options.verify ? -1 : STDOUT_FILENO);
+
+    if (options.range)
+    {
+        status = puff_range (&input, &output, options.range_offset,
+          options.range_length, &stats.mode);
+    }
+    else if ((mode = read_header (&reader, &flags)) == -1)
+    {
+        fprintf (stderr, "%s: input is not a compressed stream.\n",
+          argv [0]);
+        status = EXIT_FAILURE;
+    }
+    else if (read_params (&reader, mode, flags, &params) == -1)
+    {
+        fprintf (stderr, "Error reading stream parameters.\n");
+        status = EXIT_FAILURE;
+    }
+    else if (flags & FLAG_SEEKABLE)
+    {
+        stats.mode = mode;
+        status = puff_seekable (&reader, &output, mode, &params, &options,
+          gather);
+    }
+    else
+    {
+        stats.mode = mode;
+        status = puff_segment (&reader, &output, mode, &params, &options,
+          gather);
+    }
+
+    reader_free (&reader);
+
+    if (input_close (&input) == -1)
+    {
+        fprintf (stderr, "%s: error reading input\n", argv [0]);
+        status = EXIT_FAILURE;
+    }
+
+    if (output_close (&output) == -1)
+    {
+        fprintf (stderr, "%s: error writing output\n", argv [0]);
+        status = EXIT_FAILURE;
+    }
+
+    if (options.stats)
+    {
+        stats_finish (&stats, input.total, output.total,
+          input.busy + output.busy);
+        stats_print (&stats, "puff", options.stats_json);
+    }
+
+    return status;
 }
 
 /**********************************************************/
 
 /**
- *  Reads the next codeword from stdin and returns the byte that was 
- *  encoded.
- *
- *  This function will check for an end of stream sequence, and if
- *  encountered will return -1.
+ *  Read the parameters that follow the header of a stream of the given
+ *  mode and flags. Returns 0, or -1 if they are not valid or the input
+ *  ends.
  */
     PRIVATE int
-decode_next_codeword (const node_t *tree)
+read_params (bit_reader_t *reader, int mode, int flags, params_t *params)
 {
-    int byte = traverse_tree (tree);
+    params->checksum = (flags & FLAG_CHECKSUM) != 0;
+    params->flush = (flags & FLAG_FLUSH) != 0;
 
-    if (byte == NOT_SEEN)
-        byte = read_next_byte ();
+    if (mode == MODE_CONTEXT &&
+      (params->order = read_context_order (reader)) == -1)
+    {
+        return -1;
+    }
 
-    if (byte == END_OF_STREAM)
+    if (mode == MODE_LZ &&
+      (params->window_bits = read_window_bits (reader)) == -1)
+    {
         return -1;
+    }
+
+    if (mode != MODE_BLOCK &&
+      (params->age_bits = read_age_bits (reader)) == -1)
+    {
+        return -1;
+    }
+
+    params->drift_bits = NO_DRIFT_BITS;
+
+    if ((flags & FLAG_DEFERRED) && (mode == MODE_BLOCK ||
+      (params->drift_bits = read_drift_bits (reader)) == -1))
+    {
+        return -1;
+    }
 
-    return byte;
+    return 0;
 }
 
 /**********************************************************/
 
 /**
- *  Decodes a Huffman codeword by traversing the Huffman tree.
- *
- *  Return value is the decoded value. This function may also return
- *  special values for NOT_SEEN, indicating that the next 8 bits of the
- *  compressed stream are a literal byte value, or END_OF_STREAM,
- *  indicating that there are no more codewords.
+ *  Decompress length bytes of a seekable stream, starting at the given
+ *  offset, and write them to output. The stream has to be mapped, so that
+ *  its index can be read from the end. The mode of the stream is stored in
+ *  *mode, or -1 if the stream has no valid header. Returns 0, or
+ *  EXIT_FAILURE if the stream is not seekable or is corrupt. A range that
+ *  runs past the end of the stream is cut short.
+ */
+    PRIVATE int
+puff_range (input_file_t *input, output_file_t *output, uint64_t offset,
+  uint64_t length, int *mode)
+{
+    const unsigned char *stream;
+    unsigned char *buffer;
+    bit_reader_t header;
+    size_t stream_length, piece, produced;
+    int flags, result = SZ_OK;
+
+    if ((stream = input_mapping (input, &stream_length)) == NULL)
+    {
+        fprintf (stderr, "A range can only be read from a regular file.\n");
+        return EXIT_FAILURE;
+    }
+
+    // the header is only read for the statistics; sz_decode_range finds
+    // out for itself whether the stream makes sense.
+    reader_init_memory (&header, stream, stream_length);
+    *mode = read_header (&header, &flags);
+
+    piece = (length < RANGE_PIECE) ? length : RANGE_PIECE;
+    buffer = checked_malloc (piece);
+
+    while (length > 0 && result == SZ_OK)
+    {
+        if (piece > length)
+            piece = length;
+
+        result = sz_decode_range (stream, stream_length, offset, buffer,
+          piece, &produced);
+        output_write (output, buffer, produced);
+        offset += produced;
+        length -= produced;
+    }
+
+    free (buffer);
+
+    // the mapping is used in place, so it is only taken now, which counts
+    // it as read. Reading the index means the whole of it counts.
+    input_read (input, &stream, stream_length);
+
+    if (result == SZ_ERROR)
+    {
+        fprintf (stderr, "Error decoding range; the stream may not be "
+          "seekable.\n");
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Decompress the segments of a seekable stream one after the other, up
+ *  to the index, writing the result to output. Returns 0, EXIT_FAILURE if
+ *  a segment is corrupt or the stream is truncated, or EXIT_CHECKSUM if a
+ *  segment does not match its checksum.
+ */
+    PRIVATE int
+puff_seekable (bit_reader_t *reader, output_file_t *output, int mode,
+  const params_t *params, const options_t *options, stats_t *stats)
+{
+    uint32_t segments = 0, count;
+    int tag, status = 0;
+
+    while (status == 0 && (tag = read_bits (reader, 8)) != INDEX_TAG)
+    {
+        if (tag != SEGMENT_TAG)
+        {
+            fprintf (stderr, "Error reading segment.\n");
+            return EXIT_FAILURE;
+        }
+
+        segments += 1;
+
+        status = puff_segment (reader, output, mode, params, options,
+          stats);
+
+        if (status == 0 && reader_align (reader) == -1)
+        {
+            fprintf (stderr, "Error reading segment.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // a stream cut short at the end of a segment only shows up here.
+    if (status == 0 && (read_u32 (reader, &count) == -1 ||
+      count != segments))
+    {
+        fprintf (stderr, "Error reading index.\n");
+        return EXIT_FAILURE;
+    }
+
+    return status;
+}
+
+/**********************************************************/
+
+/**
+ *  Decompress a whole stream of the given mode, or one segment of a
+ *  seekable stream, writing the result to output, and check it against
+ *  its checksum, which follows it at the next byte boundary. Statistics
+ *  are added to stats, unless it is NULL. Returns 0, EXIT_FAILURE if it is
+ *  corrupt, or EXIT_CHECKSUM if it does not match its checksum.
+ */
+    PRIVATE int
+puff_segment (bit_reader_t *reader, output_file_t *output, int mode,
+  const params_t *params, const options_t *options, stats_t *stats)
+{
+    bool verify = params->checksum && options->checksum;
+    uint32_t crc = 0, *sum = verify ? &crc : NULL, stored;
+    int status;
+
+    // the threads would read ahead of a sync point, and wait there for
+    // input that may not come for a while.
+    if (mode == MODE_BLOCK && options->threads > 0 && !params->flush)
+    {
+        status = parallel_puff (reader, output, params->checksum, verify,
+          &crc, options->threads, options->in_flight, stats);
+
+        if (status == CHECKSUM_MISMATCH)
+        {
+            fprintf (stderr, "Checksum mismatch in block.\n");
+            return EXIT_CHECKSUM;
+        }
+
+        if (status == -1)
+        {
+            fprintf (stderr, "Error decoding block.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    else if (mode == MODE_BLOCK)
+    {
+        status = puff_blocks (reader, output, params->checksum,
+          params->flush, sum, stats);
+    }
+    else if (mode == MODE_CONTEXT)
+    {
+        status = puff_context (reader, output, params->order,
+          params->age_bits, params->drift_bits, params->flush, sum, stats);
+    }
+    else if (mode == MODE_LZ)
+    {
+        status = puff_lz (reader, output, params->window_bits,
+          params->age_bits, params->drift_bits, params->flush, sum, stats);
+    }
+    else
+    {
+        status = puff_adaptive (reader, output, params->age_bits,
+          params->drift_bits, params->flush, sum, stats);
+    }
+
+    if (status != 0 || !params->checksum)
+        return status;
+
+    if (reader_align (reader) == -1 || read_u32 (reader, &stored) == -1)
+    {
+        fprintf (stderr, "Error reading checksum.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (verify && stored != crc)
+    {
+        fprintf (stderr, "Checksum mismatch: the stream is corrupt.\n");
+        return EXIT_CHECKSUM;
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Decompress a stream that was coded with a single adaptive tree, aged at
+ *  2^age_bits and with a drift limit of drift_bits, writing the result to
+ *  output, and adding it to *crc unless crc is NULL, and statistics to
+ *  stats unless it is NULL. If flush is true, the stream may have sync
+ *  points. Returns 0, or EXIT_FAILURE if the stream is corrupt or
+ *  truncated.
  */
     PRIVATE int
-traverse_tree (const node_t *tree)
+puff_adaptive (bit_reader_t *reader, output_file_t *output, int age_bits,
+  int drift_bits, bool flush, uint32_t *crc, stats_t *stats)
 {
-    int value;
+    unsigned char buffer [DECODE_PIECE];
+    size_t length = 0;
+    uint64_t consumed = reader->consumed, time = 0;
+    int nextchar;
+    adaptive_tree_t tree;
 
-    // if we have reached a leaf node, then we have decoded a codeword, so
-    // return the value.
-    if (tree->left == NULL && tree->right == NULL)
-        return tree->ch;
+    adaptive_init (&tree, age_bits, drift_bits);
 
-    // otherwise, select the left or right branch depending on whether the
-    // next bit of the codeword is a 0 or 1.
-    switch (next_codeword_bit ())
+    while ((nextchar = adaptive_read (&tree, reader)) != DECODE_ERROR)
     {
-    case 1:
-        value = traverse_tree (tree->right);
-        break;
+        if (stats != NULL)
+        {
+            time = stats_symbol (stats, reader->consumed - consumed);
+            consumed = reader->consumed;
+        }
+
+        if (nextchar == END_OF_STREAM)
+        {
+            if (!flush || (nextchar = read_sync (reader)) != SYNC_POINT)
+                break;
+
+            sync_output (output, buffer, &length, crc);
+            consumed = reader->consumed;
+            continue;
+        }
+
+        buffer [length ++] = nextchar;
+        adaptive_update (&tree, nextchar);
+
+        if (stats != NULL)
+            stats_model (stats, time);
+
+        if (length == sizeof (buffer))
+        {
+            write_output (output, buffer, length, crc);
+            length = 0;
+        }
+    }
+
+    write_output (output, buffer, length, crc);
 
-    case 0:
-        value = traverse_tree (tree->left);
-        break;
+    if (stats != NULL)
+        stats_add_tree (stats, &tree);
 
-    default:
+    // a stream that stops part way through a codeword has been truncated,
+    // and must not pass for one that ends there.
+    if (nextchar == DECODE_ERROR)
+    {
         fprintf (stderr, "Error reading codeword bits.\n");
-        value = END_OF_STREAM;
+        return EXIT_FAILURE;
     }
 
-    return value;
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Decompress a stream made up of statically coded blocks, writing the
+ *  result to output. If checksum is true, the block headers hold
+ *  checksums, which are checked if crc is not NULL, and the output is
+ *  added to *crc. Statistics for each block are added to stats, unless it
+ *  is NULL. If flush is true, any block may end at a sync point, so each
+ *  one is read whole before it is decoded, since decoding looks a few
+ *  bits past each codeword, and past the end of the block, the input may
+ *  not have been sent yet; the output is flushed after each block.
+ *  Returns 0, EXIT_FAILURE if a block is corrupt, or EXIT_CHECKSUM if it
+ *  does not match its checksum.
+ */
+    PRIVATE int
+puff_blocks (bit_reader_t *reader, output_file_t *output, bool checksum,
+  bool flush, uint32_t *crc, stats_t *stats)
+{
+    block_header_t header;
+    block_stats_t block_stats;
+    bit_reader_t whole, *source = reader;
+    unsigned char *block = NULL, *compressed = NULL;
+    uint32_t capacity = 0, compressed_capacity = 0;
+    uint64_t start;
+    int status = 0;
+
+    while (true)
+    {
+        if (read_block_header (reader, &header, checksum) == -1)
+        {
+            fprintf (stderr, "Error reading block header.\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        if (header.length == 0)
+            break;
+
+        if (header.length > capacity)
+        {
+            free (block);
+            block = checked_malloc (header.length);
+            capacity = header.length;
+        }
+
+        if (flush && header.compressed_length > compressed_capacity)
+        {
+            free (compressed);
+            compressed = checked_malloc (header.compressed_length);
+            compressed_capacity = header.compressed_length;
+        }
+
+        if (flush)
+        {
+            source = &whole;
+            reader_init_memory (&whole, compressed, header.compressed_length);
+        }
+
+        // the block must use up exactly its compressed length, as it must
+        // when it is decoded by the worker threads.
+        start = source->consumed;
+
+        if ((flush && read_bytes (reader, compressed,
+          header.compressed_length) == -1) ||
+          decode_block (source, block, header.length,
+          stats != NULL ? &block_stats : NULL) == -1 ||
+          source->consumed - start != 8 * (uint64_t) header.compressed_length)
+        {
+            fprintf (stderr, "Error decoding block.\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        if (crc != NULL)
+        {
+            if (crc32c (block, header.length) != header.checksum)
+            {
+                fprintf (stderr, "Checksum mismatch in block.\n");
+                status = EXIT_CHECKSUM;
+                break;
+            }
+
+            *crc = crc32c_combine (*crc, header.checksum, header.length);
+        }
+
+        output_write (output, block, header.length);
+
+        if (flush)
+            output_flush (output);
+
+        if (stats != NULL)
+            stats_block (stats, &block_stats);
+    }
+
+    free (block);
+    free (compressed);
+    return status;
 }
 
 /**********************************************************/
 
 /**
- *  Reads the next 8 bits from stdin and returns them as an int. The value
- *  is read MSB first.
+ *  Decompress a stream that was coded with a context model of the given
+ *  order, whose trees are aged at 2^age_bits and have a drift limit of
+ *  drift_bits, writing the result to output, and adding it to *crc unless
+ *  crc is NULL, and statistics to stats unless it is NULL. If flush is
+ *  true, the stream may have sync points. Returns 0, or EXIT_FAILURE if
+ *  the stream is corrupt or truncated.
  */
     PRIVATE int
-read_next_byte (void)
+puff_context (bit_reader_t *reader, output_file_t *output, int order,
+  int age_bits, int drift_bits, bool flush, uint32_t *crc, stats_t *stats)
 {
-    int byte = 0x0;
+    context_model_t *model = context_new (order, age_bits, drift_bits);
+    unsigned char buffer [DECODE_PIECE];
+    size_t length = 0;
+    uint64_t consumed = reader->consumed, time = 0;
+    int nextchar;
 
-    for (int mask = 0x80; mask != 0x00; mask >>= 1)
+    while ((nextchar = context_read (model, reader)) != DECODE_ERROR)
     {
-        // is the next bit a 1? if so, set the bit in byte.
-        if (getchar () == '1')
-            byte |= mask;
+        if (stats != NULL)
+        {
+            time = stats_symbol (stats, reader->consumed - consumed);
+            consumed = reader->consumed;
+        }
+
+        if (nextchar == END_OF_STREAM)
+        {
+            if (!flush || (nextchar = read_sync (reader)) != SYNC_POINT)
+                break;
+
+            sync_output (output, buffer, &length, crc);
+            consumed = reader->consumed;
+            continue;
+        }
+
+        buffer [length ++] = nextchar;
+        context_update (model, nextchar);
+
+        if (stats != NULL)
+            stats_model (stats, time);
+
+        if (length == sizeof (buffer))
+        {
+            write_output (output, buffer, length, crc);
+            length = 0;
+        }
     }
 
-    return byte;
+    write_output (output, buffer, length, crc);
+
+    if (stats != NULL)
+        context_counts (model, &stats->rebuilds, &stats->escapes);
+
+    context_free (model);
+
+    if (nextchar == DECODE_ERROR)
+    {
+        fprintf (stderr, "Error reading codeword bits.\n");
+        return EXIT_FAILURE;
+    }
+
+    return 0;
 }
 
 /**********************************************************/
 
 /**
- *  Gets the next bit from the compressed stream. Returns 0 or 1 for the
- *  bit value, or -1 if EOF is encountered.
+ *  Decompress a stream of literals and matches, found within a window of
+ *  2^window_bits bytes, with trees aged at 2^age_bits and a drift limit of
+ *  drift_bits, writing the result to output, and adding it to *crc unless
+ *  crc is NULL, and statistics to stats unless it is NULL. If flush is
+ *  true, the stream may have sync points. Returns 0, or EXIT_FAILURE if
+ *  the stream is corrupt or truncated.
  */
     PRIVATE int
-next_codeword_bit (void)
+puff_lz (bit_reader_t *reader, output_file_t *output, int window_bits,
+  int age_bits, int drift_bits, bool flush, uint32_t *crc, stats_t *stats)
 {
-    int numeral = getchar ();
+    lz_decoder_t *decoder = lz_decoder_new (window_bits, age_bits,
+      drift_bits);
+    unsigned char buffer [DECODE_PIECE];
+    lz_token_t token;
+    int result;
+    size_t length = 0, count;
+
+    decoder->stats = stats;
+
+    // the bytes of many tokens are gathered before being written, so that
+    // the checksum is not worked out a few bytes at a time.
+    while ((result = lz_read (decoder, reader, &token)) == 0 ||
+      (result == END_OF_STREAM && flush &&
+      (result = read_sync (reader)) == SYNC_POINT))
+    {
+        if (result == SYNC_POINT)
+        {
+            if (stats != NULL)
+                stats_symbol (stats, token.symbol_bits);
+
+            sync_output (output, buffer, &length, crc);
+            continue;
+        }
+
+        lz_apply (decoder, &token);
+
+        do
+        {
+            if (length == sizeof (buffer))
+            {
+                write_output (output, buffer, length, crc);
+                length = 0;
+            }
+
+            count = lz_drain (decoder, buffer + length,
+              sizeof (buffer) - length);
+            length += count;
+        }
+        while (count > 0);
+    }
+
+    write_output (output, buffer, length, crc);
 
-    if (numeral == '1')
-        return 1;
+    if (stats != NULL)
+    {
+        if (token.symbol == END_OF_STREAM)
+            stats_symbol (stats, token.symbol_bits);
+
+        stats_add_tree (stats, &decoder->symbols);
+        stats_add_tree (stats, &decoder->distances);
+    }
 
-    if (numeral == '0')
-        return 0;
+    lz_decoder_free (decoder);
 
-    return numeral;
+    if (result == DECODE_ERROR)
+    {
+        fprintf (stderr, "Error reading codeword bits.\n");
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Check the command line options, and fill in the options structure.
+ *  Prints a usage message and exits if they are not valid.
+ */
+    PRIVATE void
+parse_arguments (int argc, char **argv, options_t *options)
+{
+    const char *count;
+
+    options->text = false;
+    options->threads = 0;
+    options->in_flight = 0;
+    options->verify = false;
+    options->checksum = true;
+    options->stats = false;
+    options->stats_json = false;
+    options->range = false;
+    options->input = NULL;
+
+    for (int i = 1; i < argc; i ++)
+    {
+        if (strcmp (argv [i], "--text") == 0)
+        {
+            options->text = true;
+        }
+        else if (strncmp (argv [i], "-T", 2) == 0)
+        {
+            // the count may be attached, or the next argument.
+            count = (argv [i] [2] != '\0' || i + 1 == argc) ?
+              argv [i] + 2 : argv [++ i];
+            options->threads = parse_size (count);
+
+            if (options->threads <= 0 || options->threads > MAX_THREADS)
+            {
+                fprintf (stderr, "%s: invalid thread count: %s\n", argv [0],
+                  count);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strncmp (argv [i], "--in-flight=", 12) == 0)
+        {
+            options->in_flight = parse_size (argv [i] + 12);
+
+            if (options->in_flight <= 0 || options->in_flight > MAX_IN_FLIGHT)
+            {
+                fprintf (stderr, "%s: invalid in flight count: %s\n",
+                  argv [0], argv [i] + 12);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strncmp (argv [i], "--range=", 8) == 0)
+        {
+            if (parse_range (argv [i] + 8, options) == -1)
+            {
+                fprintf (stderr, "%s: invalid range: %s\n", argv [0],
+                  argv [i] + 8);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strcmp (argv [i], "--verify") == 0)
+        {
+            options->verify = true;
+        }
+        else if (strcmp (argv [i], "--no-checksum") == 0)
+        {
+            options->checksum = false;
+        }
+        else if (strcmp (argv [i], "--stats") == 0 ||
+          strcmp (argv [i], "--stats=json") == 0)
+        {
+            options->stats = true;
+            options->stats_json = (argv [i] [7] == '=');
+        }
+        else if (argv [i] [0] != '-' && options->input == NULL)
+        {
+            options->input = argv [i];
+        }
+        else
+        {
+            fprintf (stderr, "usage: %s [--text] [-T N] [--in-flight=N] "
+              "[--range=OFFSET:LEN] [--verify] [--no-checksum] "
+              "[--stats[=json]] [input] > output\n", argv [0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    if (options->range && (options->text || options->threads > 0 ||
+      !options->checksum))
+    {
+        fprintf (stderr, "%s: --range cannot be used with --text, threads "
+          "or --no-checksum\n", argv [0]);
+        exit (EXIT_FAILURE);
+    }
+
+    if (options->verify && !options->checksum)
+    {
+        fprintf (stderr, "%s: --verify cannot be used with --no-checksum\n",
+          argv [0]);
+        exit (EXIT_FAILURE);
+    }
+
+    if (options->threads > 0 && options->in_flight == 0)
+        options->in_flight = 2 * options->threads;
+}
+
+/**********************************************************/
+
+/**
+ *  Parse the OFFSET:LEN argument of --range, where each is a size such as
+ *  parse_size takes, and the offset may also be 0. Returns 0, or -1 if it
+ *  is not valid.
+ */
+    PRIVATE int
+parse_range (const char *text, options_t *options)
+{
+    const char *colon = strchr (text, ':');
+    char offset [32];
+    size_t length;
+
+    if (colon == NULL || (length = colon - text) == 0 ||
+      length >= sizeof (offset))
+    {
+        return -1;
+    }
+
+    memcpy (offset, text, length);
+    offset [length] = '\0';
+
+    options->range = true;
+    options->range_offset = (strcmp (offset, "0") == 0) ? 0 :
+      parse_size (offset);
+    options->range_length = parse_size (colon + 1);
+
+    if (options->range_offset < 0 || options->range_length <= 0)
+        return -1;
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Write length bytes of decoded data to output, and add them to *crc
+ *  unless crc is NULL.
+ */
+    PRIVATE void
+write_output (output_file_t *output, const unsigned char *data,
+  size_t length, uint32_t *crc)
+{
+    if (crc != NULL)
+        *crc = crc32c_update (*crc, data, length);
+
+    output_write (output, data, length);
+}
+
+/**********************************************************/
+
+/**
+ *  At a sync point, write out the length bytes of decoded data that are
+ *  waiting in data, and flush the output, so that everything up to the
+ *  sync point is passed on without waiting for more input. *length is
+ *  set to 0.
+ */
+    PRIVATE void
+sync_output (output_file_t *output, const unsigned char *data,
+  size_t *length, uint32_t *crc)
+{
+    write_output (output, data, *length, crc);
+    output_flush (output);
+    *length = 0;
 }
 
 /**********************************************************/
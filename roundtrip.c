@@ -0,0 +1,650 @@
+/**
+ *  Round trip tests for libstreamzip. Every generated corpus, and a run of
+ *  randomly generated inputs, is compressed and decompressed with a range
+ *  of parameters, feeding the encoder and decoder randomly sized pieces of
+ *  input and output space, and the result is checked against the input.
+ *  The encoder's output must not depend on how its input was split up, so
+ *  that is checked as well, with flushes at the same places each time.
+ *  Seekable streams also have random ranges decoded from them, and
+ *  streams with sync points are flushed part way through, to check that
+ *  everything before that can be decoded. Finally, damaged streams are
+ *  decoded, to make sure the decoder rejects them cleanly (this is most
+ *  useful under the sanitizers; see make check-asan), and that damage is
+ *  never passed off as the original data when the stream has checksums.
+ *
+ *  With --write=NAME, the named corpus is written to stdout instead, so
+ *  that check.sh can run it through the squash and puff binaries.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+#include "corpus.h"
+#include "streamzip.h"
+
+/**********************************************************/
+
+typedef struct
+{
+    uint64_t seed;
+    long long iterations;
+    long long size;
+
+    // corpus to write to stdout, or -1 to run the tests.
+    int write;
+}
+options_t;
+
+// the parameters each input is tried with.
+typedef struct
+{
+    int mode;
+    size_t block_size;
+    int max_length;
+    int order;
+    int window_bits;
+
+    // age limit of adaptive trees, or 0 for the default, and their drift
+    // limit, or -1 for the default.
+    int age_bits;
+    int drift_bits;
+
+    // segment size of a seekable stream, or 0 for an ordinary one.
+    size_t segment_size;
+
+    // whether the stream has checksums.
+    bool checksum;
+
+    // bytes of input between flushes, or 0 for a stream without sync
+    // points.
+    size_t flush_every;
+}
+variant_t;
+
+// the part of the stream header that says which mode and features the
+// stream uses; see format.h. Damage to it may turn the checksums off.
+#define HEADER_LENGTH   6
+
+/**********************************************************/
+
+PRIVATE void parse_arguments (int argc, char **argv, options_t *options);
+PRIVATE int check_input (const unsigned char *input, size_t length,
+  const char *name, uint64_t *state);
+PRIVATE size_t compress (const sz_params_t *params, size_t flush_every,
+  const unsigned char *input, size_t length, unsigned char **output,
+  uint64_t *state);
+PRIVATE int finish (sz_encoder_t *encoder, bool end, unsigned char **output,
+  size_t *capacity, size_t *used, uint64_t *state);
+PRIVATE int decompress (const unsigned char *input, size_t length,
+  unsigned char *output, size_t capacity, size_t *produced,
+  uint64_t *state);
+PRIVATE int check_ranges (const unsigned char *input, size_t length,
+  const unsigned char *stream, size_t stream_length, uint64_t *state);
+PRIVATE int check_sync (const sz_params_t *params,
+  const unsigned char *input, size_t length, uint64_t *state);
+PRIVATE void damage (unsigned char *stream, size_t length, uint64_t *state);
+PRIVATE unsigned char * random_input (size_t *length, uint64_t *state);
+PRIVATE size_t random_size (size_t limit, uint64_t *state);
+PRIVATE uint64_t next_random (uint64_t *state);
+
+/**********************************************************/
+
+PRIVATE const variant_t variants [] =
+{
+    { SZ_MODE_ADAPTIVE, 0, 0, 0, 0, 0, -1, 0, true, 0 },
+    { SZ_MODE_ADAPTIVE, 0, 0, 0, 0, SZ_MIN_AGE_BITS, -1, 0, true, 0 },
+    { SZ_MODE_BLOCK, 7, 9, 0, 0, 0, -1, 0, true, 0 },
+    { SZ_MODE_BLOCK, 4096, 15, 0, 0, 0, -1, 0, true, 0 },
+    { SZ_MODE_BLOCK, 4096, 9, 0, 0, 0, -1, 0, true, 0 },
+    { SZ_MODE_BLOCK, 65536, 63, 0, 0, 0, -1, 0, true, 0 },
+    { SZ_MODE_BLOCK, 1 << 20, 15, 0, 0, 0, -1, 0, true, 0 },
+    { SZ_MODE_CONTEXT, 0, 0, 1, 0, 0, -1, 0, true, 0 },
+    { SZ_MODE_CONTEXT, 0, 0, 2, 0, 0, -1, 0, true, 0 },
+    { SZ_MODE_CONTEXT, 0, 0, 1, 0, SZ_MIN_AGE_BITS, -1, 0, true, 0 },
+    { SZ_MODE_LZ, 0, 0, 0, SZ_MIN_WINDOW_BITS, 0, -1, 0, true, 0 },
+    { SZ_MODE_LZ, 0, 0, 0, 16, SZ_MIN_AGE_BITS, -1, 0, true, 0 },
+    { SZ_MODE_LZ, 0, 0, 0, SZ_MAX_WINDOW_BITS, 0, -1, 0, true, 0 },
+    { SZ_MODE_ADAPTIVE, 0, 0, 0, 0, 0, -1, SZ_MIN_SEGMENT_SIZE, true, 0 },
+    { SZ_MODE_BLOCK, 4096, 15, 0, 0, 0, -1, 10000, true, 0 },
+    { SZ_MODE_CONTEXT, 0, 0, 2, 0, 0, -1, 5000, true, 0 },
+    { SZ_MODE_LZ, 0, 0, 0, 16, 0, -1, 3000, true, 0 },
+    { SZ_MODE_ADAPTIVE, 0, 0, 0, 0, 0, -1, 0, false, 0 },
+    { SZ_MODE_BLOCK, 4096, 15, 0, 0, 0, -1, 0, false, 0 },
+    { SZ_MODE_LZ, 0, 0, 0, 16, 0, -1, 3000, false, 0 },
+    { SZ_MODE_ADAPTIVE, 0, 0, 0, 0, 0, -1, 0, true, 1000 },
+    { SZ_MODE_BLOCK, 4096, 15, 0, 0, 0, -1, 0, true, 3000 },
+    { SZ_MODE_CONTEXT, 0, 0, 2, 0, 0, -1, 0, true, 777 },
+    { SZ_MODE_LZ, 0, 0, 0, 16, 0, -1, 0, true, 500 },
+    { SZ_MODE_CONTEXT, 0, 0, 1, 0, 0, -1, 5000, true, 2000 },
+    { SZ_MODE_LZ, 0, 0, 0, SZ_MIN_WINDOW_BITS, 0, -1, 0, false, 64 },
+    { SZ_MODE_ADAPTIVE, 0, 0, 0, 0, 0, 0, 0, true, 0 },
+    { SZ_MODE_ADAPTIVE, 0, 0, 0, 0, SZ_MIN_AGE_BITS, 1, 0, true, 0 },
+    { SZ_MODE_ADAPTIVE, 0, 0, 0, 0, 0, SZ_MAX_DRIFT_BITS, 0, true, 0 },
+    { SZ_MODE_CONTEXT, 0, 0, 2, 0, 0, 0, 0, true, 0 },
+    { SZ_MODE_CONTEXT, 0, 0, 1, 0, SZ_MIN_AGE_BITS, 2, 0, true, 0 },
+    { SZ_MODE_LZ, 0, 0, 0, 16, 0, 0, 0, true, 0 },
+    { SZ_MODE_LZ, 0, 0, 0, 16, 0, 0, 3000, true, 0 },
+    { SZ_MODE_CONTEXT, 0, 0, 2, 0, 0, 0, 0, true, 777 },
+    { SZ_MODE_ADAPTIVE, 0, 0, 0, 0, 0, -1, SZ_MIN_SEGMENT_SIZE, true, 700 },
+    { SZ_MODE_BLOCK, 4096, 15, 0, 0, 0, -1, 10000, true, 3000 },
+    { SZ_MODE_LZ, 0, 0, 0, 16, 0, 0, 3000, false, 1000 },
+};
+
+#define NUM_VARIANTS    (sizeof (variants) / sizeof (variants [0]))
+
+// sizes each corpus is generated at.
+PRIVATE const size_t corpus_sizes [] = { 1, 2, 100, 4097, 50000 };
+
+#define NUM_SIZES       (sizeof (corpus_sizes) / sizeof (corpus_sizes [0]))
+
+/**********************************************************/
+
+    PUBLIC int
+main (int argc, char **argv)
+{
+    options_t options;
+    unsigned char *input;
+    uint64_t state;
+    size_t length;
+    char name [64];
+    int failures = 0;
+
+    parse_arguments (argc, argv, &options);
+
+    if (options.write != -1)
+    {
+        input = generate_corpus (options.write, options.size, &length);
+        fwrite (input, 1, length, stdout);
+        free (input);
+        return 0;
+    }
+
+    state = options.seed;
+
+    for (int kind = 0; kind < NUM_CORPORA; kind ++)
+    {
+        for (size_t i = 0; i < NUM_SIZES; i ++)
+        {
+            input = generate_corpus (kind, corpus_sizes [i], &length);
+            sprintf (name, "%s/%zu", corpus_name (kind), corpus_sizes [i]);
+            failures += check_input (input, length, name, &state);
+            free (input);
+        }
+    }
+
+    for (int i = 0; i < options.iterations; i ++)
+    {
+        input = random_input (&length, &state);
+        sprintf (name, "random/%d", i);
+        failures += check_input (input, length, name, &state);
+        free (input);
+    }
+
+    if (failures > 0)
+    {
+        fprintf (stderr, "%s: %d failures.\n", argv [0], failures);
+        return EXIT_FAILURE;
+    }
+
+    printf ("%s: all round trips passed.\n", argv [0]);
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Check the command line options, and fill in the options structure.
+ *  Prints a usage message and exits if they are not valid.
+ */
+    PRIVATE void
+parse_arguments (int argc, char **argv, options_t *options)
+{
+    bool valid = true;
+
+    options->seed = 1;
+    options->iterations = 100;
+    options->size = 1 << 20;
+    options->write = -1;
+
+    for (int i = 1; i < argc; i ++)
+    {
+        if (strncmp (argv [i], "--seed=", 7) == 0)
+            valid = (options->seed = parse_size (argv [i] + 7)) > 0;
+        else if (strncmp (argv [i], "--iterations=", 13) == 0)
+            valid = (options->iterations = parse_size (argv [i] + 13)) > 0;
+        else if (strncmp (argv [i], "--size=", 7) == 0)
+            valid = (options->size = parse_size (argv [i] + 7)) > 0;
+        else if (strncmp (argv [i], "--write=", 8) == 0)
+            valid = (options->write = corpus_kind (argv [i] + 8)) != -1;
+        else
+            valid = false;
+
+        if (!valid)
+        {
+            fprintf (stderr, "usage: %s [--seed=N] [--iterations=N] "
+              "[--write=CORPUS [--size=SIZE]]\n", argv [0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Round trip one input with every mode and variant. Returns the number of
+ *  checks that failed, after reporting them on stderr.
+ */
+    PRIVATE int
+check_input (const unsigned char *input, size_t length, const char *name,
+  uint64_t *state)
+{
+    unsigned char *compressed, *again, *output;
+    size_t compressed_length, again_length, produced;
+    const variant_t *variant;
+    sz_params_t params;
+    int failures = 0;
+
+    output = checked_malloc (length + 1);
+
+    for (size_t v = 0; v < NUM_VARIANTS; v ++)
+    {
+        variant = variants + v;
+        sz_default_params (&params);
+        params.mode = variant->mode;
+
+        if (variant->mode == SZ_MODE_BLOCK)
+        {
+            params.block_size = variant->block_size;
+            params.max_length = variant->max_length;
+        }
+        else if (variant->mode == SZ_MODE_CONTEXT)
+        {
+            params.order = variant->order;
+        }
+        else if (variant->mode == SZ_MODE_LZ)
+        {
+            params.window_bits = variant->window_bits;
+        }
+
+        if (variant->age_bits > 0)
+            params.age_bits = variant->age_bits;
+
+        if (variant->drift_bits >= 0)
+            params.drift_bits = variant->drift_bits;
+
+        params.segment_size = variant->segment_size;
+        params.checksum = variant->checksum;
+        params.flush = (variant->flush_every > 0);
+
+        compressed_length = compress (&params, variant->flush_every, input,
+          length, &compressed, state);
+
+        if (decompress (compressed, compressed_length, output, length + 1,
+          &produced, state) != SZ_END || produced != length ||
+          memcmp (input, output, length) != 0)
+        {
+            fprintf (stderr, "%s: round trip failed (mode %d, block %zu, "
+              "max %d, order %d).\n", name, variant->mode,
+              variant->block_size, variant->max_length, variant->order);
+            failures += 1;
+        }
+
+        // a second encoding, split up differently, must match exactly.
+        again_length = compress (&params, variant->flush_every, input,
+          length, &again, state);
+
+        if (again_length != compressed_length ||
+          memcmp (compressed, again, compressed_length) != 0)
+        {
+            fprintf (stderr, "%s: output depends on input splitting "
+              "(mode %d, block %zu, max %d, order %d).\n", name,
+              variant->mode, variant->block_size, variant->max_length,
+              variant->order);
+            failures += 1;
+        }
+
+        if (variant->segment_size > 0 && check_ranges (input, length,
+          compressed, compressed_length, state) == -1)
+        {
+            fprintf (stderr, "%s: range decoding failed (mode %d, segment "
+              "%zu).\n", name, variant->mode, variant->segment_size);
+            failures += 1;
+        }
+
+        if (params.flush && check_sync (&params, input, length,
+          state) == -1)
+        {
+            fprintf (stderr, "%s: flushed output incomplete (mode %d, "
+              "segment %zu).\n", name, variant->mode,
+              variant->segment_size);
+            failures += 1;
+        }
+
+        // the decoder must survive damage to the stream, though what it
+        // decodes is anybody's guess, unless the stream has checksums, in
+        // which case it must not claim to have decoded the stream unless
+        // it really has.
+        damage (again, again_length, state);
+
+        if (decompress (again, again_length, output, length + 1,
+          &produced, state) == SZ_END && variant->checksum &&
+          memcmp (compressed, again, HEADER_LENGTH) == 0 &&
+          (produced != length || memcmp (input, output, length) != 0))
+        {
+            fprintf (stderr, "%s: damage was not detected (mode %d, "
+              "segment %zu).\n", name, variant->mode,
+              variant->segment_size);
+            failures += 1;
+        }
+
+        if (variant->segment_size > 0)
+        {
+            sz_decode_range (again, again_length, next_random (state) %
+              (length + 1), output, length + 1, &produced);
+        }
+
+        decompress (compressed, next_random (state) % compressed_length,
+          output, length + 1, &produced, state);
+
+        free (compressed);
+        free (again);
+    }
+
+    free (output);
+    return failures;
+}
+
+/**********************************************************/
+
+/**
+ *  Compress length bytes of input into a buffer allocated here, which the
+ *  caller should free, feeding the encoder random amounts of input and
+ *  output space. Unless flush_every is 0, the encoder is flushed after
+ *  every flush_every bytes of input. Returns the compressed length.
+ */
+    PRIVATE size_t
+compress (const sz_params_t *params, size_t flush_every,
+  const unsigned char *input, size_t length, unsigned char **output,
+  uint64_t *state)
+{
+    sz_encoder_t *encoder = sz_encoder_new (params);
+    size_t capacity = 2 * length + 4096, used = 0, position = 0;
+    size_t consumed, produced, piece, space;
+
+    *output = checked_malloc (capacity);
+
+    while (position < length)
+    {
+        if (capacity - used < 65536)
+        {
+            capacity *= 2;
+            *output = checked_realloc (*output, capacity);
+        }
+
+        piece = random_size (length - position, state);
+        space = random_size (capacity - used, state);
+
+        // the flushes go in at the same places however the input is split
+        // up, so that they do not change the output.
+        if (flush_every > 0 && piece > flush_every - position % flush_every)
+            piece = flush_every - position % flush_every;
+
+        sz_encode (encoder, input + position, piece, *output + used, space,
+          &consumed, &produced);
+        position += consumed;
+        used += produced;
+
+        if (flush_every > 0 && consumed > 0 && position % flush_every == 0)
+            finish (encoder, false, output, &capacity, &used, state);
+    }
+
+    finish (encoder, true, output, &capacity, &used, state);
+
+    sz_encoder_free (encoder);
+    return used;
+}
+
+/**********************************************************/
+
+/**
+ *  Flush the encoder, or if end is true, end the stream, appending the
+ *  output to *output, which is grown as need be, a random amount of space
+ *  at a time. Returns the result of the last call.
+ */
+    PRIVATE int
+finish (sz_encoder_t *encoder, bool end, unsigned char **output,
+  size_t *capacity, size_t *used, uint64_t *state)
+{
+    size_t produced, space;
+    int result;
+
+    do
+    {
+        if (*capacity - *used < 65536)
+        {
+            *capacity *= 2;
+            *output = checked_realloc (*output, *capacity);
+        }
+
+        space = random_size (*capacity - *used, state);
+        result = end ? sz_encode_end (encoder, *output + *used, space,
+          &produced) : sz_encode_flush (encoder, *output + *used, space,
+          &produced);
+        *used += produced;
+    }
+    while (result == SZ_MORE_OUTPUT);
+
+    return result;
+}
+
+/**********************************************************/
+
+/**
+ *  Decompress a stream into output, feeding the decoder random amounts of
+ *  input and output space, until it finishes, fails, or stops making
+ *  progress. Returns the decoder's last result, and stores the number of
+ *  bytes decoded in *produced.
+ */
+    PRIVATE int
+decompress (const unsigned char *input, size_t length, unsigned char *output,
+  size_t capacity, size_t *produced, uint64_t *state)
+{
+    sz_decoder_t *decoder = sz_decoder_new ();
+    size_t position = 0, consumed, made, piece, space;
+    int result, idle = 0;
+
+    *produced = 0;
+
+    do
+    {
+        piece = random_size (length - position, state);
+        space = random_size (capacity - *produced, state);
+
+        result = sz_decode (decoder, input + position, piece,
+          output + *produced, space, &consumed, &made);
+        position += consumed;
+        *produced += made;
+
+        // with all of the input in, a few calls in a row that do nothing
+        // mean the stream was truncated.
+        idle = (consumed == 0 && made == 0) ? idle + 1 : 0;
+    }
+    while (result == SZ_OK && idle < 8);
+
+    sz_decoder_free (decoder);
+    return result;
+}
+
+/**********************************************************/
+
+/**
+ *  Decode a few random ranges of a seekable stream, some of which run past
+ *  the end, and check them against the input. Returns 0, or -1 if any of
+ *  them is wrong.
+ */
+    PRIVATE int
+check_ranges (const unsigned char *input, size_t length,
+  const unsigned char *stream, size_t stream_length, uint64_t *state)
+{
+    unsigned char *output = checked_malloc (length + 1);
+    size_t offset, wanted, expected, produced;
+    int result, status = 0;
+
+    for (int i = 0; i < 4 && length > 0 && status == 0; i ++)
+    {
+        offset = next_random (state) % length;
+        wanted = random_size (length + 1 - offset, state);
+        expected = (offset + wanted <= length) ? wanted : length - offset;
+
+        result = sz_decode_range (stream, stream_length, offset, output,
+          wanted, &produced);
+
+        if (result != ((expected == wanted) ? SZ_OK : SZ_END) ||
+          produced != expected ||
+          memcmp (input + offset, output, expected) != 0)
+        {
+            status = -1;
+        }
+    }
+
+    free (output);
+    return status;
+}
+
+/**********************************************************/
+
+/**
+ *  Compress a random amount of the input, and flush the encoder without
+ *  ending the stream, and check that what it has output so far decodes
+ *  to all of that input. Returns 0, or -1 if it does not.
+ */
+    PRIVATE int
+check_sync (const sz_params_t *params, const unsigned char *input,
+  size_t length, uint64_t *state)
+{
+    sz_encoder_t *encoder = sz_encoder_new (params);
+    size_t wanted = random_size (length, state), capacity = 2 * wanted +
+      4096, used = 0, position = 0, consumed, produced;
+    unsigned char *stream = checked_malloc (capacity);
+    unsigned char *output = checked_malloc (wanted + 1);
+    int result, status = 0;
+
+    while (position < wanted)
+    {
+        sz_encode (encoder, input + position, wanted - position,
+          stream + used, capacity - used, &consumed, &produced);
+        position += consumed;
+        used += produced;
+
+        if (capacity - used < 65536)
+        {
+            capacity *= 2;
+            stream = checked_realloc (stream, capacity);
+        }
+    }
+
+    finish (encoder, false, &stream, &capacity, &used, state);
+
+    // the decoder runs out of input just after the sync point, and must
+    // have decoded everything before it by then.
+    result = decompress (stream, used, output, wanted + 1, &produced,
+      state);
+
+    if (result != SZ_OK || produced != wanted ||
+      memcmp (input, output, wanted) != 0)
+    {
+        status = -1;
+    }
+
+    sz_encoder_free (encoder);
+    free (stream);
+    free (output);
+    return status;
+}
+
+/**********************************************************/
+
+/**
+ *  Flip a few random bits of a stream.
+ */
+    PRIVATE void
+damage (unsigned char *stream, size_t length, uint64_t *state)
+{
+    int flips = 1 + next_random (state) % 4;
+
+    for (int i = 0; i < flips; i ++)
+        stream [next_random (state) % length] ^= 1 << (next_random (state) % 8);
+}
+
+/**********************************************************/
+
+/**
+ *  Make up an input of random length, drawn from a random number of
+ *  distinct byte values, with a random amount of skew.
+ */
+    PRIVATE unsigned char *
+random_input (size_t *length, uint64_t *state)
+{
+    unsigned char *data;
+    int distinct = 1 + next_random (state) % 256;
+    int skew = next_random (state) % 8;
+
+    *length = next_random (state) % (next_random (state) % 2 ? 300 : 20000);
+    data = checked_malloc (*length + 1);
+
+    // the more skew, the more often values are shifted down towards 0.
+    for (size_t i = 0; i < *length; i ++)
+    {
+        data [i] = (next_random (state) % distinct) >>
+          (next_random (state) % (skew + 1));
+    }
+
+    return data;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns a size of at most limit, usually small, but sometimes all of
+ *  it, so that both the piecemeal and the single call paths are used.
+ *  Only returns 0 if limit is 0.
+ */
+    PRIVATE size_t
+random_size (size_t limit, uint64_t *state)
+{
+    if (limit == 0)
+        return 0;
+
+    switch (next_random (state) % 4)
+    {
+    case 0:
+        return 1;
+
+    case 1:
+        return limit;
+
+    default:
+        return 1 + next_random (state) % (limit < 5000 ? limit : 5000);
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Step an xorshift64* generator, and return the next value.
+ */
+    PRIVATE uint64_t
+next_random (uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
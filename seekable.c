@@ -0,0 +1,187 @@
+/**
+ *  The index of a seekable stream. See seekable.h.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+#include "bitio.h"
+#include "seekable.h"
+
+/**********************************************************/
+
+/**
+ *  Set up an empty index.
+ */
+    PUBLIC void
+index_init (seek_index_t *index)
+{
+    index->entries = NULL;
+    index->count = 0;
+    index->capacity = 0;
+    index->length = 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Record the start of a segment, at the given uncompressed offset and
+ *  compressed position.
+ */
+    PUBLIC void
+index_add (seek_index_t *index, uint64_t offset, uint64_t position)
+{
+    if (index->count == index->capacity)
+    {
+        index->capacity = (index->capacity == 0) ? 64 : 2 * index->capacity;
+        index->entries = checked_realloc (index->entries,
+          index->capacity * sizeof (index_entry_t));
+    }
+
+    index->entries [index->count].offset = offset;
+    index->entries [index->count].position = position;
+    index->count += 1;
+}
+
+/**********************************************************/
+
+/**
+ *  Release the index's entries.
+ */
+    PUBLIC void
+index_free (seek_index_t *index)
+{
+    free (index->entries);
+    index->entries = NULL;
+}
+
+/**********************************************************/
+
+/**
+ *  Write the index, and the footer that points at it, after the last
+ *  segment of a stream whose uncompressed length is given. The output must
+ *  be at a byte boundary.
+ */
+    PUBLIC void
+write_index (bit_writer_t *writer, const seek_index_t *index,
+  uint64_t length)
+{
+    uint64_t position = writer_position (writer);
+
+    write_bits (writer, INDEX_TAG, 8);
+    write_bits (writer, index->count, 32);
+
+    for (uint32_t i = 0; i < index->count; i ++)
+    {
+        write_bits (writer, index->entries [i].offset, 64);
+        write_bits (writer, index->entries [i].position, 64);
+    }
+
+    write_bits (writer, length, 64);
+    write_bits (writer, position, 64);
+
+    for (int i = 0; i < INDEX_MAGIC_LENGTH; i ++)
+        write_bits (writer, INDEX_MAGIC [i], 8);
+}
+
+/**********************************************************/
+
+/**
+ *  Read the index from the end of a whole stream, held in memory, into an
+ *  index that has not been set up yet. Returns 0, or -1 if the stream has
+ *  no index, or it does not make sense; there is then nothing to free.
+ */
+    PUBLIC int
+read_index (const unsigned char *stream, size_t length, seek_index_t *index)
+{
+    bit_reader_t reader;
+    uint64_t start, offset, position;
+    uint32_t count;
+
+    if (length < INDEX_FOOTER_SIZE || memcmp (stream + length -
+      INDEX_MAGIC_LENGTH, INDEX_MAGIC, INDEX_MAGIC_LENGTH) != 0)
+    {
+        return -1;
+    }
+
+    reader_init_memory (&reader, stream + length - INDEX_FOOTER_SIZE,
+      INDEX_FOOTER_SIZE);
+
+    if (read_u64 (&reader, &start) == -1 || start >= length)
+        return -1;
+
+    // everything from the tag to the end of the stream must be the index,
+    // which leaves no room for doubt about the number of segments.
+    reader_init_memory (&reader, stream + start, length - start);
+
+    if (read_bits (&reader, 8) != INDEX_TAG ||
+      read_u32 (&reader, &count) == -1 ||
+      length - start != 1 + 4 + 16 * (uint64_t) count + 8 +
+      INDEX_FOOTER_SIZE)
+    {
+        return -1;
+    }
+
+    index_init (index);
+
+    for (uint32_t i = 0; i < count; i ++)
+    {
+        if (read_u64 (&reader, &offset) == -1 ||
+          read_u64 (&reader, &position) == -1)
+        {
+            index_free (index);
+            return -1;
+        }
+
+        // segments must be in order, and not empty.
+        if (position >= start || (i == 0 && offset != 0) || (i > 0 &&
+          (offset <= index->entries [i - 1].offset ||
+          position <= index->entries [i - 1].position)))
+        {
+            index_free (index);
+            return -1;
+        }
+
+        index_add (index, offset, position);
+    }
+
+    if (read_u64 (&reader, &index->length) == -1 ||
+      (count == 0 && index->length != 0) || (count > 0 &&
+      index->length <= index->entries [count - 1].offset))
+    {
+        index_free (index);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the number of the segment that holds the given uncompressed
+ *  offset, which must be less than the length of the stream.
+ */
+    PUBLIC uint32_t
+find_segment (const seek_index_t *index, uint64_t offset)
+{
+    uint32_t low = 0, high = index->count - 1, middle;
+
+    // the answer is always between low and high.
+    while (low < high)
+    {
+        middle = low + (high - low + 1) / 2;
+
+        if (index->entries [middle].offset <= offset)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    return low;
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
@@ -0,0 +1,84 @@
+/**
+ *  Seekable streams. With FLAG_SEEKABLE set in the header, the input is
+ *  coded as a sequence of segments of a fixed uncompressed size (the last
+ *  one may be shorter), each starting on a byte boundary with fresh
+ *  models, so that any segment can be decoded without the ones before it.
+ *  Each segment starts with a SEGMENT_TAG byte, and is coded just like a
+ *  whole stream of the same mode, up to its end of stream symbol or empty
+ *  block, and padded to a byte boundary.
+ *
+ *  After the last segment comes the index, laid out as follows:
+ *
+ *      8 bits      INDEX_TAG
+ *      32 bits     number of segments
+ *      64 bits     uncompressed offset of the segment   } for each
+ *      64 bits     compressed offset of its tag byte    } segment
+ *      64 bits     uncompressed length of the stream
+ *      64 bits     compressed offset of the INDEX_TAG byte
+ *      32 bits     INDEX_MAGIC
+ *
+ *  The last INDEX_FOOTER_SIZE bytes of the stream say where the index
+ *  starts, so a reader that can get at the end of the stream first can
+ *  find any segment straight away. Offsets are counted from the start of
+ *  the stream.
+ */
+
+#ifndef SEEKABLE_H
+#define SEEKABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "utils.h"
+#include "bitio.h"
+
+// the byte before each segment, and before the index.
+#define SEGMENT_TAG         1
+#define INDEX_TAG           0
+
+// the last bytes of a seekable stream.
+#define INDEX_MAGIC         "SQZI"
+#define INDEX_MAGIC_LENGTH  4
+#define INDEX_FOOTER_SIZE   (8 + INDEX_MAGIC_LENGTH)
+
+// range of segment sizes, and the size used when none is given. Smaller
+// segments mean less to decode before the part that is wanted, but cost
+// more, since every segment starts learning the data again.
+#define MIN_SEGMENT_SIZE    1024
+#define MAX_SEGMENT_SIZE    (1 << 30)
+#define DEFAULT_SEGMENT_SIZE    (1 << 20)
+
+
+// where a segment starts, in the uncompressed data and in the stream.
+typedef struct
+{
+    uint64_t offset;
+    uint64_t position;
+}
+index_entry_t;
+
+typedef struct
+{
+    index_entry_t *entries;
+    uint32_t count;
+    uint32_t capacity;
+
+    // uncompressed length of the whole stream.
+    uint64_t length;
+}
+seek_index_t;
+
+
+void index_init (seek_index_t *index);
+void index_add (seek_index_t *index, uint64_t offset, uint64_t position);
+void index_free (seek_index_t *index);
+void write_index (bit_writer_t *writer, const seek_index_t *index,
+  uint64_t length);
+int read_index (const unsigned char *stream, size_t length,
+  seek_index_t *index);
+uint32_t find_segment (const seek_index_t *index, uint64_t offset);
+
+
+#endif // SEEKABLE_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
@@ -1,171 +1,1073 @@
 /**
- *  Stream compression program. Data is read from stdin and compressed
- *  using a variant of a Huffman code algorithm, one byte at a time.
+ *  Stream compression program. Data is read from the file named on the
+ *  command line, or from stdin, and compressed using a variant of a
+ *  Huffman code algorithm, one byte at a time. If the input is a regular
+ *  file, it is mapped into memory rather than read.
+ *
+ *  With the --block=SIZE option, the input is instead split into blocks
+ *  of SIZE bytes, and each block is compressed with a static Huffman code
+ *  built for that block. This needs far less work per byte, and gives a
+ *  better ratio on data whose statistics do not change much, but the
+ *  output of each block is only available once the whole block has been
+ *  read. Codewords in a block are at most 15 bits long, or the length given
+ *  with the --max-length=N option.
+ *
+ *  With -T N, blocks are compressed by N worker threads at once, and the
+ *  --in-flight=N option limits how many blocks are held in memory while
+ *  that happens. Threads imply block mode, with blocks of 1MB unless
+ *  --block says otherwise. The output is identical to that of a single
+ *  thread.
+ *
+ *  With --context=1, each byte is instead coded with an adaptive tree
+ *  chosen by the byte before it, and with --context=2, by the two bytes
+ *  before it. This takes more memory, and more time per byte, but gives a
+ *  much better ratio on data such as text and logs, where a byte says a
+ *  lot about the next one. Context mode cannot be combined with block
+ *  mode.
+ *
+ *  With --lz, repeated strings are found first, within a window of the
+ *  last 64kB of input, or of SIZE bytes with --window=SIZE, and each one
+ *  is coded as a single length symbol and a distance, rather than a byte
+ *  at a time. This is much better on repetitive data, and faster too,
+ *  since there are fewer symbols to code. Like context mode, it cannot be
+ *  combined with block mode.
+ *
+ *  With --seekable, the input is coded in segments of 1MB, or of SIZE
+ *  bytes with --seekable=SIZE, each of which starts from scratch, and an
+ *  index of the segments is written at the end. puff --range can then
+ *  decode any part of the stream without decoding all of it first. This
+ *  costs a little in ratio, since each segment has to learn the data
+ *  again. It cannot be combined with threads or text output.
+ *
+ *  The CRC32C of the input is stored at the end of the stream, or of each
+ *  segment, and in block mode, of each block as well, so that puff can
+ *  tell if the stream has been damaged. The --no-checksum option leaves
+ *  the checksums out, which saves four bytes or so per block.
+ *
+ *  The -1 to -9 options pick a mode and its parameters from a scale of
+ *  presets, from the fastest, -1, to the one that usually compresses best,
+ *  -9. Levels 1 to 3 are block mode, with blocks of 1MB, 256kB and 64kB,
+ *  which is faster than anything else. Level 4 is the single
+ *  adaptive tree squash uses without any options. Levels 5 and 6 are
+ *  context mode of order 1 and 2, and 7 to 9 are LZ mode, with windows of
+ *  64kB, 1MB and 16MB, the bigger two of which search two and four times
+ *  as far along their hash chains for matches; each costs more time per
+ *  byte than the one before, on most data. Up to level 7, adaptive trees
+ *  defer their updates, as described below; levels 8 and 9 update them
+ *  after every symbol, which costs little in LZ mode, since it codes far
+ *  fewer symbols than bytes. A level cannot be combined with the options
+ *  that pick a mode themselves, though --drift overrides its drift limit,
+ *  and with threads, only levels 1 to 3 can be used. Whatever the level,
+ *  the mode and its parameters are recorded in the stream header, so puff
+ *  follows them without being told.
+ *
+ *  Adaptive trees are aged, halving all of their weights, each time their
+ *  total weight reaches 2^16, or 2^BITS with the --age=BITS option. A
+ *  smaller limit follows changes in the data more quickly; a larger one
+ *  does a little better on data that does not change.
+ *
+ *  Rather than being updated after every byte, adaptive trees defer their
+ *  updates, and are rebuilt from scratch only once the bytes coded since
+ *  the last rebuild come to 1/2^5 of their total weight, or 1/2^BITS with
+ *  the --drift=BITS option. This makes coding a byte far cheaper, and
+ *  costs a fraction of a percent in ratio at most. A larger limit comes
+ *  closer to updating after every byte, and --drift=0 does just that.
+ *
+ *  With --stats, a summary of the run is printed on stderr when it is
+ *  done: the sizes and ratio, how long the codewords were, how often the
+ *  adaptive trees were rebuilt and how many bytes were escaped, and how
+ *  the time was split between model updates, coding and I/O. With
+ *  --stats=json, the summary is a single line of JSON instead.
+ *
+ *  With --flush-every=SIZE, a sync point is written after every SIZE
+ *  bytes of input, and with --flush-every=Nms, no later than N
+ *  milliseconds after the first byte that has not been pushed out yet
+ *  was read, which is meant for input that arrives a little at a time,
+ *  such as messages down a pipe. Everything before a sync point is sent
+ *  at once, and puff can decode all of it straight away. Input is taken
+ *  as it arrives, rather than a buffer full at a time. Each sync point
+ *  costs a few bytes, and in block mode, a short block. It cannot be used
+ *  with threads or --seekable.
+ *
+ *  The compressed stream is written to stdout as packed bits, preceded by
+ *  a short header. Given the --text option, the bits are instead printed
+ *  as ASCII 0 and 1 numerals, which is useful for debugging.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
-#include <assert.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "utils.h"
 #include "huffman.h"
 #include "node.h"
 #include "alphabet.h"
+#include "adaptive.h"
+#include "fileio.h"
+#include "bitio.h"
+#include "format.h"
+#include "block.h"
+#include "parallel.h"
+#include "context.h"
+#include "lz.h"
+#include "seekable.h"
+#include "checksum.h"
+#include "stats.h"
 
 /**********************************************************/
 
-PRIVATE void print_codeword (node_t *tree, int ch);
-PRIVATE void print_bits (int ch);
-PRIVATE void init_stats (void);
-PRIVATE void record_length (int codeword_length);
-PRIVATE void print_stats (void);
+typedef struct
+{
+    bool text;
+
+    // size of each block in block mode, or 0 to compress adaptively.
+    long long block_size;
+
+    // longest codeword allowed in block mode.
+    long long max_length;
+
+    // number of worker threads, or 0 to do everything on the main thread,
+    // and the number of blocks that may be in progress at once.
+    long long threads;
+    long long in_flight;
+
+    // order of the context model, or 0 to use a single adaptive tree.
+    long long context;
+
+    // total weight at which adaptive trees are aged, in bits, and the
+    // drift limit of their deferred updates, or NO_DRIFT_BITS to update
+    // them after every byte. The drift limit is -1 until it is given or
+    // picked by a level.
+    long long age_bits;
+    long long drift_bits;
+
+    // size of the window, in bits, to find repeated strings in, or 0 to
+    // code every byte.
+    int window_bits;
+
+    // uncompressed size of each segment of a seekable stream, or 0 to
+    // write a stream that can only be decoded from the start.
+    long long segment_size;
+
+    // whether to store checksums of the data.
+    bool checksum;
+
+    // whether to print statistics at the end, and whether as JSON.
+    bool stats;
+    bool stats_json;
+
+    // input after which to write a sync point, in bytes, or failing that,
+    // in milliseconds, or 0 for neither.
+    long long flush_bytes;
+    long long flush_time;
+
+    // preset from 1 to 9 that picks the mode and its parameters, or 0 if
+    // none was given.
+    int level;
+
+    // file to compress, or NULL for stdin.
+    const char *input;
+
+    // the mode of the stream, which follows from the options above.
+    int mode;
+}
+options_t;
+
+// the input, as seen by the functions that compress a segment: no more
+// than remaining more bytes of it may be taken, and the checksum covers
+// the taken bytes, if it is wanted. In block mode, the checksum is made
+// up from those of the blocks instead, so next_piece leaves it alone.
+// Statistics are gathered in stats, unless it is NULL.
+//
+// With --flush-every, input is taken as it arrives, and a sync point is
+// due once flush_bytes bytes have been taken since the last one, or if
+// flush_bytes is 0, flush_time nanoseconds after the first of them was.
+// unflushed counts those bytes, and deadline is when the time is up.
+typedef struct
+{
+    input_file_t *input;
+    uint64_t remaining;
+    uint64_t taken;
+    bool checksum;
+    uint32_t crc;
+    stats_t *stats;
+
+    bool flushing;
+    uint64_t flush_bytes;
+    uint64_t flush_time;
+    uint64_t unflushed;
+    uint64_t deadline;
+}
+source_t;
+
+// the mode and parameters each level picks, from -1 up; see the comment
+// at the top.
+typedef struct
+{
+    long long block_size;
+    long long context;
+    int window_bits;
+    int drift_bits;
+}
+level_t;
+
+PRIVATE const level_t levels [] =
+{
+    { 1 << 20, 0, 0, DEFAULT_DRIFT_BITS },
+    { 1 << 18, 0, 0, DEFAULT_DRIFT_BITS },
+    { 1 << 16, 0, 0, DEFAULT_DRIFT_BITS },
+    { 0, 0, 0, DEFAULT_DRIFT_BITS },
+    { 0, 1, 0, DEFAULT_DRIFT_BITS },
+    { 0, 2, 0, DEFAULT_DRIFT_BITS },
+    { 0, 0, 16, DEFAULT_DRIFT_BITS },
+    { 0, 0, 20, NO_DRIFT_BITS },
+    { 0, 0, 24, NO_DRIFT_BITS },
+};
+
+#define NUM_LEVELS          (sizeof (levels) / sizeof (levels [0]))
+
+// most input taken at once when flushing by time, so that the time is
+// checked often enough.
+#define FLUSH_PIECE         65536
+
+// longest time allowed between sync points, in milliseconds.
+#define MAX_FLUSH_TIME      (24 * 60 * 60 * 1000)
 
 /**********************************************************/
 
-// this array tells us how many codewords there were of each length.
-PRIVATE int length_histogram [NUM_CODEWORDS];
-PRIVATE int bytes_compressed;
+PRIVATE void parse_arguments (int argc, char **argv, options_t *options);
+PRIVATE int parse_flush (const char *text, options_t *options);
+PRIVATE void apply_level (const char *program, options_t *options);
+PRIVATE void squash_seekable (input_file_t *input, bit_writer_t *writer,
+  const options_t *options, stats_t *stats);
+PRIVATE uint64_t squash_segment (input_file_t *input, bit_writer_t *writer,
+  const options_t *options, uint64_t limit, stats_t *stats);
+PRIVATE void squash_adaptive (source_t *source, bit_writer_t *writer,
+  int age_bits, int drift_bits);
+PRIVATE void squash_context (source_t *source, bit_writer_t *writer,
+  int order, int age_bits, int drift_bits);
+PRIVATE void squash_lz (source_t *source, bit_writer_t *writer,
+  int window_bits, int age_bits, int drift_bits);
+PRIVATE void squash_blocks (source_t *source, bit_writer_t *writer,
+  size_t block_size, int max_length, bool checksum);
+PRIVATE void code_block (source_t *source, bit_writer_t *writer,
+  const unsigned char *block, size_t length, int max_length,
+  bool checksum);
+PRIVATE size_t next_piece (source_t *source, const unsigned char **data,
+  size_t size);
+PRIVATE bool sync_due (source_t *source);
+PRIVATE void sync_output (source_t *source, bit_writer_t *writer,
+  bool marker);
 
 /**********************************************************/
 
     PUBLIC int
 main (int argc, char **argv)
 {
-    int nextchar;
-    node_t *huffman_tree;
+    options_t options;
+    input_file_t input;
+    output_file_t output;
+    bit_writer_t writer;
+    stats_t stats, *gather = NULL;
+    int status = 0;
+
+    parse_arguments (argc, argv, &options);
+
+    // the statistics are always set up, which costs next to nothing, but
+    // only gathered if they are wanted.
+    stats_init (&stats, false);
+    stats.mode = options.mode;
 
-    init_stats ();
-    huffman_init ();
-    initialise_histogram ();
+    if (options.stats)
+        gather = &stats;
 
-    while ((nextchar = getchar ()) != EOF)
+    if (options.input == NULL)
+    {
+        input_init (&input, STDIN_FILENO);
+    }
+    else if (input_open (&input, options.input) == -1)
     {
-        huffman_tree = build_huffman_tree ();
-        print_codeword (huffman_tree, nextchar);
-        update_symbol (nextchar);
+        fprintf (stderr, "%s: cannot open %s: %s\n", argv [0],
+          options.input, strerror (errno));
+        return EXIT_FAILURE;
     }
 
-    huffman_tree = build_huffman_tree ();
-    print_codeword (huffman_tree, END_OF_STREAM);
+    output_init (&output, STDOUT_FILENO);
+    writer_init (&writer, &output, options.text);
 
-    //print_stats ();
+    write_header (&writer, options.mode,
+      ((options.segment_size > 0) ? FLAG_SEEKABLE : 0) |
+      (options.checksum ? FLAG_CHECKSUM : 0) |
+      ((options.flush_bytes > 0 || options.flush_time > 0) ?
+      FLAG_FLUSH : 0) | ((options.mode != MODE_BLOCK &&
+      options.drift_bits != NO_DRIFT_BITS) ? FLAG_DEFERRED : 0));
 
-    return 0;
+    if (options.mode == MODE_CONTEXT)
+        write_context_order (&writer, options.context);
+    else if (options.mode == MODE_LZ)
+        write_window_bits (&writer, options.window_bits);
+
+    if (options.mode != MODE_BLOCK)
+        write_age_bits (&writer, options.age_bits);
+
+    if (options.mode != MODE_BLOCK && options.drift_bits != NO_DRIFT_BITS)
+        write_drift_bits (&writer, options.drift_bits);
+
+    if (options.threads > 0)
+    {
+        parallel_squash (&writer, &input, options.block_size,
+          options.max_length, options.checksum, options.threads,
+          options.in_flight, gather);
+    }
+    else if (options.segment_size > 0)
+    {
+        squash_seekable (&input, &writer, &options, gather);
+    }
+    else
+    {
+        squash_segment (&input, &writer, &options, UINT64_MAX, gather);
+    }
+
+    writer_align (&writer);
+    writer_flush (&writer);
+    writer_free (&writer);
+
+    if (input_close (&input) == -1)
+    {
+        fprintf (stderr, "%s: error reading input\n", argv [0]);
+        status = EXIT_FAILURE;
+    }
+
+    if (output_close (&output) == -1)
+    {
+        fprintf (stderr, "%s: error writing output\n", argv [0]);
+        status = EXIT_FAILURE;
+    }
+
+    if (options.stats)
+    {
+        stats_finish (&stats, input.total, output.total,
+          input.busy + output.busy);
+        stats_print (&stats, "squash", options.stats_json);
+    }
+
+    return status;
 }
 
 /**********************************************************/
 
 /**
- *  Lookup the codeword for a given character, and print the codeword on
- *  stdout, as 0 and 1 numerals. If the character is not found in the
- *  Huffman tree, this function will print the codeword for not found, then
- *  the 8 bit value.
+ *  Check the command line options, and fill in the options structure.
+ *  Prints a usage message and exits if they are not valid.
  */
     PRIVATE void
-print_codeword (node_t *tree, int ch)
+parse_arguments (int argc, char **argv, options_t *options)
 {
-    // the maximum length of the codeword is the size of the alphabet,
-    // which would occurr when the Huffman tree is a stick.
-    char codeword_buffer [ALPHABET_LENGTH];
+    const char *count;
+    long long window;
+
+    options->text = false;
+    options->block_size = 0;
+    options->max_length = DEFAULT_LENGTH_LIMIT;
+    options->threads = 0;
+    options->in_flight = 0;
+    options->context = 0;
+    options->age_bits = DEFAULT_AGE_BITS;
+    options->drift_bits = -1;
+    options->window_bits = 0;
+    options->segment_size = 0;
+    options->checksum = true;
+    options->stats = false;
+    options->stats_json = false;
+    options->flush_bytes = 0;
+    options->flush_time = 0;
+    options->level = 0;
+    options->input = NULL;
+
+    for (int i = 1; i < argc; i ++)
+    {
+        if (strcmp (argv [i], "--text") == 0)
+        {
+            options->text = true;
+        }
+        else if (strncmp (argv [i], "--block=", 8) == 0)
+        {
+            options->block_size = parse_size (argv [i] + 8);
+
+            if (options->block_size <= 0 ||
+              options->block_size > MAX_BLOCK_SIZE)
+            {
+                fprintf (stderr, "%s: invalid block size: %s\n", argv [0],
+                  argv [i] + 8);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strncmp (argv [i], "--max-length=", 13) == 0)
+        {
+            options->max_length = parse_size (argv [i] + 13);
+
+            if (options->max_length < MIN_LENGTH_LIMIT ||
+              options->max_length > MAX_CODE_LENGTH)
+            {
+                fprintf (stderr, "%s: invalid maximum code length: %s\n",
+                  argv [0], argv [i] + 13);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strncmp (argv [i], "-T", 2) == 0)
+        {
+            // the count may be attached, or the next argument.
+            count = (argv [i] [2] != '\0' || i + 1 == argc) ?
+              argv [i] + 2 : argv [++ i];
+            options->threads = parse_size (count);
+
+            if (options->threads <= 0 || options->threads > MAX_THREADS)
+            {
+                fprintf (stderr, "%s: invalid thread count: %s\n", argv [0],
+                  count);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strncmp (argv [i], "--in-flight=", 12) == 0)
+        {
+            options->in_flight = parse_size (argv [i] + 12);
+
+            if (options->in_flight <= 0 || options->in_flight > MAX_IN_FLIGHT)
+            {
+                fprintf (stderr, "%s: invalid in flight count: %s\n",
+                  argv [0], argv [i] + 12);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strncmp (argv [i], "--context=", 10) == 0)
+        {
+            options->context = parse_size (argv [i] + 10);
 
-    if (lookup_codeword (tree, ch, codeword_buffer, ALPHABET_LENGTH) != 1)
+            if (options->context < MIN_CONTEXT_ORDER ||
+              options->context > MAX_CONTEXT_ORDER)
+            {
+                fprintf (stderr, "%s: invalid context order: %s\n",
+                  argv [0], argv [i] + 10);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strncmp (argv [i], "--age=", 6) == 0)
+        {
+            options->age_bits = parse_size (argv [i] + 6);
+
+            if (options->age_bits < MIN_AGE_BITS ||
+              options->age_bits > MAX_AGE_BITS)
+            {
+                fprintf (stderr, "%s: invalid age limit: %s\n", argv [0],
+                  argv [i] + 6);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strncmp (argv [i], "--drift=", 8) == 0)
+        {
+            options->drift_bits = (strcmp (argv [i] + 8, "0") == 0) ?
+              NO_DRIFT_BITS : parse_size (argv [i] + 8);
+
+            if (options->drift_bits < NO_DRIFT_BITS ||
+              options->drift_bits > MAX_DRIFT_BITS)
+            {
+                fprintf (stderr, "%s: invalid drift limit: %s\n",
+                  argv [0], argv [i] + 8);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strcmp (argv [i], "--lz") == 0)
+        {
+            if (options->window_bits == 0)
+                options->window_bits = LZ_DEFAULT_WINDOW_BITS;
+        }
+        else if (strncmp (argv [i], "--window=", 9) == 0)
+        {
+            window = parse_size (argv [i] + 9);
+            options->window_bits = LZ_MIN_WINDOW_BITS;
+
+            while (options->window_bits < LZ_MAX_WINDOW_BITS &&
+              (1LL << options->window_bits) < window)
+            {
+                options->window_bits += 1;
+            }
+
+            if (window != 1LL << options->window_bits)
+            {
+                fprintf (stderr, "%s: window must be a power of two from "
+                  "1k to 16m: %s\n", argv [0], argv [i] + 9);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strcmp (argv [i], "--seekable") == 0)
+        {
+            options->segment_size = DEFAULT_SEGMENT_SIZE;
+        }
+        else if (strncmp (argv [i], "--seekable=", 11) == 0)
+        {
+            options->segment_size = parse_size (argv [i] + 11);
+
+            if (options->segment_size < MIN_SEGMENT_SIZE ||
+              options->segment_size > MAX_SEGMENT_SIZE)
+            {
+                fprintf (stderr, "%s: invalid segment size: %s\n",
+                  argv [0], argv [i] + 11);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (strcmp (argv [i], "--no-checksum") == 0)
+        {
+            options->checksum = false;
+        }
+        else if (strcmp (argv [i], "--stats") == 0 ||
+          strcmp (argv [i], "--stats=json") == 0)
+        {
+            options->stats = true;
+            options->stats_json = (argv [i] [7] == '=');
+        }
+        else if (strncmp (argv [i], "--flush-every=", 14) == 0)
+        {
+            if (parse_flush (argv [i] + 14, options) == -1)
+            {
+                fprintf (stderr, "%s: invalid flush interval: %s\n",
+                  argv [0], argv [i] + 14);
+                exit (EXIT_FAILURE);
+            }
+        }
+        else if (argv [i] [0] == '-' && argv [i] [1] >= '1' &&
+          argv [i] [1] <= '0' + (int) NUM_LEVELS && argv [i] [2] == '\0')
+        {
+            options->level = argv [i] [1] - '0';
+        }
+        else if (argv [i] [0] != '-' && options->input == NULL)
+        {
+            options->input = argv [i];
+        }
+        else
+        {
+            fprintf (stderr, "usage: %s [-1 ... -9] [--text] "
+              "[--block=SIZE] [--max-length=N] [-T N] [--in-flight=N] "
+              "[--context=N] [--lz] [--window=SIZE] [--age=BITS] "
+              "[--drift=BITS] "
+              "[--seekable[=SIZE]] [--no-checksum] [--stats[=json]] "
+              "[--flush-every=SIZE|Nms] [input] > output\n", argv [0]);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    if (options->level > 0)
+        apply_level (argv [0], options);
+
+    if (options->drift_bits == -1)
+        options->drift_bits = DEFAULT_DRIFT_BITS;
+
+    if ((options->context > 0 || options->window_bits > 0) &&
+      (options->block_size > 0 || options->threads > 0))
     {
-        // not found.
-        printf ("%s", codeword_buffer);
-        print_bits (ch);
-        record_length (strlen (codeword_buffer) + 8);
+        fprintf (stderr, "%s: --context and --lz cannot be used in block "
+          "mode\n", argv [0]);
+        exit (EXIT_FAILURE);
     }
+
+    if (options->context > 0 && options->window_bits > 0)
+    {
+        fprintf (stderr, "%s: --context and --lz cannot be used together\n",
+          argv [0]);
+        exit (EXIT_FAILURE);
+    }
+
+    if (options->segment_size > 0 && (options->threads > 0 ||
+      options->text))
+    {
+        fprintf (stderr, "%s: --seekable cannot be used with threads or "
+          "--text\n", argv [0]);
+        exit (EXIT_FAILURE);
+    }
+
+    if ((options->flush_bytes > 0 || options->flush_time > 0) &&
+      (options->threads > 0 || options->segment_size > 0))
+    {
+        fprintf (stderr, "%s: --flush-every cannot be used with threads or "
+          "--seekable\n", argv [0]);
+        exit (EXIT_FAILURE);
+    }
+
+    if (options->threads > 0)
+    {
+        if (options->block_size == 0)
+            options->block_size = DEFAULT_BLOCK_SIZE;
+
+        if (options->in_flight == 0)
+            options->in_flight = 2 * options->threads;
+    }
+
+    if (options->block_size > 0)
+        options->mode = MODE_BLOCK;
+    else if (options->context > 0)
+        options->mode = MODE_CONTEXT;
+    else if (options->window_bits > 0)
+        options->mode = MODE_LZ;
     else
+        options->mode = MODE_ADAPTIVE;
+}
+
+/**********************************************************/
+
+/**
+ *  Parse the argument of --flush-every, which is either a size such as
+ *  parse_size takes, or a number of milliseconds followed by "ms".
+ *  Returns 0, or -1 if it is not valid.
+ */
+    PRIVATE int
+parse_flush (const char *text, options_t *options)
+{
+    char *end;
+    long long milliseconds = strtoll (text, &end, 10);
+
+    if (end != text && strcmp (end, "ms") == 0)
     {
-        printf ("%s", codeword_buffer);
-        record_length (strlen (codeword_buffer));
+        options->flush_time = milliseconds;
+        return (milliseconds > 0 && milliseconds <= MAX_FLUSH_TIME) ? 0 : -1;
     }
+
+    options->flush_bytes = parse_size (text);
+    return (options->flush_bytes > 0) ? 0 : -1;
 }
 
 /**********************************************************/
 
 /**
- *  Print the individual bits of the given 8 bit value. Only the lowest
- *  8 bits of the int are used, and will be printed MSB first.
+ *  Fill in the mode and parameters of the level given, and its drift
+ *  limit, unless --drift gave one. Prints a message and exits if they
+ *  clash with the other options.
  */
     PRIVATE void
-print_bits (int ch)
+apply_level (const char *program, options_t *options)
 {
-    // sweep down from the 8th bit to the least significant bit.
-    // For each one, test if the bit in ch is 1, and print the appropriate
-    // numeral on stdout.
-    for (int mask = 0x80; mask != 0x00; mask >>= 1)
+    const level_t *level = levels + options->level - 1;
+
+    if (options->block_size > 0 || options->context > 0 ||
+      options->window_bits > 0)
     {
-        if ((ch & mask) != 0)
+        fprintf (stderr, "%s: a level cannot be used with --block, "
+          "--context, --lz or --window\n", program);
+        exit (EXIT_FAILURE);
+    }
+
+    if (options->threads > 0 && level->block_size == 0)
+    {
+        fprintf (stderr, "%s: only levels 1 to 3 can be used with "
+          "threads\n", program);
+        exit (EXIT_FAILURE);
+    }
+
+    options->block_size = level->block_size;
+    options->context = level->context;
+    options->window_bits = level->window_bits;
+
+    if (options->drift_bits == -1)
+        options->drift_bits = level->drift_bits;
+}
+
+/**********************************************************/
+
+/**
+ *  Compress the input as a seekable stream: a sequence of segments, each
+ *  coded from scratch, followed by the index that says where they start.
+ */
+    PRIVATE void
+squash_seekable (input_file_t *input, bit_writer_t *writer,
+  const options_t *options, stats_t *stats)
+{
+    seek_index_t index;
+    uint64_t offset = 0;
+
+    index_init (&index);
+
+    while (!input_end (input))
+    {
+        index_add (&index, offset, writer_position (writer));
+        write_bits (writer, SEGMENT_TAG, 8);
+        offset += squash_segment (input, writer, options,
+          options->segment_size, stats);
+    }
+
+    write_index (writer, &index, offset);
+    index_free (&index);
+}
+
+/**********************************************************/
+
+/**
+ *  Compress up to limit bytes of the input in the mode the options call
+ *  for, from scratch, up to and including the end of stream marker, and
+ *  pad the output to a byte boundary, followed by the checksum if there
+ *  is one. Statistics are added to stats, unless it is NULL. Returns the
+ *  number of bytes compressed.
+ */
+    PRIVATE uint64_t
+squash_segment (input_file_t *input, bit_writer_t *writer,
+  const options_t *options, uint64_t limit, stats_t *stats)
+{
+    source_t source = { input, limit, 0,
+      options->checksum && options->mode != MODE_BLOCK, 0, stats,
+      options->flush_bytes > 0 || options->flush_time > 0,
+      options->flush_bytes, options->flush_time * 1000000, 0, 0 };
+
+    if (options->mode == MODE_BLOCK)
+    {
+        squash_blocks (&source, writer, options->block_size,
+          options->max_length, options->checksum);
+    }
+    else if (options->mode == MODE_CONTEXT)
+    {
+        squash_context (&source, writer, options->context,
+          options->age_bits, options->drift_bits);
+    }
+    else if (options->mode == MODE_LZ)
+    {
+        squash_lz (&source, writer, options->window_bits, options->age_bits,
+          options->drift_bits);
+    }
+    else
+    {
+        squash_adaptive (&source, writer, options->age_bits,
+          options->drift_bits);
+    }
+
+    // in the modes that end with an end of stream codeword, it has to be
+    // told apart from those at sync points.
+    if (source.flushing && options->mode != MODE_BLOCK)
+        write_sync (writer, false);
+
+    writer_align (writer);
+
+    if (options->checksum)
+        write_bits (writer, source.crc, 32);
+
+    return source.taken;
+}
+
+/**********************************************************/
+
+/**
+ *  Compress the source with a single adaptive Huffman tree, aged at
+ *  2^age_bits and with a drift limit of drift_bits.
+ */
+    PRIVATE void
+squash_adaptive (source_t *source, bit_writer_t *writer, int age_bits,
+  int drift_bits)
+{
+    stats_t *stats = source->stats;
+    const unsigned char *data;
+    size_t length;
+    adaptive_tree_t tree;
+    uint64_t time = 0;
+    int bits;
+
+    adaptive_init (&tree, age_bits, drift_bits);
+
+    // the tree is updated after each byte, or the byte counted, in exactly
+    // the same way as puff will update its copy after decoding the byte.
+    while ((length = next_piece (source, &data, FILEIO_BUFFER_SIZE)) > 0)
+    {
+        for (size_t i = 0; i < length; i ++)
         {
-            printf ("1");
+            bits = adaptive_write (&tree, writer, data [i]);
+
+            if (stats != NULL)
+                time = stats_symbol (stats, bits);
+
+            adaptive_update (&tree, data [i]);
+
+            if (stats != NULL)
+                stats_model (stats, time);
         }
-        else
+
+        if (source->flushing && sync_due (source))
         {
-            printf ("0");
+            bits = adaptive_write (&tree, writer, END_OF_STREAM);
+
+            if (stats != NULL)
+                stats_symbol (stats, bits);
+
+            sync_output (source, writer, true);
         }
     }
+
+    bits = adaptive_write (&tree, writer, END_OF_STREAM);
+
+    if (stats != NULL)
+    {
+        stats_symbol (stats, bits);
+        stats_add_tree (stats, &tree);
+    }
 }
 
 /**********************************************************/
 
 /**
- *  Initialise the global variables used to record statistics.
+ *  Compress the source with a context model of the given order, whose
+ *  trees are aged at 2^age_bits and have a drift limit of drift_bits.
  */
     PRIVATE void
-init_stats (void)
+squash_context (source_t *source, bit_writer_t *writer, int order,
+  int age_bits, int drift_bits)
 {
-    bytes_compressed = 0;
+    context_model_t *model = context_new (order, age_bits, drift_bits);
+    stats_t *stats = source->stats;
+    const unsigned char *data;
+    size_t length;
+    uint64_t time = 0;
+    int bits;
+
+    while ((length = next_piece (source, &data, FILEIO_BUFFER_SIZE)) > 0)
+    {
+        for (size_t i = 0; i < length; i ++)
+        {
+            bits = context_write (model, writer, data [i]);
+
+            if (stats != NULL)
+                time = stats_symbol (stats, bits);
 
-    for (int i = 0; i < NUM_CODEWORDS; i ++)
-        length_histogram [i] = 0;
+            context_update (model, data [i]);
+
+            if (stats != NULL)
+                stats_model (stats, time);
+        }
+
+        if (source->flushing && sync_due (source))
+        {
+            bits = context_write (model, writer, END_OF_STREAM);
+
+            if (stats != NULL)
+                stats_symbol (stats, bits);
+
+            sync_output (source, writer, true);
+        }
+    }
+
+    bits = context_write (model, writer, END_OF_STREAM);
+
+    if (stats != NULL)
+    {
+        stats_symbol (stats, bits);
+        context_counts (model, &stats->rebuilds, &stats->escapes);
+    }
+
+    context_free (model);
 }
 
 /**********************************************************/
 
 /**
- *  Record that a codeword of the specified length was printed.
+ *  Compress the source as literals and matches, found within a window of
+ *  2^window_bits bytes, with trees aged at 2^age_bits and a drift limit of
+ *  drift_bits.
  */
     PRIVATE void
-record_length (int codeword_length)
+squash_lz (source_t *source, bit_writer_t *writer, int window_bits,
+  int age_bits, int drift_bits)
 {
-    // this assert is mostly for array bounds checking, but we also prevent
-    // codewords from being zero length, which would be within the array
-    // bounds, but completely illogical.
-    assert (codeword_length > 0 && codeword_length < NUM_CODEWORDS);
-    bytes_compressed += 1;
-    length_histogram [codeword_length] += 1;
+    lz_encoder_t *encoder = lz_encoder_new (window_bits, age_bits,
+      drift_bits);
+    const unsigned char *data;
+    size_t length;
+
+    encoder->stats = source->stats;
+
+    while ((length = next_piece (source, &data, FILEIO_BUFFER_SIZE)) > 0)
+    {
+        lz_encode (encoder, writer, data, length);
+
+        // the input held back in case it starts a match is coded at a
+        // sync point, and matching carries on from there.
+        if (source->flushing && sync_due (source))
+        {
+            lz_encode_end (encoder, writer);
+            sync_output (source, writer, true);
+        }
+    }
+
+    lz_encode_end (encoder, writer);
+
+    if (source->stats != NULL)
+    {
+        stats_add_tree (source->stats, &encoder->symbols);
+        stats_add_tree (source->stats, &encoder->distances);
+    }
+
+    lz_encoder_free (encoder);
 }
 
 /**********************************************************/
 
 /**
- *  Print statistics about codeword lengths on stderr. This information
- *  is a useful measure of how well the compression performed: short
- *  codewords means good compression. Some codewords will be longer than
- *  the uncompressed byte, but they should be rare, and the average length
- *  will (hopefully) be small.
+ *  Compress the source as a sequence of blocks of the given size,
+ *  followed by the empty block that marks the end of the stream. If
+ *  checksum is true, the blocks hold their checksums, which make up the
+ *  source's. When flushing, input arrives in pieces, which are gathered
+ *  into a block until it is full or a sync point is due.
  */
     PRIVATE void
-print_stats (void)
+squash_blocks (source_t *source, bit_writer_t *writer, size_t block_size,
+  int max_length, bool checksum)
+{
+    const unsigned char *block;
+    unsigned char *gathered = NULL;
+    size_t length, filled = 0;
+    bool sync;
+
+    if (source->flushing)
+        gathered = checked_malloc (block_size);
+
+    while ((length = next_piece (source, &block, block_size - filled)) > 0)
+    {
+        if (gathered == NULL)
+        {
+            code_block (source, writer, block, length, max_length,
+              checksum);
+            continue;
+        }
+
+        memcpy (gathered + filled, block, length);
+        filled += length;
+        sync = sync_due (source);
+
+        if (filled == block_size || sync)
+        {
+            code_block (source, writer, gathered, filled, max_length,
+              checksum);
+            filled = 0;
+        }
+
+        if (sync)
+            sync_output (source, writer, false);
+    }
+
+    if (filled > 0)
+        code_block (source, writer, gathered, filled, max_length, checksum);
+
+    end_blocks (writer, checksum);
+    free (gathered);
+}
+
+/**********************************************************/
+
+/**
+ *  Compress length bytes as a block, and add its checksum to the
+ *  source's if there is one.
+ */
+    PRIVATE void
+code_block (source_t *source, bit_writer_t *writer,
+  const unsigned char *block, size_t length, int max_length, bool checksum)
+{
+    block_stats_t stats;
+    uint32_t crc = encode_block (writer, block, length, max_length,
+      checksum, source->stats != NULL ? &stats : NULL);
+
+    if (checksum)
+        source->crc = crc32c_combine (source->crc, crc, length);
+
+    if (source->stats != NULL)
+        stats_block (source->stats, &stats);
+}
+
+/**********************************************************/
+
+/**
+ *  Take the next piece of the source, of at most size bytes, and add it
+ *  to the checksum. When flushing, the piece is whatever has arrived, and
+ *  stops where the next sync point is due. Returns the length of the
+ *  piece, which is 0 once the input or the source's limit has run out.
+ */
+    PRIVATE size_t
+next_piece (source_t *source, const unsigned char **data, size_t size)
 {
-    unsigned int total_compressed_bits = 0;
-    unsigned int total_codewords = 0;
+    size_t length;
 
-    fprintf (stderr, "bytes compressed: %d\n", bytes_compressed);
-    fprintf (stderr, "codeword length histogram (in bits):\n\n");
+    if (size > source->remaining)
+        size = source->remaining;
 
-    for (int length = 0; length < NUM_CODEWORDS; length ++)
+    if (!source->flushing)
     {
-        fprintf (stderr, "%4d: %10d\n", length, length_histogram [length]);
-        total_compressed_bits += length_histogram [length] * length;
-        total_codewords += length_histogram [length];
+        length = input_read (source->input, data, size);
+    }
+    else
+    {
+        if (source->flush_bytes > 0 &&
+          size > source->flush_bytes - source->unflushed)
+        {
+            size = source->flush_bytes - source->unflushed;
+        }
+        else if (source->flush_bytes == 0 && size > FLUSH_PIECE)
+        {
+            size = FLUSH_PIECE;
+        }
+
+        length = input_read_some (source->input, data, size);
+
+        if (length > 0 && source->unflushed == 0)
+            source->deadline = monotonic_time () + source->flush_time;
+
+        source->unflushed += length;
     }
 
-    fprintf (stderr, "compressed size: %10d bytes\n", 
-      total_compressed_bits / 8);
-    fprintf (stderr, "avg codeword length: %f bits\n", 
-      (double) total_compressed_bits / total_codewords);
+    if (source->checksum)
+        source->crc = crc32c_update (source->crc, *data, length);
+
+    source->remaining -= length;
+    source->taken += length;
+    return length;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns true if a sync point is due, having taken the last piece. When
+ *  flushing by time, the rest of the time is spent waiting for more input,
+ *  and a sync point is only due if none arrives.
+ */
+    PRIVATE bool
+sync_due (source_t *source)
+{
+    uint64_t now;
+
+    if (source->unflushed == 0)
+        return false;
+
+    if (source->flush_bytes > 0)
+        return source->unflushed == source->flush_bytes;
+
+    now = monotonic_time ();
+
+    if (now >= source->deadline)
+        return true;
+
+    // rounded up, so as not to spin on the last fraction of a millisecond.
+    return !input_wait (source->input,
+      (source->deadline - now + 999999) / 1000000);
+}
+
+/**********************************************************/
+
+/**
+ *  Push out everything coded so far, at a sync point. If marker is true,
+ *  an end of stream codeword has just been written, and the sync point
+ *  follows it; otherwise, the output is at the end of a block.
+ */
+    PRIVATE void
+sync_output (source_t *source, bit_writer_t *writer, bool marker)
+{
+    if (marker)
+        write_sync (writer, true);
+
+    writer_flush (writer);
+    source->unflushed = 0;
 }
 
 /**********************************************************/
@@ -0,0 +1,326 @@
+/**
+ *  Statistics for squash and puff. See stats.h.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "utils.h"
+#include "format.h"
+#include "adaptive.h"
+#include "stats.h"
+
+/**********************************************************/
+
+PRIVATE const char * mode_name (int mode);
+PRIVATE double ratio (const stats_t *stats);
+PRIVATE double rate (const stats_t *stats);
+PRIVATE void print_text (const stats_t *stats, const char *program,
+  double seconds []);
+PRIVATE void print_json (const stats_t *stats, const char *program,
+  double seconds []);
+
+// number of times the clock is read to find out how long that takes.
+#define STATS_CLOCK_TRIES   256
+
+// the parts of seconds [] passed to the print functions.
+enum { TOTAL, MODEL, CODING, IO, NUM_TIMES };
+
+/**********************************************************/
+
+/**
+ *  Set up empty statistics, and start the clock.
+ */
+    PUBLIC void
+stats_init (stats_t *stats, bool decoding)
+{
+    uint64_t finish = 0;
+
+    stats->decoding = decoding;
+    stats->mode = -1;
+    stats->bytes_in = 0;
+    stats->bytes_out = 0;
+    stats->symbols = 0;
+    stats->rebuilds = 0;
+    stats->escapes = 0;
+    stats->model_time = 0;
+    stats->io_time = 0;
+    stats->total_time = 0;
+
+    for (int i = 0; i < STATS_LENGTHS; i ++)
+        stats->lengths [i] = 0;
+
+    // the time between two readings of the clock, on average, is what
+    // reading it adds to an update that is timed.
+    stats->start = monotonic_time ();
+
+    for (int i = 0; i < STATS_CLOCK_TRIES; i ++)
+        finish = monotonic_time ();
+
+    stats->clock_cost = (finish - stats->start) / STATS_CLOCK_TRIES;
+
+    stats->start = monotonic_time ();
+}
+
+/**********************************************************/
+
+/**
+ *  Record a codeword of the given length, just before the model is
+ *  updated with its symbol. Returns the time if this update is one of
+ *  those to be timed, or 0 if not; either way, it is to be passed to
+ *  stats_model once the update is done.
+ */
+    PUBLIC uint64_t
+stats_symbol (stats_t *stats, uint64_t length)
+{
+    if (length >= STATS_LENGTHS)
+        length = STATS_LENGTHS - 1;
+
+    stats->lengths [length] += 1;
+    stats->symbols += 1;
+
+    return (stats->symbols % STATS_SAMPLE == 0) ? monotonic_time () : 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Finish timing a model update that started at the time stats_symbol
+ *  returned, if it returned one.
+ */
+    PUBLIC void
+stats_model (stats_t *stats, uint64_t since)
+{
+    uint64_t elapsed;
+
+    if (since == 0)
+        return;
+
+    elapsed = monotonic_time () - since;
+
+    if (elapsed > stats->clock_cost)
+        stats->model_time += (elapsed - stats->clock_cost) * STATS_SAMPLE;
+}
+
+/**********************************************************/
+
+/**
+ *  Add the rebuilds and escapes of a tree that is finished with.
+ */
+    PUBLIC void
+stats_add_tree (stats_t *stats, const adaptive_tree_t *tree)
+{
+    stats->rebuilds += tree->rebuilds;
+    stats->escapes += tree->escapes;
+}
+
+/**********************************************************/
+
+/**
+ *  Add the statistics of a block that has been coded, which also counts
+ *  as one tree built.
+ */
+    PUBLIC void
+stats_block (stats_t *stats, const block_stats_t *block)
+{
+    for (int i = 0; i <= MAX_CODE_LENGTH; i ++)
+    {
+        stats->lengths [i] += block->counts [i];
+        stats->symbols += block->counts [i];
+    }
+
+    stats->rebuilds += 1;
+    stats->model_time += block->model_time;
+}
+
+/**********************************************************/
+
+/**
+ *  Stop the clock, and record the number of bytes read and written, and
+ *  the time spent doing it.
+ */
+    PUBLIC void
+stats_finish (stats_t *stats, uint64_t bytes_in, uint64_t bytes_out,
+  uint64_t io_time)
+{
+    stats->total_time = monotonic_time () - stats->start;
+    stats->bytes_in = bytes_in;
+    stats->bytes_out = bytes_out;
+    stats->io_time = io_time;
+}
+
+/**********************************************************/
+
+/**
+ *  Print the statistics on stderr, as text meant for people, or as a
+ *  single JSON object on a line of its own, meant for monitoring. The
+ *  model update time is not known if no codewords were counted, as when
+ *  the input is empty; then all of the time not spent on I/O counts as
+ *  coding.
+ */
+    PUBLIC void
+stats_print (const stats_t *stats, const char *program, bool json)
+{
+    double seconds [NUM_TIMES];
+    uint64_t model_time = stats->model_time;
+
+    // the estimate can overshoot on a run too short to time properly.
+    if (model_time + stats->io_time > stats->total_time)
+        model_time = stats->total_time - stats->io_time;
+
+    seconds [TOTAL] = stats->total_time / 1e9;
+    seconds [MODEL] = model_time / 1e9;
+    seconds [IO] = stats->io_time / 1e9;
+    seconds [CODING] = seconds [TOTAL] - seconds [MODEL] - seconds [IO];
+
+    if (seconds [CODING] < 0)
+        seconds [CODING] = 0;
+
+    if (json)
+        print_json (stats, program, seconds);
+    else
+        print_text (stats, program, seconds);
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the name of a stream mode, as bench prints it.
+ */
+    PRIVATE const char *
+mode_name (int mode)
+{
+    const char *names [] = { "adaptive", "block", "context", "lz" };
+
+    if (mode < MODE_ADAPTIVE || mode > MODE_LZ)
+        return "unknown";
+
+    return names [mode];
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the compressed size per uncompressed byte, which is 0 for no
+ *  data at all.
+ */
+    PRIVATE double
+ratio (const stats_t *stats)
+{
+    uint64_t uncompressed = stats->decoding ? stats->bytes_out :
+      stats->bytes_in;
+    uint64_t compressed = stats->decoding ? stats->bytes_in :
+      stats->bytes_out;
+
+    return (uncompressed == 0) ? 0 : (double) compressed / uncompressed;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the rate at which uncompressed data went through, in MB/s.
+ */
+    PRIVATE double
+rate (const stats_t *stats)
+{
+    double megabytes = (double) (stats->decoding ? stats->bytes_out :
+      stats->bytes_in) / (1 << 20);
+
+    return (stats->total_time == 0) ? 0 : megabytes * 1e9 /
+      stats->total_time;
+}
+
+/**********************************************************/
+
+/**
+ *  Print the statistics as text, with a line for each codeword length
+ *  that turned up.
+ */
+    PRIVATE void
+print_text (const stats_t *stats, const char *program, double seconds [])
+{
+    uint64_t bits = 0;
+
+    fprintf (stderr, "%s: %s mode\n", program, mode_name (stats->mode));
+    fprintf (stderr, "  bytes in:         %llu\n",
+      (unsigned long long) stats->bytes_in);
+    fprintf (stderr, "  bytes out:        %llu\n",
+      (unsigned long long) stats->bytes_out);
+    fprintf (stderr, "  ratio:            %.4f\n", ratio (stats));
+    fprintf (stderr, "  time:             %.4f s, %.2f MB/s\n",
+      seconds [TOTAL], rate (stats));
+
+    if (stats->symbols > 0)
+        fprintf (stderr, "  model update:     %.4f s\n", seconds [MODEL]);
+
+    fprintf (stderr, "  coding:           %.4f s\n", seconds [CODING]);
+    fprintf (stderr, "  i/o:              %.4f s\n", seconds [IO]);
+    fprintf (stderr, "  tree rebuilds:    %llu\n",
+      (unsigned long long) stats->rebuilds);
+    fprintf (stderr, "  escapes:          %llu\n",
+      (unsigned long long) stats->escapes);
+
+    if (stats->symbols == 0)
+        return;
+
+    fprintf (stderr, "  codeword lengths (in bits):\n");
+
+    for (int length = 0; length < STATS_LENGTHS; length ++)
+    {
+        if (stats->lengths [length] == 0)
+            continue;
+
+        fprintf (stderr, "    %4d%s %12llu\n", length,
+          (length == STATS_LENGTHS - 1) ? "+:" : ": ",
+          (unsigned long long) stats->lengths [length]);
+        bits += stats->lengths [length] * length;
+    }
+
+    fprintf (stderr, "  average codeword: %.3f bits\n",
+      (double) bits / stats->symbols);
+}
+
+/**********************************************************/
+
+/**
+ *  Print the statistics as a JSON object. Times that are not known are
+ *  null, and the histogram maps each length that turned up to its count.
+ */
+    PRIVATE void
+print_json (const stats_t *stats, const char *program, double seconds [])
+{
+    const char *separator = "";
+
+    fprintf (stderr, "{\"program\": \"%s\", \"mode\": \"%s\", "
+      "\"bytes_in\": %llu, \"bytes_out\": %llu, \"ratio\": %.4f, "
+      "\"seconds\": %.6f, \"mb_s\": %.2f, ", program,
+      mode_name (stats->mode), (unsigned long long) stats->bytes_in,
+      (unsigned long long) stats->bytes_out, ratio (stats),
+      seconds [TOTAL], rate (stats));
+
+    if (stats->symbols > 0)
+        fprintf (stderr, "\"model_seconds\": %.6f, ", seconds [MODEL]);
+    else
+        fprintf (stderr, "\"model_seconds\": null, ");
+
+    fprintf (stderr, "\"coding_seconds\": %.6f, \"io_seconds\": %.6f, "
+      "\"rebuilds\": %llu, \"escapes\": %llu, \"codeword_lengths\": {",
+      seconds [CODING], seconds [IO], (unsigned long long) stats->rebuilds,
+      (unsigned long long) stats->escapes);
+
+    for (int length = 0; length < STATS_LENGTHS; length ++)
+    {
+        if (stats->lengths [length] == 0)
+            continue;
+
+        fprintf (stderr, "%s\"%d\": %llu", separator, length,
+          (unsigned long long) stats->lengths [length]);
+        separator = ", ";
+    }
+
+    fprintf (stderr, "}}\n");
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
@@ -0,0 +1,85 @@
+/**
+ *  Statistics for the --stats option of squash and puff: how much data
+ *  went in and came out, how long the codewords were, how often adaptive
+ *  trees were rebuilt and how many symbols were escaped, and where the
+ *  time went. The coding loops take a pointer to a stats_t, which is NULL
+ *  unless the option was given, so that gathering nothing costs a test
+ *  per symbol.
+ *
+ *  Taking the time around every model update would cost more than the
+ *  update itself, so only one update in STATS_SAMPLE is timed, and the
+ *  total is scaled up from those, less the time taken to read the clock.
+ *  Time spent in read() and write() comes from fileio, and whatever is
+ *  left is put down to coding.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include "utils.h"
+#include "huffman.h"
+#include "adaptive.h"
+#include "block.h"
+
+// one model update in this many is timed. It is prime, so that it does
+// not fall into step with aging, which comes round after close to a power
+// of two updates.
+#define STATS_SAMPLE        61
+
+// codewords of this many bits or more are counted together. Only the not
+// seen codeword of a very lopsided tree gets that long.
+#define STATS_LENGTHS       NUM_CODEWORDS
+
+
+typedef struct
+{
+    // whether the data is being decompressed, which makes the output the
+    // uncompressed side, and the mode of the stream, or -1 if it is not
+    // known.
+    bool decoding;
+    int mode;
+
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+
+    // number of codewords of each length in bits, the end of stream
+    // included. A byte escaped to a literal counts as one codeword, as
+    // does a byte escaped from its context. In LZ mode, each literal,
+    // match length and match distance counts as one, with its extra bits.
+    // In block mode, the model time is the time spent building the codes.
+    uint64_t lengths [STATS_LENGTHS];
+    uint64_t symbols;
+
+    // tree rebuilds and escapes, summed over all of the adaptive trees
+    // used. In block mode, each block builds a tree of its own.
+    uint64_t rebuilds;
+    uint64_t escapes;
+
+    // times in nanoseconds: the estimate for model updates, and the time
+    // spent in system calls. The clock starts in stats_init, which also
+    // measures how long reading it takes, so that can be taken off the
+    // updates timed.
+    uint64_t clock_cost;
+    uint64_t model_time;
+    uint64_t io_time;
+    uint64_t start;
+    uint64_t total_time;
+}
+stats_t;
+
+
+void stats_init (stats_t *stats, bool decoding);
+uint64_t stats_symbol (stats_t *stats, uint64_t length);
+void stats_model (stats_t *stats, uint64_t since);
+void stats_add_tree (stats_t *stats, const adaptive_tree_t *tree);
+void stats_block (stats_t *stats, const block_stats_t *block);
+void stats_finish (stats_t *stats, uint64_t bytes_in, uint64_t bytes_out,
+  uint64_t io_time);
+void stats_print (const stats_t *stats, const char *program, bool json);
+
+
+#endif // STATS_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
@@ -0,0 +1,1235 @@
+/**
+ *  Streaming encoder and decoder contexts, built on the same coding
+ *  functions as squash and puff.
+ *
+ *  The encoder codes into an in-memory bit writer, and copies the finished
+ *  bytes out to the caller. It stops taking input once BITIO_BUFFER_SIZE
+ *  bytes of output are waiting, so that a caller with a small output
+ *  buffer does not make the context grow without limit.
+ *
+ *  The decoder copies input into a buffer of its own, and decodes one
+ *  step at a time (a symbol, or a block header). Decoding only ever reads
+ *  the buffer, so if a step runs off the end of the buffered input, the
+ *  step is abandoned and tried again from the same place once more input
+ *  has arrived. The models are only updated after a step succeeds.
+ *
+ *  In a stream with sync points, the decoder reads what follows each end
+ *  of stream codeword to see whether it is a sync point, and if so, goes
+ *  on decoding with the same models.
+ *
+ *  In a seekable stream, both ends start the models again from scratch at
+ *  the start of each segment. The decoder reads the segments one after
+ *  the other, and stops at the index.
+ *
+ *  The decoder adds its output to the checksums at the end of each call,
+ *  and before checking one, so that every byte is added exactly once, no
+ *  matter how often a step has to be tried again.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+#include "huffman.h"
+#include "adaptive.h"
+#include "canonical.h"
+#include "bitio.h"
+#include "format.h"
+#include "block.h"
+#include "context.h"
+#include "lz.h"
+#include "seekable.h"
+#include "checksum.h"
+#include "streamzip.h"
+
+/**********************************************************/
+
+// states of the decoder: what the next step will read.
+#define STATE_HEADER        0
+#define STATE_ADAPTIVE      1
+#define STATE_BLOCK_HEADER  2
+#define STATE_BLOCK_DATA    3
+#define STATE_CONTEXT       4
+#define STATE_LZ            5
+#define STATE_SEGMENT       6
+#define STATE_DONE          7
+#define STATE_ERROR         8
+
+// results of a single decoding step.
+#define STEP_OK             0
+#define STEP_FULL           1
+#define STEP_FAILED         2
+
+// most input handed to the LZ encoder at once.
+#define LZ_CHUNK            4096
+
+/**********************************************************/
+
+struct sz_encoder
+{
+    sz_params_t params;
+    bit_writer_t writer;
+
+    // number of bytes at the start of the writer's buffer that have
+    // already been handed over to the caller.
+    size_t drained;
+    bool ended;
+
+    adaptive_tree_t tree;
+    context_model_t *model;
+    lz_encoder_t *lz;
+
+    // input gathered for the next block, in block mode.
+    unsigned char *block;
+    size_t block_length;
+
+    // in a seekable stream, where each segment started, the total input
+    // so far, and how much of it is in the current segment, if one has
+    // been started.
+    seek_index_t index;
+    uint64_t offset;
+    size_t segment_length;
+    bool in_segment;
+
+    // whether any input has been coded since the last sync point, in the
+    // modes where one costs an end of stream codeword.
+    bool unsynced;
+
+    // checksum of the input in the stream, or the current segment.
+    uint32_t crc;
+};
+
+struct sz_decoder
+{
+    int state;
+
+    // what the header says about the stream.
+    int mode;
+    int flags;
+    int order;
+    int window_bits;
+    int age_bits;
+    int drift_bits;
+
+    // buffered input. The bytes from start to length have not been used
+    // yet, apart from the first offset bits of them.
+    unsigned char buffer [BITIO_BUFFER_SIZE];
+    size_t start;
+    size_t length;
+    int offset;
+
+    adaptive_tree_t tree;
+    context_model_t *model;
+    lz_decoder_t *lz;
+    canonical_decoder_t canonical;
+
+    // number of segments of a seekable stream started so far, which the
+    // index has to agree with.
+    uint32_t segments;
+
+    // bytes of the current block that have not been decoded yet.
+    uint32_t remaining;
+
+    // checksums of the output of the stream or segment, and of the
+    // current block, so far, and the one the block header gave. Only the
+    // first summed bytes of the output of the current call have been
+    // added to them. In block mode, only the block's checksum is worked
+    // out as the output goes by, and it is added to the other once it
+    // has been checked.
+    uint32_t crc;
+    uint32_t block_crc;
+    uint32_t block_checksum;
+    uint32_t block_length;
+    size_t summed;
+};
+
+/**********************************************************/
+
+PRIVATE size_t code_input (sz_encoder_t *encoder,
+  const unsigned char *data, size_t length);
+PRIVATE void code_block (sz_encoder_t *encoder);
+PRIVATE void sync_coding (sz_encoder_t *encoder);
+PRIVATE void start_coding (sz_encoder_t *encoder);
+PRIVATE void finish_coding (sz_encoder_t *encoder);
+PRIVATE size_t drain (sz_encoder_t *encoder, unsigned char *output,
+  size_t capacity);
+PRIVATE int finish_drain (sz_encoder_t *encoder, unsigned char *output,
+  size_t capacity, size_t *produced);
+PRIVATE int decode_step (sz_decoder_t *decoder, bit_reader_t *reader,
+  unsigned char *output, size_t capacity, size_t *produced);
+PRIVATE int read_parameters (sz_decoder_t *decoder, bit_reader_t *reader);
+PRIVATE void start_decoding (sz_decoder_t *decoder);
+PRIVATE int end_or_sync (sz_decoder_t *decoder, bit_reader_t *reader,
+  const unsigned char *output, size_t produced);
+PRIVATE int finish_decoding (sz_decoder_t *decoder, bit_reader_t *reader,
+  const unsigned char *output, size_t produced);
+PRIVATE void add_output (sz_decoder_t *decoder, const unsigned char *output,
+  size_t produced);
+
+/**********************************************************/
+
+/**
+ *  Fill in the default parameters: an adaptive stream, as squash writes
+ *  without any options.
+ */
+    PUBLIC void
+sz_default_params (sz_params_t *params)
+{
+    params->mode = SZ_MODE_ADAPTIVE;
+    params->block_size = DEFAULT_BLOCK_SIZE;
+    params->max_length = DEFAULT_LENGTH_LIMIT;
+    params->order = 1;
+    params->window_bits = LZ_DEFAULT_WINDOW_BITS;
+    params->age_bits = DEFAULT_AGE_BITS;
+    params->drift_bits = DEFAULT_DRIFT_BITS;
+    params->segment_size = 0;
+    params->checksum = 1;
+    params->flush = 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Create an encoder. If params is NULL, the defaults are used. Returns
+ *  NULL if the parameters are not valid.
+ */
+    PUBLIC sz_encoder_t *
+sz_encoder_new (const sz_params_t *params)
+{
+    sz_encoder_t *encoder;
+    sz_params_t defaults;
+
+    if (params == NULL)
+    {
+        sz_default_params (&defaults);
+        params = &defaults;
+    }
+
+    if (params->mode < SZ_MODE_ADAPTIVE || params->mode > SZ_MODE_LZ)
+        return NULL;
+
+    if (params->mode == SZ_MODE_BLOCK && (params->block_size == 0 ||
+      params->block_size > MAX_BLOCK_SIZE ||
+      params->max_length < MIN_LENGTH_LIMIT ||
+      params->max_length > MAX_CODE_LENGTH))
+    {
+        return NULL;
+    }
+
+    if (params->mode == SZ_MODE_CONTEXT &&
+      (params->order < MIN_CONTEXT_ORDER || params->order > MAX_CONTEXT_ORDER))
+    {
+        return NULL;
+    }
+
+    if (params->mode == SZ_MODE_LZ &&
+      (params->window_bits < LZ_MIN_WINDOW_BITS ||
+      params->window_bits > LZ_MAX_WINDOW_BITS))
+    {
+        return NULL;
+    }
+
+    if (params->mode != SZ_MODE_BLOCK &&
+      (params->age_bits < MIN_AGE_BITS || params->age_bits > MAX_AGE_BITS))
+    {
+        return NULL;
+    }
+
+    if (params->mode != SZ_MODE_BLOCK &&
+      (params->drift_bits < NO_DRIFT_BITS ||
+      params->drift_bits > MAX_DRIFT_BITS))
+    {
+        return NULL;
+    }
+
+    if (params->segment_size != 0 &&
+      (params->segment_size < MIN_SEGMENT_SIZE ||
+      params->segment_size > MAX_SEGMENT_SIZE))
+    {
+        return NULL;
+    }
+
+    encoder = checked_malloc (sizeof (sz_encoder_t));
+    encoder->params = *params;
+    encoder->drained = 0;
+    encoder->ended = false;
+    encoder->block = NULL;
+    encoder->block_length = 0;
+    encoder->model = NULL;
+    encoder->lz = NULL;
+    encoder->offset = 0;
+    encoder->segment_length = 0;
+    encoder->in_segment = false;
+    encoder->unsynced = false;
+
+    index_init (&encoder->index);
+    writer_init (&encoder->writer, NULL, false);
+
+    // the library's modes are numbered as in the stream header.
+    write_header (&encoder->writer, params->mode,
+      ((params->segment_size > 0) ? FLAG_SEEKABLE : 0) |
+      (params->checksum ? FLAG_CHECKSUM : 0) |
+      (params->flush ? FLAG_FLUSH : 0) |
+      ((params->mode != SZ_MODE_BLOCK &&
+      params->drift_bits != NO_DRIFT_BITS) ? FLAG_DEFERRED : 0));
+
+    if (params->mode == SZ_MODE_CONTEXT)
+        write_context_order (&encoder->writer, params->order);
+    else if (params->mode == SZ_MODE_LZ)
+        write_window_bits (&encoder->writer, params->window_bits);
+
+    if (params->mode == SZ_MODE_BLOCK)
+        encoder->block = checked_malloc (params->block_size);
+    else
+        write_age_bits (&encoder->writer, params->age_bits);
+
+    if (params->mode != SZ_MODE_BLOCK && params->drift_bits != NO_DRIFT_BITS)
+        write_drift_bits (&encoder->writer, params->drift_bits);
+
+    // the models of a seekable stream are started with each segment.
+    if (params->segment_size == 0)
+        start_coding (encoder);
+
+    return encoder;
+}
+
+/**********************************************************/
+
+/**
+ *  Compress up to length bytes of input, storing up to capacity bytes of
+ *  output. The number of bytes of each actually used is stored in
+ *  *consumed and *produced; input that was not consumed should be passed
+ *  in again. Returns SZ_OK, or SZ_ERROR if the encoder has been ended.
+ */
+    PUBLIC int
+sz_encode (sz_encoder_t *encoder, const void *input, size_t length,
+  void *output, size_t capacity, size_t *consumed, size_t *produced)
+{
+    const unsigned char *data = input;
+    unsigned char *out = output;
+    size_t segment_size = encoder->params.segment_size;
+    size_t used = 0, count;
+
+    *consumed = 0;
+    *produced = 0;
+
+    if (encoder->ended)
+        return SZ_ERROR;
+
+    *produced = drain (encoder, out, capacity);
+
+    while (used < length &&
+      encoder->writer.length - encoder->drained < BITIO_BUFFER_SIZE)
+    {
+        count = length - used;
+
+        // a segment is only started once there is input for it, so that
+        // the last one is never empty.
+        if (segment_size > 0)
+        {
+            if (!encoder->in_segment)
+            {
+                index_add (&encoder->index, encoder->offset,
+                  writer_position (&encoder->writer));
+                write_bits (&encoder->writer, SEGMENT_TAG, 8);
+                start_coding (encoder);
+                encoder->segment_length = 0;
+                encoder->in_segment = true;
+            }
+
+            if (count > segment_size - encoder->segment_length)
+                count = segment_size - encoder->segment_length;
+        }
+
+        count = code_input (encoder, data + used, count);
+
+        // in block mode, the checksum is made up from those of the
+        // blocks.
+        if (encoder->params.checksum &&
+          encoder->params.mode != SZ_MODE_BLOCK)
+        {
+            encoder->crc = crc32c_update (encoder->crc, data + used, count);
+        }
+
+        used += count;
+        encoder->offset += count;
+        encoder->unsynced = true;
+        encoder->segment_length += count;
+
+        if (segment_size > 0 && encoder->segment_length == segment_size)
+        {
+            finish_coding (encoder);
+            encoder->in_segment = false;
+        }
+    }
+
+    *consumed = used;
+    *produced += drain (encoder, out + *produced, capacity - *produced);
+
+    return SZ_OK;
+}
+
+/**********************************************************/
+
+/**
+ *  Push out as much of the input given so far as possible. In block mode,
+ *  the input gathered so far is coded as a block of its own, so that all
+ *  of it can be decoded from the output. In the other modes, if the
+ *  stream was made with the flush parameter, a sync point is written, so
+ *  that all of it can be decoded too; this costs a few bytes, and nothing
+ *  if no input has been given since the last one. Otherwise, only whole
+ *  bytes of output are available; up to 7 bits stay behind until more
+ *  input arrives, or the stream is ended, and in LZ mode, the last
+ *  LZ_MAX_MATCH bytes of input or so stay behind as well, since they may
+ *  still turn out to start a match.
+ *
+ *  Returns SZ_OK once all of the output has been stored, or
+ *  SZ_MORE_OUTPUT if it did not fit, in which case the call should be
+ *  repeated with more space.
+ */
+    PUBLIC int
+sz_encode_flush (sz_encoder_t *encoder, void *output, size_t capacity,
+  size_t *produced)
+{
+    if (!encoder->ended && encoder->block_length > 0)
+        code_block (encoder);
+
+    if (!encoder->ended && encoder->params.flush && encoder->unsynced &&
+      encoder->params.mode != SZ_MODE_BLOCK)
+    {
+        sync_coding (encoder);
+    }
+
+    return finish_drain (encoder, output, capacity, produced);
+}
+
+/**********************************************************/
+
+/**
+ *  End the stream, and store the rest of the output. Returns SZ_OK once
+ *  all of the output has been stored, or SZ_MORE_OUTPUT if it did not
+ *  fit, in which case the call should be repeated with more space. No
+ *  more input may be given afterwards.
+ */
+    PUBLIC int
+sz_encode_end (sz_encoder_t *encoder, void *output, size_t capacity,
+  size_t *produced)
+{
+    if (!encoder->ended)
+    {
+        if (encoder->params.segment_size == 0 || encoder->in_segment)
+            finish_coding (encoder);
+
+        if (encoder->params.segment_size > 0)
+            write_index (&encoder->writer, &encoder->index, encoder->offset);
+
+        encoder->in_segment = false;
+        encoder->ended = true;
+    }
+
+    return finish_drain (encoder, output, capacity, produced);
+}
+
+/**********************************************************/
+
+/**
+ *  Release an encoder, and everything it holds.
+ */
+    PUBLIC void
+sz_encoder_free (sz_encoder_t *encoder)
+{
+    if (encoder == NULL)
+        return;
+
+    writer_free (&encoder->writer);
+    index_free (&encoder->index);
+    context_free (encoder->model);
+    lz_encoder_free (encoder->lz);
+    free (encoder->block);
+    free (encoder);
+}
+
+/**********************************************************/
+
+/**
+ *  Code up to length bytes of input, and return the number of bytes used.
+ *  Adaptive and context modes only take one byte at a time, and LZ mode a
+ *  small piece, so that sz_encode checks on the output waiting often
+ *  enough.
+ */
+    PRIVATE size_t
+code_input (sz_encoder_t *encoder, const unsigned char *data, size_t length)
+{
+    size_t count;
+
+    if (encoder->params.mode == SZ_MODE_ADAPTIVE)
+    {
+        adaptive_write (&encoder->tree, &encoder->writer, data [0]);
+        adaptive_update (&encoder->tree, data [0]);
+        return 1;
+    }
+
+    if (encoder->params.mode == SZ_MODE_CONTEXT)
+    {
+        context_write (encoder->model, &encoder->writer, data [0]);
+        context_update (encoder->model, data [0]);
+        return 1;
+    }
+
+    if (encoder->params.mode == SZ_MODE_LZ)
+    {
+        count = (length < LZ_CHUNK) ? length : LZ_CHUNK;
+        lz_encode (encoder->lz, &encoder->writer, data, count);
+        return count;
+    }
+
+    count = encoder->params.block_size - encoder->block_length;
+
+    if (count > length)
+        count = length;
+
+    memcpy (encoder->block + encoder->block_length, data, count);
+    encoder->block_length += count;
+
+    if (encoder->block_length == encoder->params.block_size)
+        code_block (encoder);
+
+    return count;
+}
+
+/**********************************************************/
+
+/**
+ *  Code the input gathered so far as a block, and add its checksum to that
+ *  of the stream or segment.
+ */
+    PRIVATE void
+code_block (sz_encoder_t *encoder)
+{
+    uint32_t crc = encode_block (&encoder->writer, encoder->block,
+      encoder->block_length, encoder->params.max_length,
+      encoder->params.checksum, NULL);
+
+    if (encoder->params.checksum)
+    {
+        encoder->crc = crc32c_combine (encoder->crc, crc,
+          encoder->block_length);
+    }
+
+    encoder->block_length = 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Code whatever input is still held back, and the end of stream codeword
+ *  followed by a sync point. The models carry on from there.
+ */
+    PRIVATE void
+sync_coding (sz_encoder_t *encoder)
+{
+    if (encoder->params.mode == SZ_MODE_CONTEXT)
+        context_write (encoder->model, &encoder->writer, END_OF_STREAM);
+    else if (encoder->params.mode == SZ_MODE_LZ)
+        lz_encode_end (encoder->lz, &encoder->writer);
+    else
+        adaptive_write (&encoder->tree, &encoder->writer, END_OF_STREAM);
+
+    write_sync (&encoder->writer, true);
+    encoder->unsynced = false;
+}
+
+/**********************************************************/
+
+/**
+ *  Start the models from scratch, at the start of the stream or of a
+ *  segment.
+ */
+    PRIVATE void
+start_coding (sz_encoder_t *encoder)
+{
+    const sz_params_t *params = &encoder->params;
+
+    encoder->crc = 0;
+
+    if (params->mode == SZ_MODE_CONTEXT)
+    {
+        context_free (encoder->model);
+        encoder->model = context_new (params->order, params->age_bits,
+          params->drift_bits);
+    }
+    else if (params->mode == SZ_MODE_LZ)
+    {
+        lz_encoder_free (encoder->lz);
+        encoder->lz = lz_encoder_new (params->window_bits, params->age_bits,
+          params->drift_bits);
+    }
+    else if (params->mode == SZ_MODE_ADAPTIVE)
+    {
+        adaptive_init (&encoder->tree, params->age_bits,
+          params->drift_bits);
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Code whatever input is still held back, and the end of the stream or
+ *  segment, and pad the output to a byte boundary, followed by the
+ *  checksum if there is one.
+ */
+    PRIVATE void
+finish_coding (sz_encoder_t *encoder)
+{
+    if (encoder->params.mode == SZ_MODE_BLOCK)
+    {
+        if (encoder->block_length > 0)
+            code_block (encoder);
+
+        end_blocks (&encoder->writer, encoder->params.checksum);
+    }
+    else if (encoder->params.mode == SZ_MODE_CONTEXT)
+    {
+        context_write (encoder->model, &encoder->writer, END_OF_STREAM);
+    }
+    else if (encoder->params.mode == SZ_MODE_LZ)
+    {
+        lz_encode_end (encoder->lz, &encoder->writer);
+    }
+    else
+    {
+        adaptive_write (&encoder->tree, &encoder->writer, END_OF_STREAM);
+    }
+
+    if (encoder->params.flush && encoder->params.mode != SZ_MODE_BLOCK)
+        write_sync (&encoder->writer, false);
+
+    writer_align (&encoder->writer);
+    encoder->unsynced = false;
+
+    if (encoder->params.checksum)
+        write_bits (&encoder->writer, encoder->crc, 32);
+}
+
+/**********************************************************/
+
+/**
+ *  Copy as much waiting output as will fit into the caller's buffer, and
+ *  returns the number of bytes copied.
+ */
+    PRIVATE size_t
+drain (sz_encoder_t *encoder, unsigned char *output, size_t capacity)
+{
+    size_t count = encoder->writer.length - encoder->drained;
+
+    if (count > capacity)
+        count = capacity;
+
+    if (count > 0)
+    {
+        memcpy (output, encoder->writer.buffer + encoder->drained, count);
+        encoder->drained += count;
+    }
+
+    // once everything has been handed over, the writer can start filling
+    // its buffer from the beginning again.
+    if (encoder->drained == encoder->writer.length)
+    {
+        encoder->writer.flushed += encoder->writer.length;
+        encoder->writer.length = 0;
+        encoder->drained = 0;
+    }
+
+    return count;
+}
+
+/**********************************************************/
+
+/**
+ *  Drain the output for sz_encode_flush and sz_encode_end, and work out
+ *  what they should return.
+ */
+    PRIVATE int
+finish_drain (sz_encoder_t *encoder, unsigned char *output, size_t capacity,
+  size_t *produced)
+{
+    *produced = drain (encoder, output, capacity);
+
+    if (encoder->writer.length > encoder->drained)
+        return SZ_MORE_OUTPUT;
+
+    return SZ_OK;
+}
+
+/**********************************************************/
+
+/**
+ *  Create a decoder. The mode of the stream is read from its header.
+ */
+    PUBLIC sz_decoder_t *
+sz_decoder_new (void)
+{
+    sz_decoder_t *decoder = checked_malloc (sizeof (sz_decoder_t));
+
+    decoder->state = STATE_HEADER;
+    decoder->mode = MODE_ADAPTIVE;
+    decoder->flags = 0;
+    decoder->start = 0;
+    decoder->length = 0;
+    decoder->offset = 0;
+    decoder->remaining = 0;
+    decoder->segments = 0;
+    decoder->crc = 0;
+    decoder->block_crc = 0;
+    decoder->block_checksum = 0;
+    decoder->block_length = 0;
+    decoder->model = NULL;
+    decoder->lz = NULL;
+
+    return decoder;
+}
+
+/**********************************************************/
+
+/**
+ *  Decompress up to length bytes of input, storing up to capacity bytes of
+ *  output. The number of bytes of each actually used is stored in
+ *  *consumed and *produced; input that was not consumed should be passed
+ *  in again. When the output fills up, the call should be repeated even
+ *  if there is no more input, since the decoder may be holding input that
+ *  it has not decoded yet.
+ *
+ *  Returns SZ_END once the end of the stream has been decoded, SZ_ERROR
+ *  if the stream is corrupt, or SZ_OK otherwise. A stream whose input
+ *  runs out before SZ_END is returned has been truncated.
+ */
+    PUBLIC int
+sz_decode (sz_decoder_t *decoder, const void *input, size_t length,
+  void *output, size_t capacity, size_t *consumed, size_t *produced)
+{
+    bit_reader_t reader;
+    uint64_t mark;
+    size_t count;
+    int result;
+
+    *consumed = 0;
+    *produced = 0;
+    decoder->summed = 0;
+
+    if (decoder->state == STATE_ERROR)
+        return SZ_ERROR;
+
+    if (decoder->state == STATE_DONE)
+        return SZ_END;
+
+    // move the input that is left over to the front of the buffer, and
+    // add as much new input as will fit after it.
+    memmove (decoder->buffer, decoder->buffer + decoder->start,
+      decoder->length - decoder->start);
+    decoder->length -= decoder->start;
+    decoder->start = 0;
+
+    count = sizeof (decoder->buffer) - decoder->length;
+
+    if (count > length)
+        count = length;
+
+    if (count > 0)
+    {
+        memcpy (decoder->buffer + decoder->length, input, count);
+        decoder->length += count;
+        *consumed = count;
+    }
+
+    reader_init_memory (&reader, decoder->buffer, decoder->length);
+
+    if (decoder->offset > 0)
+    {
+        peek_bits (&reader, decoder->offset);
+        skip_bits (&reader, decoder->offset);
+    }
+
+    mark = reader.consumed;
+
+    while (decoder->state != STATE_DONE)
+    {
+        result = decode_step (decoder, &reader, output, capacity, produced);
+
+        if (result == STEP_FULL)
+            break;
+
+        // a step that read past the end of the input we have so far may
+        // just need more input; one that failed anywhere else never will.
+        if (result == STEP_FAILED)
+        {
+            if (reader.padding == 0)
+                decoder->state = STATE_ERROR;
+
+            break;
+        }
+
+        mark = reader.consumed;
+    }
+
+    decoder->start = mark / 8;
+    decoder->offset = mark % 8;
+    add_output (decoder, output, *produced);
+
+    if (decoder->state == STATE_ERROR)
+        return SZ_ERROR;
+
+    if (decoder->state == STATE_DONE)
+        return SZ_END;
+
+    return SZ_OK;
+}
+
+/**********************************************************/
+
+/**
+ *  Release a decoder.
+ */
+    PUBLIC void
+sz_decoder_free (sz_decoder_t *decoder)
+{
+    if (decoder == NULL)
+        return;
+
+    context_free (decoder->model);
+    lz_decoder_free (decoder->lz);
+    free (decoder);
+}
+
+/**********************************************************/
+
+/**
+ *  Decompress capacity bytes, starting at the given uncompressed offset,
+ *  from a whole seekable stream held in memory, and store the number of
+ *  bytes decoded in *produced. Only the segments that hold those bytes are
+ *  decoded. Returns SZ_OK if the output was filled, SZ_END if the stream
+ *  ended first, or SZ_ERROR if the stream is corrupt or not seekable.
+ */
+    PUBLIC int
+sz_decode_range (const void *stream, size_t length, uint64_t offset,
+  void *output, size_t capacity, size_t *produced)
+{
+    const unsigned char *data = stream;
+    unsigned char *out = output, *target, *scratch;
+    sz_decoder_t *decoder;
+    seek_index_t index;
+    size_t position, consumed, made, room;
+    uint64_t skip;
+    uint32_t segment;
+    int result;
+
+    *produced = 0;
+
+    if (read_index (data, length, &index) == -1)
+        return SZ_ERROR;
+
+    // decoding with no room for output reads the header, and with it the
+    // parameters the segments are coded with.
+    decoder = sz_decoder_new ();
+    result = sz_decode (decoder, data, length, NULL, 0, &consumed, &made);
+
+    if (result == SZ_ERROR || (decoder->flags & FLAG_SEEKABLE) == 0 ||
+      offset >= index.length)
+    {
+        sz_decoder_free (decoder);
+        index_free (&index);
+        return (result == SZ_ERROR) ? SZ_ERROR : SZ_END;
+    }
+
+    segment = find_segment (&index, offset);
+    position = index.entries [segment].position;
+    skip = offset - index.entries [segment].offset;
+    index_free (&index);
+
+    // carry on from the start of the segment, as if the ones before it
+    // had just been decoded. The bytes of the segment before the offset
+    // are decoded into scratch space, and thrown away.
+    decoder->state = STATE_SEGMENT;
+    decoder->segments = segment;
+    decoder->start = 0;
+    decoder->length = 0;
+    decoder->offset = 0;
+
+    scratch = checked_malloc (BITIO_BUFFER_SIZE);
+    result = SZ_OK;
+
+    while (result == SZ_OK && *produced < capacity)
+    {
+        target = (skip > 0) ? scratch : out + *produced;
+        room = (skip > 0) ? ((skip < BITIO_BUFFER_SIZE) ? skip :
+          BITIO_BUFFER_SIZE) : capacity - *produced;
+
+        result = sz_decode (decoder, data + position, length - position,
+          target, room, &consumed, &made);
+        position += consumed;
+
+        if (skip > 0)
+            skip -= made;
+        else
+            *produced += made;
+
+        // a call that does nothing at all can only mean the stream ends
+        // part way through a segment.
+        if (result == SZ_OK && consumed == 0 && made == 0)
+            result = SZ_ERROR;
+    }
+
+    free (scratch);
+    sz_decoder_free (decoder);
+
+    if (result == SZ_ERROR)
+        return SZ_ERROR;
+
+    return (*produced == capacity) ? SZ_OK : SZ_END;
+}
+
+/**********************************************************/
+
+/**
+ *  Decode the next item of the stream: the header, a symbol or the header
+ *  of a block. The decoder's state is only changed if the whole item could
+ *  be read. Returns STEP_OK, STEP_FULL if there is no room for the next
+ *  byte of output, or STEP_FAILED.
+ */
+    PRIVATE int
+decode_step (sz_decoder_t *decoder, bit_reader_t *reader,
+  unsigned char *output, size_t capacity, size_t *produced)
+{
+    block_header_t header;
+    uint8_t lengths [NUM_SYMBOLS];
+    lz_token_t token;
+    uint32_t count;
+    int symbol;
+
+    switch (decoder->state)
+    {
+    case STATE_HEADER:
+        if (read_parameters (decoder, reader) == -1)
+            return STEP_FAILED;
+
+        if (decoder->flags & FLAG_SEEKABLE)
+            decoder->state = STATE_SEGMENT;
+        else
+            start_decoding (decoder);
+
+        return STEP_OK;
+
+    // the index must count as many segments as there were, so that a
+    // stream cut short at the end of a segment is not taken for a whole
+    // one.
+    case STATE_SEGMENT:
+        symbol = read_bits (reader, 8);
+
+        if (symbol == SEGMENT_TAG)
+        {
+            decoder->segments += 1;
+            start_decoding (decoder);
+        }
+        else if (symbol == INDEX_TAG && read_u32 (reader, &count) == 0 &&
+          count == decoder->segments)
+        {
+            decoder->state = STATE_DONE;
+        }
+        else
+        {
+            return STEP_FAILED;
+        }
+
+        return STEP_OK;
+
+    case STATE_ADAPTIVE:
+        if (*produced == capacity)
+            return STEP_FULL;
+
+        if ((symbol = adaptive_read (&decoder->tree, reader)) == DECODE_ERROR)
+            return STEP_FAILED;
+
+        if (symbol == END_OF_STREAM)
+            return end_or_sync (decoder, reader, output, *produced);
+
+        output [(*produced) ++] = symbol;
+        adaptive_update (&decoder->tree, symbol);
+        return STEP_OK;
+
+    case STATE_CONTEXT:
+        if (*produced == capacity)
+            return STEP_FULL;
+
+        if ((symbol = context_read (decoder->model, reader)) == DECODE_ERROR)
+            return STEP_FAILED;
+
+        if (symbol == END_OF_STREAM)
+            return end_or_sync (decoder, reader, output, *produced);
+
+        output [(*produced) ++] = symbol;
+        context_update (decoder->model, symbol);
+        return STEP_OK;
+
+    // the bytes a token stands for are handed out before the next token
+    // is read, as many at a time as there is room for.
+    case STATE_LZ:
+        if (decoder->lz->delivered < decoder->lz->position)
+        {
+            if (*produced == capacity)
+                return STEP_FULL;
+
+            *produced += lz_drain (decoder->lz, output + *produced,
+              capacity - *produced);
+            return STEP_OK;
+        }
+
+        if ((symbol = lz_read (decoder->lz, reader, &token)) == DECODE_ERROR)
+            return STEP_FAILED;
+
+        if (symbol == END_OF_STREAM)
+            return end_or_sync (decoder, reader, output, *produced);
+
+        lz_apply (decoder->lz, &token);
+        return STEP_OK;
+
+    case STATE_BLOCK_HEADER:
+        if (read_block_header (reader, &header,
+          (decoder->flags & FLAG_CHECKSUM) != 0) == -1)
+        {
+            return STEP_FAILED;
+        }
+
+        if (header.length == 0)
+            return finish_decoding (decoder, reader, output, *produced);
+
+        if (read_code_lengths (reader, lengths) == -1 ||
+          canonical_decoder_init (&decoder->canonical, lengths) == -1)
+        {
+            return STEP_FAILED;
+        }
+
+        // the checksum of the block is started from the next byte of
+        // output on.
+        add_output (decoder, output, *produced);
+        decoder->block_crc = 0;
+        decoder->block_checksum = header.checksum;
+        decoder->block_length = header.length;
+        decoder->remaining = header.length;
+        decoder->state = STATE_BLOCK_DATA;
+        return STEP_OK;
+
+    case STATE_BLOCK_DATA:
+        if (decoder->remaining == 0)
+        {
+            if (reader_align (reader) == -1)
+                return STEP_FAILED;
+
+            add_output (decoder, output, *produced);
+
+            if (decoder->flags & FLAG_CHECKSUM)
+            {
+                if (decoder->block_crc != decoder->block_checksum)
+                    return STEP_FAILED;
+
+                decoder->crc = crc32c_combine (decoder->crc,
+                  decoder->block_crc, decoder->block_length);
+            }
+
+            decoder->state = STATE_BLOCK_HEADER;
+            return STEP_OK;
+        }
+
+        if (*produced == capacity)
+            return STEP_FULL;
+
+        if ((symbol = canonical_decode (&decoder->canonical, reader)) < 0)
+            return STEP_FAILED;
+
+        output [(*produced) ++] = symbol;
+        decoder->remaining -= 1;
+        return STEP_OK;
+    }
+
+    return STEP_FAILED;
+}
+
+/**********************************************************/
+
+/**
+ *  Read the stream header, and the parameters that follow it, into the
+ *  decoder. Returns 0, or -1 if they are not valid or the input ends.
+ */
+    PRIVATE int
+read_parameters (sz_decoder_t *decoder, bit_reader_t *reader)
+{
+    if ((decoder->mode = read_header (reader, &decoder->flags)) == -1)
+        return -1;
+
+    if (decoder->mode == MODE_CONTEXT &&
+      (decoder->order = read_context_order (reader)) == -1)
+    {
+        return -1;
+    }
+
+    if (decoder->mode == MODE_LZ &&
+      (decoder->window_bits = read_window_bits (reader)) == -1)
+    {
+        return -1;
+    }
+
+    if (decoder->mode != MODE_BLOCK &&
+      (decoder->age_bits = read_age_bits (reader)) == -1)
+    {
+        return -1;
+    }
+
+    decoder->drift_bits = NO_DRIFT_BITS;
+
+    if ((decoder->flags & FLAG_DEFERRED) && (decoder->mode == MODE_BLOCK ||
+      (decoder->drift_bits = read_drift_bits (reader)) == -1))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**********************************************************/
+
+/**
+ *  Start the models from scratch, at the start of the stream or of a
+ *  segment, and go on to decode its first item.
+ */
+    PRIVATE void
+start_decoding (sz_decoder_t *decoder)
+{
+    decoder->crc = 0;
+
+    if (decoder->mode == MODE_BLOCK)
+    {
+        decoder->state = STATE_BLOCK_HEADER;
+    }
+    else if (decoder->mode == MODE_CONTEXT)
+    {
+        context_free (decoder->model);
+        decoder->model = context_new (decoder->order, decoder->age_bits,
+          decoder->drift_bits);
+        decoder->state = STATE_CONTEXT;
+    }
+    else if (decoder->mode == MODE_LZ)
+    {
+        lz_decoder_free (decoder->lz);
+        decoder->lz = lz_decoder_new (decoder->window_bits,
+          decoder->age_bits, decoder->drift_bits);
+        decoder->state = STATE_LZ;
+    }
+    else
+    {
+        adaptive_init (&decoder->tree, decoder->age_bits,
+          decoder->drift_bits);
+        decoder->state = STATE_ADAPTIVE;
+    }
+}
+
+/**********************************************************/
+
+/**
+ *  Deal with an end of stream codeword in adaptive, context or LZ mode,
+ *  which in a stream with sync points may mark one of them instead, in
+ *  which case decoding carries on as it was. Returns STEP_OK, or
+ *  STEP_FAILED if what follows the codeword could not be read, or is not
+ *  valid.
+ */
+    PRIVATE int
+end_or_sync (sz_decoder_t *decoder, bit_reader_t *reader,
+  const unsigned char *output, size_t produced)
+{
+    int result = END_OF_STREAM;
+
+    if (decoder->flags & FLAG_FLUSH)
+        result = read_sync (reader);
+
+    if (result == SYNC_POINT)
+        return STEP_OK;
+
+    if (result == DECODE_ERROR)
+        return STEP_FAILED;
+
+    return finish_decoding (decoder, reader, output, produced);
+}
+
+/**********************************************************/
+
+/**
+ *  Deal with the end of the stream, or in a seekable stream, the end of a
+ *  segment, which is padded to a byte boundary and followed by its
+ *  checksum, if it has one. The first produced bytes of output are the
+ *  output of the current call so far. Returns STEP_OK, or STEP_FAILED if
+ *  the padding or checksum could not be read, or the checksum does not
+ *  match.
+ */
+    PRIVATE int
+finish_decoding (sz_decoder_t *decoder, bit_reader_t *reader,
+  const unsigned char *output, size_t produced)
+{
+    uint32_t checksum;
+
+    if (decoder->flags & FLAG_CHECKSUM)
+    {
+        if (reader_align (reader) == -1 ||
+          read_u32 (reader, &checksum) == -1)
+        {
+            return STEP_FAILED;
+        }
+
+        add_output (decoder, output, produced);
+
+        if (checksum != decoder->crc)
+            return STEP_FAILED;
+    }
+
+    if ((decoder->flags & FLAG_SEEKABLE) == 0)
+    {
+        decoder->state = STATE_DONE;
+        return STEP_OK;
+    }
+
+    if (reader_align (reader) == -1)
+        return STEP_FAILED;
+
+    decoder->state = STATE_SEGMENT;
+    return STEP_OK;
+}
+
+/**********************************************************/
+
+/**
+ *  Add the output of the current call that has not been added to the
+ *  checksum yet, up to the first produced bytes, to it: to that of the
+ *  block in block mode, or of the stream or segment otherwise.
+ */
+    PRIVATE void
+add_output (sz_decoder_t *decoder, const unsigned char *output,
+  size_t produced)
+{
+    size_t length = produced - decoder->summed;
+
+    if ((decoder->flags & FLAG_CHECKSUM) == 0 || length == 0)
+        return;
+
+    if (decoder->mode == MODE_BLOCK)
+    {
+        decoder->block_crc = crc32c_update (decoder->block_crc,
+          output + decoder->summed, length);
+    }
+    else
+    {
+        decoder->crc = crc32c_update (decoder->crc,
+          output + decoder->summed, length);
+    }
+
+    decoder->summed = produced;
+}
+
+/**********************************************************/
+
+/** vim: set ts=4 sw=4 et : */
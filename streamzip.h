@@ -0,0 +1,137 @@
+/**
+ *  libstreamzip: compression and decompression of squash streams from
+ *  memory to memory, for programs that want to embed the compressor
+ *  rather than run squash and puff.
+ *
+ *  All of the state for a stream is held in an encoder or decoder
+ *  context, so any number of streams may be in progress at once, from any
+ *  number of threads, as long as each context is only used by one thread
+ *  at a time.
+ *
+ *  The coding calls take whatever input and output space they are given,
+ *  and report how much of each they used. Any output that did not fit is
+ *  kept in the context, and handed over by the next call.
+ *
+ *  A stream can also be made seekable, by coding it in segments that can
+ *  each be decoded on their own, and ending it with an index of where the
+ *  segments start. sz_decode_range then decodes any part of such a stream
+ *  without having to decode everything before it.
+ *
+ *  Unless told otherwise, the encoder stores checksums of the data, and
+ *  the decoder fails with SZ_ERROR if what it decodes does not match them.
+ *
+ *  A stream made with the flush parameter set may hold sync points, which
+ *  sz_encode_flush writes, at which the encoder pushes out everything it
+ *  has been given so far. The decoder can decode all of it from the
+ *  output up to there, without seeing any more of the stream. A seekable
+ *  stream may have sync points too, which fall inside its segments, and
+ *  its ranges can still be decoded; squash cannot make such streams, but
+ *  puff decodes them like any other.
+ */
+
+#ifndef STREAMZIP_H
+#define STREAMZIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// only the functions declared here are exported from the shared library.
+#define SZ_EXPORT           __attribute__ ((visibility ("default")))
+
+// the modes a stream may be compressed in; see format.h.
+#define SZ_MODE_ADAPTIVE    0
+#define SZ_MODE_BLOCK       1
+#define SZ_MODE_CONTEXT     2
+#define SZ_MODE_LZ          3
+
+// range of the age limit, in bits; see adaptive.h.
+#define SZ_MIN_AGE_BITS     10
+#define SZ_MAX_AGE_BITS     30
+
+// largest drift limit, in bits; see adaptive.h.
+#define SZ_MAX_DRIFT_BITS   12
+
+// range of the LZ window size, in bits; see lz.h.
+#define SZ_MIN_WINDOW_BITS  10
+#define SZ_MAX_WINDOW_BITS  24
+
+// range of the segment size of a seekable stream; see seekable.h.
+#define SZ_MIN_SEGMENT_SIZE 1024
+#define SZ_MAX_SEGMENT_SIZE (1 << 30)
+
+// results returned by the coding calls.
+#define SZ_OK               0
+#define SZ_END              1
+#define SZ_MORE_OUTPUT      2
+#define SZ_ERROR            (-1)
+
+
+typedef struct
+{
+    // SZ_MODE_ADAPTIVE, SZ_MODE_BLOCK, SZ_MODE_CONTEXT or SZ_MODE_LZ.
+    int mode;
+
+    // size of each block, and the longest codeword allowed in a block.
+    // Only used in block mode.
+    size_t block_size;
+    int max_length;
+
+    // order of the context model, 1 or 2. Only used in context mode.
+    int order;
+
+    // size of the window matches are found in is 2^window_bits bytes.
+    // Only used in LZ mode.
+    int window_bits;
+
+    // adaptive trees are aged when their total weight reaches 2^age_bits.
+    // Used in adaptive, context and LZ modes.
+    int age_bits;
+
+    // if non-zero, adaptive trees defer their updates, and are rebuilt
+    // whenever the symbols coded since the last rebuild come to
+    // 1/2^drift_bits of their total weight; see adaptive.h. If 0, they are
+    // updated after every symbol. Used in adaptive, context and LZ modes.
+    int drift_bits;
+
+    // uncompressed size of each segment of a seekable stream, or 0 for a
+    // stream that can only be decoded from the start.
+    size_t segment_size;
+
+    // non-zero to store checksums of the data; see checksum.h.
+    int checksum;
+
+    // non-zero to let sz_encode_flush write sync points; see format.h.
+    // This may be combined with a segment size.
+    int flush;
+}
+sz_params_t;
+
+typedef struct sz_encoder sz_encoder_t;
+typedef struct sz_decoder sz_decoder_t;
+
+
+SZ_EXPORT void sz_default_params (sz_params_t *params);
+
+SZ_EXPORT sz_encoder_t * sz_encoder_new (const sz_params_t *params);
+SZ_EXPORT int sz_encode (sz_encoder_t *encoder, const void *input,
+  size_t length, void *output, size_t capacity, size_t *consumed,
+  size_t *produced);
+SZ_EXPORT int sz_encode_flush (sz_encoder_t *encoder, void *output,
+  size_t capacity, size_t *produced);
+SZ_EXPORT int sz_encode_end (sz_encoder_t *encoder, void *output,
+  size_t capacity, size_t *produced);
+SZ_EXPORT void sz_encoder_free (sz_encoder_t *encoder);
+
+SZ_EXPORT sz_decoder_t * sz_decoder_new (void);
+SZ_EXPORT int sz_decode (sz_decoder_t *decoder, const void *input,
+  size_t length, void *output, size_t capacity, size_t *consumed,
+  size_t *produced);
+SZ_EXPORT void sz_decoder_free (sz_decoder_t *decoder);
+
+SZ_EXPORT int sz_decode_range (const void *stream, size_t length,
+  uint64_t offset, void *output, size_t capacity, size_t *produced);
+
+
+#endif // STREAMZIP_H
+
+/** vim: set ft=c ts=4 sw=4 et : */
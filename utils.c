@@ -1,24 +1,136 @@
-#include <assert.h>
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
 
 #include "utils.h"
 
 /**********************************************************/
 
+PRIVATE void out_of_memory (size_t bytes);
+
+/**********************************************************/
+
 /**
  *  Wrapper to malloc that will abort the program if malloc returns null.
- *  We will use assert() to test the return value, so this function will
- *  only catch nulls if NDEBUG is *not* #define'd. See the man page for
- *  assert() for more details on the reasoning behind this design.
+ *  Unlike an assert(), the check stays in place when NDEBUG is defined,
+ *  so release builds fail loudly rather than dereferencing null.
  */
     PUBLIC void * 
 checked_malloc (size_t bytes) 
 {
 	void *mem = malloc (bytes);
-	assert (mem != NULL);
+
+	if (mem == NULL)
+		out_of_memory (bytes);
+
 	return mem;
 }
 
 /**********************************************************/
 
+/**
+ *  Wrapper to realloc that will abort the program if realloc returns
+ *  null, in the same way as checked_malloc.
+ */
+    PUBLIC void *
+checked_realloc (void *mem, size_t bytes)
+{
+    mem = realloc (mem, bytes);
+
+    if (mem == NULL)
+        out_of_memory (bytes);
+
+    return mem;
+}
+
+/**********************************************************/
+
+/**
+ *  Allocate memory whose address is a multiple of alignment, which must be
+ *  a power of two and a multiple of the size of a pointer. The memory is
+ *  released with free. Aborts the program if it cannot be allocated.
+ */
+    PUBLIC void *
+checked_aligned_malloc (size_t alignment, size_t bytes)
+{
+    void *mem;
+
+    if (posix_memalign (&mem, alignment, bytes) != 0)
+        out_of_memory (bytes);
+
+    return mem;
+}
+
+/**********************************************************/
+
+/**
+ *  Parse a positive number of bytes, which may be followed by a k, m or g
+ *  suffix (in either case) to multiply it by 2^10, 2^20 or 2^30. Returns
+ *  -1 if the text is not a valid size.
+ */
+    PUBLIC long long
+parse_size (const char *text)
+{
+    char *end;
+    long long size = strtoll (text, &end, 10);
+
+    if (end == text || size <= 0 || size >= (1LL << 32))
+        return -1;
+
+    switch (*end)
+    {
+    case 'k': case 'K':
+        size <<= 10;
+        end += 1;
+        break;
+
+    case 'm': case 'M':
+        size <<= 20;
+        end += 1;
+        break;
+
+    case 'g': case 'G':
+        size <<= 30;
+        end += 1;
+        break;
+    }
+
+    if (*end != '\0')
+        return -1;
+
+    return size;
+}
+
+/**********************************************************/
+
+/**
+ *  Returns the time from a monotonic clock, in nanoseconds. Only the
+ *  difference between two times means anything.
+ */
+    PUBLIC uint64_t
+monotonic_time (void)
+{
+    struct timespec time;
+
+    clock_gettime (CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/**********************************************************/
+
+/**
+ *  Report a failed allocation, and abort.
+ */
+    PRIVATE void
+out_of_memory (size_t bytes)
+{
+    fprintf (stderr, "Out of memory allocating %zu bytes.\n", bytes);
+    abort ();
+}
+
+/**********************************************************/
+
 /** vim: set ts=4 sw=4 et : */
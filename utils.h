@@ -2,6 +2,7 @@
 #define _UTILS_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 
 /** constants that may be used to specify the scope of functions. */
 #define PUBLIC
@@ -14,9 +15,21 @@ typedef int bool;
 #define false           0
 
 
-/** wrapper to malloc that aborts if malloc returns null. */
+/** wrapper to malloc that aborts if malloc returns null, even with NDEBUG. */
 void * checked_malloc(size_t bytes);
 
+/** wrapper to realloc that aborts if realloc returns null. */
+void * checked_realloc (void *mem, size_t bytes);
+
+/** allocate memory aligned to a power of two, aborting if that fails. */
+void * checked_aligned_malloc (size_t alignment, size_t bytes);
+
+/** parse a size such as 4096, 64k or 1M from the command line. */
+long long parse_size (const char *text);
+
+/** the time from a monotonic clock, in nanoseconds. */
+uint64_t monotonic_time (void);
+
 
 #endif
 